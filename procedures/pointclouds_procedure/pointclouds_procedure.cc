@@ -114,83 +114,159 @@ static int set_turbulence(void *self, const PropertyValue &value)
   return 0;
 }
 
+class CloudFilling {
+public:
+  CloudFilling() : volume(NULL), cp(NULL), turbulence(NULL), progress(NULL),
+      xmin(0), ymin(0), xmax(0), ymax(0), thresholdwidth(0) {}
+  ~CloudFilling() {}
+
+  Volume *volume;
+  const CloudControlPoint *cp;
+  const Turbulence *turbulence;
+  Progress *progress;
+
+  int xmin, ymin;
+  int xmax, ymax;
+  double thresholdwidth;
+};
+
+static void increment_progress(void *data)
+{
+  Progress *progress = reinterpret_cast<Progress *>(data);
+  progress->Increment();
+}
+
+static LoopStatus fill_slice(void *data, const ThreadContext &context)
+{
+  const CloudFilling *filling = reinterpret_cast<const CloudFilling *>(data);
+  Volume *volume = filling->volume;
+  const CloudControlPoint *cp = filling->cp;
+  const double thresholdwidth = filling->thresholdwidth;
+
+  // each slice is written by one thread
+  const int k = context.iteration_id;
+  const int row_size = filling->xmax - filling->xmin + 1;
+  int i, j;
+
+  // noise of a row is evaluated in one batch
+  std::vector<int> noise_index(row_size);
+  std::vector<double> noise_distance(row_size);
+  std::vector<Vector> noise_position(row_size);
+  std::vector<Real> noise_value(row_size);
+
+  for (j = filling->ymin; j <= filling->ymax; j++) {
+    int nnoises = 0;
+
+    for (i = filling->xmin; i <= filling->xmax; i++) {
+      double distance = 0;
+
+      Vector cell_center;
+      Vector P_local_space;
+      Vector P_noise_space;
+      float value = 0;
+
+      cell_center = volume->IndexToPoint(i, j, k);
+      P_local_space.x =  cell_center.x - cp->orig.x;
+      P_local_space.y =  cell_center.y - cp->orig.y;
+      P_local_space.z =  cell_center.z - cp->orig.z;
+      distance = Length(P_local_space);
+
+      if (distance < cp->radius - thresholdwidth) {
+        value = volume->GetValue(i, j, k);
+        volume->SetValue(i, j, k, Max(value, cp->density));
+        continue;
+      }
+
+      P_noise_space = P_local_space;
+      P_noise_space = Normalize(P_noise_space);
+      P_noise_space.x += cp->noise_space.x;
+      P_noise_space.y += cp->noise_space.y;
+      P_noise_space.z += cp->noise_space.z;
+
+      noise_index[nnoises] = i;
+      noise_distance[nnoises] = distance;
+      noise_position[nnoises] = P_noise_space;
+      nnoises++;
+    }
+
+    if (nnoises == 0) {
+      continue;
+    }
+    filling->turbulence->EvaluateBatch(&noise_position[0], nnoises, &noise_value[0]);
+
+    for (int n = 0; n < nnoises; n++) {
+      double sphere_func = 0;
+      double noise_func = 0;
+      double pyro_func = 0;
+      float pyro_value = 0;
+      float value = 0;
+
+      i = noise_index[n];
+
+      noise_func = noise_value[n];
+      noise_func = Abs(noise_func);
+      noise_func = Gamma(noise_func, .5);
+      noise_func *= cp->noise_amplitude;
+
+      sphere_func = noise_distance[n] - cp->radius;
+      pyro_func = sphere_func - noise_func;
+      pyro_value = Fit(pyro_func, -thresholdwidth, thresholdwidth, 1, 0);
+      pyro_value *= cp->density;
+
+      value = volume->GetValue(i, j, k);
+      volume->SetValue(i, j, k, Max(value, pyro_value));
+    }
+  }
+
+  MtCriticalSection(filling->progress, increment_progress);
+
+  return LoopStatus::Continue;
+}
+
 static int FillWithPointClouds(Volume *volume,
     const CloudControlPoint *cp, const Turbulence *turbulence)
 
 {
   // based on Production Volume Rendering (SIGGRAPH 2011) Course notes
-  int i, j, k;
   int xres, yres, zres;
   int xmin, ymin, zmin;
   int xmax, ymax, zmax;
 
-  double thresholdwidth = 0;
-
   // TODO come up with the best place to put progress
   Progress progress;
 
   volume->GetResolution(&xres, &yres, &zres);
-  thresholdwidth = .5 * volume->GetFilterSize();
 
   VolGetIndexRange(volume, &cp->orig, cp->radius * 1.5,
       &xmin, &ymin, &zmin,
       &xmax, &ymax, &zmax);
 
-  progress.Start(
-      (xmax - xmin + 1) *
-      (ymax - ymin + 1) *
-      (zmax - zmin + 1));
-
-  for (k = zmin; k <= zmax; k++) {
-    for (j = ymin; j <= ymax; j++) {
-      for (i = xmin; i <= xmax; i++) {
-        double sphere_func = 0;
-        double noise_func = 0;
-        double pyro_func = 0;
-        double distance = 0;
-
-        Vector cell_center;
-        Vector P_local_space;
-        Vector P_noise_space;
-        float pyro_value = 0;
-        float value = 0;
-
-        cell_center = volume->IndexToPoint(i, j, k);
-        P_local_space.x =  cell_center.x - cp->orig.x;
-        P_local_space.y =  cell_center.y - cp->orig.y;
-        P_local_space.z =  cell_center.z - cp->orig.z;
-        distance = Length(P_local_space);
-
-        if (distance < cp->radius - thresholdwidth) {
-          value = volume->GetValue(i, j, k);
-          volume->SetValue(i, j, k, Max(value, cp->density));
-          progress.Increment();
-          continue;
-        }
-
-        P_noise_space = P_local_space;
-        P_noise_space = Normalize(P_noise_space);
-        P_noise_space.x += cp->noise_space.x;
-        P_noise_space.y += cp->noise_space.y;
-        P_noise_space.z += cp->noise_space.z;
-
-        noise_func = turbulence->Evaluate(P_noise_space);
-        noise_func = Abs(noise_func);
-        noise_func = Gamma(noise_func, .5);
-        noise_func *= cp->noise_amplitude;
-
-        sphere_func = distance - cp->radius;
-        pyro_func = sphere_func - noise_func;
-        pyro_value = Fit(pyro_func, -thresholdwidth, thresholdwidth, 1, 0);
-        pyro_value *= cp->density;
-
-        value = volume->GetValue(i, j, k);
-        volume->SetValue(i, j, k, Max(value, pyro_value));
+  CloudFilling filling;
+  filling.volume = volume;
+  filling.cp = cp;
+  filling.turbulence = turbulence;
+  filling.progress = &progress;
+  filling.xmin = xmin;
+  filling.ymin = ymin;
+  filling.xmax = xmax;
+  filling.ymax = ymax;
+  filling.thresholdwidth = .5 * volume->GetFilterSize();
+
+  // slices out of volume have nothing to fill
+  zmin = Max(zmin, 0);
+  zmax = Min(zmax, zres - 1);
+  if (zmin > zmax) {
+    return 0;
+  }
 
-        progress.Increment();
-      }
-    }
+  std::vector<int> iteration_que;
+  for (int k = zmin; k <= zmax; k++) {
+    iteration_que.push_back(k);
   }
+
+  progress.Start(zmax - zmin + 1);
+  MtRunParallelLoop(&filling, fill_slice,
+      MtGetMaxAvailableThreadCount(), iteration_que);
   progress.Done();
 
   return 0;
@@ -141,32 +141,46 @@ static int set_turbulence(void *self, const PropertyValue &value)
   return 0;
 }
 
-static int FillWithSpecksAlongLine(Volume *volume,
-    const WispsControlPoint *cp0, const WispsControlPoint *cp1,
-    const Turbulence *turbulence)
-{
-  XorShift rng;
-  int NSPECKS = 1000;
-  int i = 0;
+// specks are generated and splatted in batches to bound memory
+static const int SPECK_BATCH_SIZE = 1 << 16;
+static const int SPECK_CHUNK_SIZE = 1 << 10;
 
-  // TODO come up with the best place to put progress
-  Progress progress;
+class SpeckGeneration {
+public:
+  SpeckGeneration() : cp0(NULL), cp1(NULL), turbulence(NULL),
+      disks(), line_t(), specks() {}
+  ~SpeckGeneration() {}
 
-  // TODO should not be a point attribute?
-  NSPECKS = cp0->speck_count;
+  const WispsControlPoint *cp0;
+  const WispsControlPoint *cp1;
+  const Turbulence *turbulence;
 
-  progress.Start(NSPECKS);
+  std::vector<Vector2> disks;
+  std::vector<double> line_t;
+  std::vector<VolumeSphere> specks;
+};
+
+static LoopStatus compute_specks(void *data, const ThreadContext &context)
+{
+  SpeckGeneration *gen = reinterpret_cast<SpeckGeneration *>(data);
+  const int nspecks = static_cast<int>(gen->specks.size());
+  const int begin = context.iteration_id * SPECK_CHUNK_SIZE;
+  const int end = Min(begin + SPECK_CHUNK_SIZE, nspecks);
 
-  for (i = 0; i < NSPECKS; i++) {
+  // noise of the chunk is evaluated in one batch
+  std::vector<WispsControlPoint> cps(end - begin);
+  std::vector<Vector> noise_position(end - begin);
+  std::vector<Vector> noise_value(end - begin);
+
+  for (int i = begin; i < end; i++) {
     WispsControlPoint cp_t;
     Vector P_speck;
     Vector P_noise_space;
-    Vector noise;
 
-    const Vector2 disk = rng.SolidDiskRand();
-    const double line_t = rng.NextFloat01();
+    const Vector2 &disk = gen->disks[i];
+    const double line_t = gen->line_t[i];
 
-    LerpWispConstrolPoint(&cp_t, cp0, cp1, line_t);
+    LerpWispConstrolPoint(&cp_t, gen->cp0, gen->cp1, line_t);
 
     P_speck = cp_t.orig;
     P_speck.x += cp_t.radius * disk.x * cp_t.udir.x + cp_t.radius * disk.y * cp_t.vdir.x;
@@ -176,7 +190,18 @@ static int FillWithSpecksAlongLine(Volume *volume,
     P_noise_space.x = cp_t.noise_space.x + disk.x;
     P_noise_space.y = cp_t.noise_space.y + disk.y;
     P_noise_space.z = cp_t.noise_space.z;
-    noise = turbulence->Evaluate3d(P_noise_space);
+
+    cps[i - begin] = cp_t;
+    noise_position[i - begin] = P_noise_space;
+    gen->specks[i].center = P_speck;
+  }
+
+  gen->turbulence->Evaluate3dBatch(&noise_position[0], end - begin, &noise_value[0]);
+
+  for (int i = begin; i < end; i++) {
+    const WispsControlPoint &cp_t = cps[i - begin];
+    Vector P_speck = gen->specks[i].center;
+    Vector noise = noise_value[i - begin];
 
     noise.x *= cp_t.radius * cp_t.noise_amplitude;
     noise.y *= cp_t.radius * cp_t.noise_amplitude;
@@ -186,7 +211,58 @@ static int FillWithSpecksAlongLine(Volume *volume,
     P_speck.y += noise.x * cp_t.udir.y + noise.y * cp_t.vdir.y + noise.z * cp_t.wdir.y;
     P_speck.z += noise.x * cp_t.udir.z + noise.y * cp_t.vdir.z + noise.z * cp_t.wdir.z;
 
-    FillWithSphere(volume, &P_speck, cp_t.speck_radius, cp_t.density);
+    gen->specks[i].center = P_speck;
+    gen->specks[i].radius = cp_t.speck_radius;
+    gen->specks[i].density = cp_t.density;
+  }
+
+  return LoopStatus::Continue;
+}
+
+static int FillWithSpecksAlongLine(Volume *volume,
+    const WispsControlPoint *cp0, const WispsControlPoint *cp1,
+    const Turbulence *turbulence)
+{
+  XorShift rng;
+  int NSPECKS = 1000;
+
+  // TODO come up with the best place to put progress
+  Progress progress;
+
+  // TODO should not be a point attribute?
+  NSPECKS = cp0->speck_count;
+  if (NSPECKS < 1) {
+    return 0;
+  }
+
+  const int thread_count = MtGetMaxAvailableThreadCount();
+  SpeckGeneration gen;
+  gen.cp0 = cp0;
+  gen.cp1 = cp1;
+  gen.turbulence = turbulence;
+
+  progress.Start((NSPECKS + SPECK_BATCH_SIZE - 1) / SPECK_BATCH_SIZE);
+
+  for (int batch_start = 0; batch_start < NSPECKS; batch_start += SPECK_BATCH_SIZE) {
+    const int nspecks = Min(SPECK_BATCH_SIZE, NSPECKS - batch_start);
+    gen.disks.resize(nspecks);
+    gen.line_t.resize(nspecks);
+    gen.specks.resize(nspecks);
+
+    // random numbers are drawn in order so that specks do not depend on
+    // thread count
+    for (int i = 0; i < nspecks; i++) {
+      gen.disks[i] = rng.SolidDiskRand();
+      gen.line_t[i] = rng.NextFloat01();
+    }
+
+    std::vector<int> iteration_que;
+    for (int i = 0; i * SPECK_CHUNK_SIZE < nspecks; i++) {
+      iteration_que.push_back(i);
+    }
+    MtRunParallelLoop(&gen, compute_specks, thread_count, iteration_que);
+
+    FillWithSpheres(volume, &gen.specks[0], nspecks, thread_count);
     progress.Increment();
   }
   progress.Done();
@@ -137,38 +137,51 @@ static int set_turbulence(void *self, const PropertyValue &value)
   return 0;
 }
 
-static int FillWithSpecksOnSurface(Volume *volume,
-    const WispsControlPoint *cp00, const WispsControlPoint *cp10,
-    const WispsControlPoint *cp01, const WispsControlPoint *cp11,
-    const Turbulence *turbulence)
+// specks are generated and splatted in batches to bound memory
+static const int SPECK_BATCH_SIZE = 1 << 16;
+static const int SPECK_CHUNK_SIZE = 1 << 10;
 
-{
-  XorShift rng;
-  int NSPECKS = 1000;
-  int i = 0;
+class SpeckGeneration {
+public:
+  SpeckGeneration() : cp00(NULL), cp10(NULL), cp01(NULL), cp11(NULL), turbulence(NULL),
+      cubes(), specks() {}
+  ~SpeckGeneration() {}
+
+  const WispsControlPoint *cp00;
+  const WispsControlPoint *cp10;
+  const WispsControlPoint *cp01;
+  const WispsControlPoint *cp11;
+  const Turbulence *turbulence;
 
-  // TODO come up with the best place to put progress
-  Progress progress;
+  std::vector<Vector> cubes;
+  std::vector<VolumeSphere> specks;
+};
 
-  // TODO should not be a point attribute?
-  NSPECKS = cp00->speck_count;
+static LoopStatus compute_specks(void *data, const ThreadContext &context)
+{
+  SpeckGeneration *gen = reinterpret_cast<SpeckGeneration *>(data);
+  const int nspecks = static_cast<int>(gen->specks.size());
+  const int begin = context.iteration_id * SPECK_CHUNK_SIZE;
+  const int end = Min(begin + SPECK_CHUNK_SIZE, nspecks);
 
-  progress.Start(NSPECKS);
+  // noise of the chunk is evaluated in one batch
+  std::vector<WispsControlPoint> cps(end - begin);
+  std::vector<Vector> noise_position(end - begin);
+  std::vector<Vector> noise_value(end - begin);
 
-  for (i = 0; i < NSPECKS; i++) {
+  for (int i = begin; i < end; i++) {
     WispsControlPoint cp_t;
     Vector P_speck;
     Vector P_noise_space;
-    Vector noise;
     double s = 0;
     double t = 0;
 
-    const Vector cube = rng.SolidCubeRand();
+    const Vector &cube = gen->cubes[i];
 
     s = cube.x;
     t = cube.y;
 
-    BilerpWispConstrolPoint(&cp_t, cp00, cp10, cp01, cp11, s, t);
+    BilerpWispConstrolPoint(&cp_t, gen->cp00, gen->cp10, gen->cp01, gen->cp11, s, t);
 
     P_speck = cp_t.orig;
     P_speck.x += cp_t.radius * cube.z * cp_t.wdir.x;
@@ -178,7 +191,18 @@ static int FillWithSpecksOnSurface(Volume *volume,
     P_noise_space.x = cp_t.noise_space.x;
     P_noise_space.y = cp_t.noise_space.y;
     P_noise_space.z = cp_t.noise_space.z + cube.z;
-    noise = turbulence->Evaluate3d(P_noise_space);
+
+    cps[i - begin] = cp_t;
+    noise_position[i - begin] = P_noise_space;
+    gen->specks[i].center = P_speck;
+  }
+
+  gen->turbulence->Evaluate3dBatch(&noise_position[0], end - begin, &noise_value[0]);
+
+  for (int i = begin; i < end; i++) {
+    const WispsControlPoint &cp_t = cps[i - begin];
+    Vector P_speck = gen->specks[i].center;
+    Vector noise = noise_value[i - begin];
 
     noise.x *= cp_t.noise_amplitude;
     noise.y *= cp_t.noise_amplitude;
@@ -188,7 +212,59 @@ static int FillWithSpecksOnSurface(Volume *volume,
     P_speck.y += noise.x * cp_t.udir.y + noise.y * cp_t.vdir.y + noise.z * cp_t.wdir.y;
     P_speck.z += noise.x * cp_t.udir.z + noise.y * cp_t.vdir.z + noise.z * cp_t.wdir.z;
 
-    FillWithSphere(volume, &P_speck, cp_t.speck_radius, cp_t.density);
+    gen->specks[i].center = P_speck;
+    gen->specks[i].radius = cp_t.speck_radius;
+    gen->specks[i].density = cp_t.density;
+  }
+
+  return LoopStatus::Continue;
+}
+
+static int FillWithSpecksOnSurface(Volume *volume,
+    const WispsControlPoint *cp00, const WispsControlPoint *cp10,
+    const WispsControlPoint *cp01, const WispsControlPoint *cp11,
+    const Turbulence *turbulence)
+{
+  XorShift rng;
+  int NSPECKS = 1000;
+
+  // TODO come up with the best place to put progress
+  Progress progress;
+
+  // TODO should not be a point attribute?
+  NSPECKS = cp00->speck_count;
+  if (NSPECKS < 1) {
+    return 0;
+  }
+
+  const int thread_count = MtGetMaxAvailableThreadCount();
+  SpeckGeneration gen;
+  gen.cp00 = cp00;
+  gen.cp10 = cp10;
+  gen.cp01 = cp01;
+  gen.cp11 = cp11;
+  gen.turbulence = turbulence;
+
+  progress.Start((NSPECKS + SPECK_BATCH_SIZE - 1) / SPECK_BATCH_SIZE);
+
+  for (int batch_start = 0; batch_start < NSPECKS; batch_start += SPECK_BATCH_SIZE) {
+    const int nspecks = Min(SPECK_BATCH_SIZE, NSPECKS - batch_start);
+    gen.cubes.resize(nspecks);
+    gen.specks.resize(nspecks);
+
+    // random numbers are drawn in order so that specks do not depend on
+    // thread count
+    for (int i = 0; i < nspecks; i++) {
+      gen.cubes[i] = rng.SolidCubeRand();
+    }
+
+    std::vector<int> iteration_que;
+    for (int i = 0; i * SPECK_CHUNK_SIZE < nspecks; i++) {
+      iteration_que.push_back(i);
+    }
+    MtRunParallelLoop(&gen, compute_specks, thread_count, iteration_que);
+
+    FillWithSpheres(volume, &gen.specks[0], nspecks, thread_count);
     progress.Increment();
   }
   progress.Done();
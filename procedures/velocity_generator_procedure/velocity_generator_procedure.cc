@@ -11,11 +11,14 @@ using namespace fj;
 
 class VelocityGeneratorProcedure : Procedure {
 public:
-  VelocityGeneratorProcedure() : mesh(NULL) {}
+  VelocityGeneratorProcedure() : mesh(NULL), position_sample_count(1) {}
   virtual ~VelocityGeneratorProcedure() {}
 
 public:
   Mesh *mesh;
+  // > 1 advects points through the field into position samples
+  // instead of setting velocity. paths curve with more samples
+  int position_sample_count;
 
 private:
   virtual int run() const;
@@ -26,16 +29,20 @@ static void MyDeleteFunction(void *self);
 static const char MyPluginName[] = "VelocityGeneratorProcedure";
 
 static int set_mesh(void *self, const PropertyValue &value);
+static int set_position_sample_count(void *self, const PropertyValue &value);
 
+static Vector compute_velocity(const Vector &pos, double zmin, double zmax);
 static int generate_velocity(Mesh &mesh);
+static int generate_position_samples(Mesh &mesh, int sample_count);
 
 static const Property MyPropertyList[] = {
   Property("mesh",    PropMesh(NULL),  set_mesh),
+  Property("position_sample_count", PropScalar(1), set_position_sample_count),
   Property()
 };
 
 static const MetaInfo MyMetainfo[] = {
-  {"help", "Generate velocity on mesh."},
+  {"help", "Generate velocity or deformation position samples on mesh."},
   {"plugin_type", "Procedure"},
   {NULL, NULL}
 };
@@ -76,6 +83,10 @@ int VelocityGeneratorProcedure::run() const
     return -1;
   }
 
+  if (position_sample_count > 1) {
+    return generate_position_samples(*mesh, position_sample_count);
+  }
+
   const int err = generate_velocity(*mesh);
 
   return err;
@@ -93,6 +104,27 @@ static int set_mesh(void *self, const PropertyValue &value)
   return 0;
 }
 
+static int set_position_sample_count(void *self, const PropertyValue &value)
+{
+  VelocityGeneratorProcedure *velgen = (VelocityGeneratorProcedure *) self;
+
+  if (value.vector[0] < 1)
+    return -1;
+
+  velgen->position_sample_count = (int) value.vector[0];
+
+  return 0;
+}
+
+static Vector compute_velocity(const Vector &pos, double zmin, double zmax)
+{
+  const double znml = (pos.z - zmin) / (zmax - zmin);
+  const double vscale = .2 * (1 - SmoothStep(.2, .7, znml));
+
+  const Vector noise_vec = PerlinNoise3d(.2 * pos, 2, .5, 1);
+  return vscale * noise_vec;
+}
+
 static int generate_velocity(Mesh &mesh)
 {
   const int POINT_COUNT = mesh.GetPointCount();
@@ -104,14 +136,35 @@ static int generate_velocity(Mesh &mesh)
 
   for (int i = 0; i < POINT_COUNT; i++) {
     const Vector pos = mesh.GetPointPosition(i);
+    const Vector vel = compute_velocity(pos, zmin, zmax);
+
+    mesh.SetPointVelocity(i, vel);
+  }
 
-    const double znml = (pos.z - zmin) / (zmax - zmin);
-    const double vscale = .2 * (1 - SmoothStep(.2, .7, znml));
+  mesh.ComputeNormals();
+  mesh.ComputeBounds();
 
-    const Vector noise_vec = PerlinNoise3d(.2 * pos, 2, .5, 1);
-    const Vector vel = vscale * noise_vec;
+  return 0;
+}
 
-    mesh.SetPointVelocity(i, vel);
+static int generate_position_samples(Mesh &mesh, int sample_count)
+{
+  const int POINT_COUNT = mesh.GetPointCount();
+  const double zmin = mesh.GetBounds().min.z;
+  const double zmax = mesh.GetBounds().max.z;
+  const double dt = 1. / (sample_count - 1);
+
+  printf("Point Count: %d\n", POINT_COUNT);
+  printf("Position Sample Count: %d\n", sample_count);
+  mesh.SetPointPositionSampleCount(sample_count);
+
+  for (int i = 0; i < POINT_COUNT; i++) {
+    Vector pos = mesh.GetPointPosition(i);
+
+    for (int s = 1; s < sample_count; s++) {
+      pos += dt * compute_velocity(pos, zmin, zmax);
+      mesh.SetPointPositionSample(s, i, pos);
+    }
   }
 
   mesh.ComputeNormals();
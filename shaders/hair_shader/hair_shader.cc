@@ -89,7 +89,7 @@ void HairShader::evaluate(const TraceContext &cxt,
 {
   LightSample *samples = NULL;
   // allocate samples
-  samples = SlNewLightSamples(&in);
+  samples = SlNewLightSamples(&cxt, &in);
 
   out->Cs = Color();
   const int nsamples = SlGetLightSampleCount(&in);
@@ -113,7 +113,7 @@ void HairShader::evaluate(const TraceContext &cxt,
     out->Cs.b += (in.Cd.b * diffuse.b * diff + spec) * Lout.Cl.b;
   }
 
-  SlFreeLightSamples(samples);
+  SlFreeLightSamples(&cxt, samples);
 
   out->Os = 1;
 }
@@ -2,7 +2,6 @@
 // See LICENSE and README
 
 #include "fj_shader.h"
-#include "fj_multi_thread.h"
 
 using namespace fj;
 
@@ -46,8 +45,6 @@ private:
   // TODO TEST
   Color direct_lighting(const TraceContext &cxt,
       const SurfaceInput &in, SurfaceOutput *out) const;
-
-  mutable XorShift rng[64];
 };
 
 static void *MyCreateFunction(void);
@@ -183,9 +180,9 @@ Color PathtracingShader::integrate_diffuse(const TraceContext &cxt,
   u = Normalize(u);
   v = Cross(w, u);
 
-  const int id = MtGetThreadID();
-  const Real r1 = 2. * PI * rng[id].NextFloat01();
-  const Real r2 = rng[id].NextFloat01();
+  XorShift &rng = SlGetShadingContext(&cxt)->GetRandom();
+  const Real r1 = 2. * PI * rng.NextFloat01();
+  const Real r2 = rng.NextFloat01();
   const Real r2sqrt = Sqrt(r2);
 
   const Vector D = Normalize(
@@ -260,10 +257,10 @@ Color PathtracingShader::direct_lighting(const TraceContext &cxt,
       const SurfaceInput &in, SurfaceOutput *out) const
 {
   // allocate samples
-  LightSample *samples = SlNewLightSamples(&in);
+  LightSample *samples = SlNewLightSamples(&cxt, &in);
   const Vector D = Normalize(samples[0].P - in.P);
   // free samples
-  SlFreeLightSamples(samples);
+  SlFreeLightSamples(&cxt, samples);
   //----------------------------------------------------------
 
   const Real Kd = Dot(in.N, D);
@@ -283,7 +280,7 @@ Color PathtracingShader::direct_lighting(const TraceContext &cxt,
   SlFaceforward(&in.I, &in.N, &Nf);
 
   // allocate samples
-  LightSample *samples = SlNewLightSamples(&in);
+  LightSample *samples = SlNewLightSamples(&cxt, &in);
   const int nsamples = SlGetLightSampleCount(&in);
 
   Color C_direct;
@@ -297,7 +294,7 @@ Color PathtracingShader::direct_lighting(const TraceContext &cxt,
     C_direct += in.Cd * Kd * diffuse * Lout.Cl + Ks * specular * Lout.Cl;
   }
   // free samples
-  SlFreeLightSamples(samples);
+  SlFreeLightSamples(&cxt, samples);
 
   return C_direct;
 #endif
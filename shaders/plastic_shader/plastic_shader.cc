@@ -123,7 +123,7 @@ void PlasticShader::evaluate(const TraceContext &cxt,
   }
 
   // allocate samples
-  samples = SlNewLightSamples(&in);
+  samples = SlNewLightSamples(&cxt, &in);
 
   for (i = 0; i < nsamples; i++) {
     LightOutput Lout;
@@ -143,7 +143,7 @@ void PlasticShader::evaluate(const TraceContext &cxt,
   }
 
   // free samples
-  SlFreeLightSamples(samples);
+  SlFreeLightSamples(&cxt, samples);
 
   // diffuse map
   if (diffuse_map != NULL) {
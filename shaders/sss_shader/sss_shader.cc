@@ -34,8 +34,6 @@ public:
   int enable_single_scattering;
   int enable_multiple_scattering;
 
-  XorShift rng;
-
   float scattering_coeff[3];
   float absorption_coeff[3];
   float extinction_coeff[3];
@@ -155,7 +153,7 @@ void SSSShader::evaluate(const TraceContext &cxt,
   const int nsamples = SlGetLightSampleCount(&in);
 
   // allocate samples
-  samples = SlNewLightSamples(&in);
+  samples = SlNewLightSamples(&cxt, &in);
 
   for (int i = 0; i < nsamples; i++) {
     LightOutput Lout;
@@ -180,7 +178,7 @@ void SSSShader::evaluate(const TraceContext &cxt,
     }
   }
 
-  SlFreeLightSamples(samples);
+  SlFreeLightSamples(&cxt, samples);
 
   // diffuse map
   Color4 diff_map4(1, 1, 1, 1);
@@ -250,9 +248,9 @@ Color SSSShader::single_scattering(const TraceContext &cxt, const SurfaceInput &
   SlRefract(&in.I, &in.N, one_over_eta, &To);
   To = Normalize(To);
 
+  XorShift &rng = SlGetShadingContext(&cxt)->GetRandom();
   for (i = 0; i < nsamples; i++) {
-    XorShift &mutable_rng = const_cast<XorShift &>(rng);
-    const float sp_dist = -log(mutable_rng.NextFloat01());
+    const float sp_dist = -log(rng.NextFloat01());
 
     for (j = 0; j < 3; j++) {
       Vector P_sample;
@@ -385,9 +383,9 @@ Color SSSShader::diffusion_scattering(const TraceContext &cxt, const SurfaceInpu
   base1 = Normalize(base1);
   base2 = Cross(N, base1);
 
+  XorShift &rng = SlGetShadingContext(&cxt)->GetRandom();
   for (i = 0; i < nsamples; i++) {
-    XorShift &mutable_rng = const_cast<XorShift &>(rng);
-    const double dist_rand = -log(mutable_rng.NextFloat01());
+    const double dist_rand = -log(rng.NextFloat01());
 
     for (j = 0; j < 3; j++) {
       const TraceContext self_cxt = SlSelfHitContext(&cxt, in.shaded_object);
@@ -415,7 +413,7 @@ Color SSSShader::diffusion_scattering(const TraceContext &cxt, const SurfaceInpu
 
       const double dist = dist_rand / sigma_tr[j];
 
-      disk = mutable_rng.HollowDiskRand();
+      disk = rng.HollowDiskRand();
       disk.x *= dist;
       disk.y *= dist;
       P_sample.x = P.x + 1/sigma_tr[j] * (disk.x * base1.x + disk.y * base2.x);
@@ -75,7 +75,7 @@ void VolumeShader::evaluate(const TraceContext &cxt,
   const int nsamples = SlGetLightSampleCount(&in);
 
   // allocate samples
-  samples = SlNewLightSamples(&in);
+  samples = SlNewLightSamples(&cxt, &in);
 
   for (int i = 0; i < nsamples; i++) {
     LightOutput Lout;
@@ -86,7 +86,7 @@ void VolumeShader::evaluate(const TraceContext &cxt,
     diff += Lout.Cl;
   }
 
-  SlFreeLightSamples(samples);
+  SlFreeLightSamples(&cxt, samples);
 
   // Cs
   out->Cs = diff * diffuse;
@@ -5,6 +5,7 @@
 #include "fj_intersection.h"
 #include "fj_primitive_set.h"
 #include "fj_accelerator.h"
+#include "fj_multi_thread.h"
 #include "fj_numeric.h"
 #include "fj_box.h"
 #include "fj_ray.h"
@@ -19,6 +20,9 @@ namespace fj {
 
 static const char ACCELERATOR_NAME[] = "BVH";
 
+// both halves of a node need this many primitives to be built in parallel
+static const int PARALLEL_BUILD_PRIM_COUNT = 4096;
+
 enum {
   HIT_NONE = 0,
   HIT_LEFT = 1,
@@ -250,6 +254,25 @@ public:
   }
 };
 
+class BuildTask {
+public:
+  BuildTask() {}
+  ~BuildTask() {}
+
+  Primitive **primptrs = NULL;
+  int begin = 0;
+  int end = 0;
+  int axis = 0;
+  BVHNode *node = NULL;
+};
+
+static LoopStatus build_bvh_task(void *data, const ThreadContext &context)
+{
+  BuildTask *task = static_cast<BuildTask *>(data);
+  task->node = build_bvh(task->primptrs, task->begin, task->end, task->axis);
+  return LoopStatus::Continue;
+}
+
 static BVHNode *build_bvh(Primitive **primptrs, int begin, int end, int axis)
 {
   BVHNode *node = new_bvhnode();
@@ -281,11 +304,33 @@ static BVHNode *build_bvh(Primitive **primptrs, int begin, int end, int axis)
   const int median = find_median(primptrs, begin, end, axis);
   const int new_axis = (axis + 1) % 3;
 
-  node->left  = build_bvh(primptrs, begin, median, new_axis);
+  if (median - begin >= PARALLEL_BUILD_PRIM_COUNT &&
+      end - median >= PARALLEL_BUILD_PRIM_COUNT) {
+    // the left half goes to the task group. an idle thread can steal it
+    // while this thread builds the right half
+    BuildTask left_task;
+    left_task.primptrs = primptrs;
+    left_task.begin = begin;
+    left_task.end = median;
+    left_task.axis = new_axis;
+
+    MtTaskGroup group;
+    group.Run(&left_task, build_bvh_task, 0);
+    node->right = build_bvh(primptrs, median, end, new_axis);
+    group.Wait();
+
+    node->left = left_task.node;
+  } else {
+    node->left  = build_bvh(primptrs, begin, median, new_axis);
+    if (node->left == NULL)
+      return NULL;
+
+    node->right = build_bvh(primptrs, median, end, new_axis);
+  }
+
   if (node->left == NULL)
     return NULL;
 
-  node->right = build_bvh(primptrs, median, end, new_axis);
   if (node->right == NULL)
     return NULL;
 
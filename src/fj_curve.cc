@@ -21,6 +21,9 @@
 
 namespace fj {
 
+// segments are split up to 2^MAX_SEGMENT_LEVEL per curve
+static const int MAX_SEGMENT_LEVEL = 3;
+
 #define ATTR(Class, Type, Name, Label) \
 void Curve::Add##Class##Label() \
 { \
@@ -73,8 +76,13 @@ static bool converge_bezier3(const Bezier3 &bezier,
     Real v0, Real vn, int depth,
     Real *v_hit, Real *P_hit);
 static void time_sample_bezier3(Bezier3 *bezier, Real time);
+static void get_sub_bezier3(const Bezier3 &bezier, int level, int segment_id,
+    Bezier3 *sub, Real *v0, Real *vn);
 
 static bool box_bezier3_intersect_recursive(const Box &box, const Bezier3 &bezier, int depth);
+static bool ribbon_bezier3_intersect(const Bezier3 &bezier,
+    Real v0, Real vn, const Ray &ray,
+    Real *v_hit, Real *t_hit);
 
 // helper functions
 static inline Vector mid_point(const Vector &a, const Vector &b)
@@ -90,7 +98,8 @@ static inline Real dot_xy(const Vector &a, const Vector &b)
   return a.x * b.x + a.y * b.y;
 }
 
-Curve::Curve() : nverts_(0), ncurves_(0)
+Curve::Curve() : nverts_(0), ncurves_(0),
+    intersection_mode_(CURVE_TUBE), ribbon_width_(.001)
 {
 }
 
@@ -165,6 +174,26 @@ void Curve::Clear()
   split_depth_.clear();
 }
 
+void Curve::SetIntersectionMode(int mode)
+{
+  intersection_mode_ = mode;
+}
+
+void Curve::SetRibbonWidth(Real ribbon_width)
+{
+  ribbon_width_ = Max(ribbon_width, 0);
+}
+
+int Curve::GetIntersectionMode() const
+{
+  return intersection_mode_;
+}
+
+Real Curve::GetRibbonWidth() const
+{
+  return ribbon_width_;
+}
+
 void Curve::cache_split_depth()
 {
   assert(split_depth_.empty());
@@ -184,41 +213,102 @@ void Curve::cache_split_depth()
   }
 }
 
-bool Curve::ray_intersect(Index prim_id, const Ray &ray,
-    Real time, Intersection *isect) const
+int Curve::GetSegmentLevel(Index prim_id) const
+{
+  return Min(split_depth_[prim_id], MAX_SEGMENT_LEVEL);
+}
+
+void Curve::GetSegmentCapsule(Index prim_id, int level, int segment_id,
+    Vector *P0, Vector *P1, Vector *velocity0, Vector *velocity1,
+    Real *radius) const
+{
+  Bezier3 bezier;
+  Bezier3 sub;
+  Real v0 = 0;
+  Real vn = 1;
+
+  get_bezier3(this, prim_id, &bezier);
+  get_sub_bezier3(bezier, level, segment_id, &sub, &v0, &vn);
+
+  const Vector axis = sub.cp[3] - sub.cp[0];
+  const Real axis_len2 = Dot(axis, axis);
+  Real max_dist = 0;
+
+  // every point on the segment lies in the convex hull of the control points.
+  // each control point stays within (distance to axis) + (velocity deviation
+  // from the axis velocity) from the moving axis over the shutter interval.
+  for (int i = 0; i < 4; i++) {
+    Real s = 0;
+    if (axis_len2 > 0) {
+      s = Clamp(Dot(sub.cp[i] - sub.cp[0], axis) / axis_len2, 0, 1);
+    }
+    const Vector P_axis = sub.cp[0] + s * axis;
+    const Vector velocity_axis = sub.velocity[0] + s * (sub.velocity[3] - sub.velocity[0]);
+    const Real dist =
+        Length(sub.cp[i] - P_axis) +
+        Length(sub.velocity[i] - velocity_axis);
+    max_dist = Max(max_dist, dist);
+  }
+
+  *P0 = sub.cp[0];
+  *P1 = sub.cp[3];
+  *velocity0 = sub.velocity[0];
+  *velocity1 = sub.velocity[3];
+  *radius = max_dist + get_bezier3_max_radius(sub);
+}
+
+bool Curve::RayIntersectSegment(Index prim_id, int level, int segment_id,
+    const Ray &ray, Real time, Intersection *isect) const
 {
   Matrix world_to_ray;
   Bezier3 bezier;
+  Bezier3 sub;
   Ray nml_ray;
-
-  // for scaled ray
-  const Real ray_scale = Length(ray.dir);
-  nml_ray = ray;
-  nml_ray.dir /= ray_scale;
+  Real v0 = 0;
+  Real vn = 1;
 
   get_bezier3(this, prim_id, &bezier);
-  const int depth = split_depth_[prim_id];
   time_sample_bezier3(&bezier, time);
+  get_sub_bezier3(bezier, level, segment_id, &sub, &v0, &vn);
 
-  compute_world_to_ray_matrix(nml_ray, &world_to_ray);
-  for (int i = 0; i < 4; i++) {
-    MatTransformPoint(world_to_ray, &bezier.cp[i]);
+  Real t_hit = REAL_MAX;
+  Real v_hit = REAL_MAX;
+  bool ribbon = intersection_mode_ == CURVE_RIBBON;
+
+  if (intersection_mode_ == CURVE_AUTO) {
+    const Vector center = mid_point(sub.cp[0], sub.cp[3]);
+    const Real dist = Length(center - ray.orig);
+    ribbon = 2 * get_bezier3_max_radius(sub) < ribbon_width_ * dist;
   }
 
-  Real ttmp = REAL_MAX;
-  Real v_hit = REAL_MAX;
+  bool hit = false;
+  if (ribbon) {
+    hit = ribbon_bezier3_intersect(sub, v0, vn, ray, &v_hit, &t_hit);
+  } else {
+    // for scaled ray
+    const Real ray_scale = Length(ray.dir);
+    nml_ray = ray;
+    nml_ray.dir /= ray_scale;
+
+    const int depth = Max(split_depth_[prim_id] - level, 0);
+
+    compute_world_to_ray_matrix(nml_ray, &world_to_ray);
+    for (int i = 0; i < 4; i++) {
+      MatTransformPoint(world_to_ray, &sub.cp[i]);
+    }
+
+    Real ttmp = REAL_MAX;
+    hit = converge_bezier3(sub, v0, vn, depth, &v_hit, &ttmp);
+    t_hit = ttmp / ray_scale;
+  }
 
-  const bool hit = converge_bezier3(bezier, 0, 1, depth, &v_hit, &ttmp);
   if (hit) {
     // P
-    isect->t_hit = ttmp / ray_scale;
+    isect->t_hit = t_hit;
     isect->P = RayPointAt(ray, isect->t_hit);
 
     // dPdv
-    Bezier3 original;
-    get_bezier3(this, prim_id, &original);
-    time_sample_bezier3(&original, time);
-    isect->dPdv = derivative_bezier3(original.cp, v_hit);
+    isect->dPdv = derivative_bezier3(bezier.cp, v_hit);
 
     // Cd
     const int i0 = GetCurveIndices(prim_id);
@@ -231,6 +321,40 @@ bool Curve::ray_intersect(Index prim_id, const Ray &ray,
   return hit;
 }
 
+bool Curve::ray_intersect(Index prim_id, const Ray &ray,
+    Real time, Intersection *isect) const
+{
+  if (intersection_mode_ == CURVE_TUBE) {
+    return RayIntersectSegment(prim_id, 0, 0, ray, time, isect);
+  }
+
+  Box bounds;
+  Real boxhit_tmin, boxhit_tmax;
+  GetPrimitiveBounds(prim_id, &bounds);
+  if (!BoxRayIntersect(bounds, ray.orig, ray.dir, ray.tmin, ray.tmax,
+        &boxhit_tmin, &boxhit_tmax)) {
+    return false;
+  }
+
+  // ribbons are linearized per segment
+  const int level = GetSegmentLevel(prim_id);
+  const int NSEGMENTS = 1 << level;
+  Intersection isect_tmp;
+  Real t_nearest = REAL_MAX;
+  bool hit = false;
+
+  for (int i = 0; i < NSEGMENTS; i++) {
+    if (RayIntersectSegment(prim_id, level, i, ray, time, &isect_tmp) &&
+        isect_tmp.t_hit < t_nearest) {
+      t_nearest = isect_tmp.t_hit;
+      *isect = isect_tmp;
+      hit = true;
+    }
+  }
+
+  return hit;
+}
+
 bool Curve::box_intersect(Index prim_id, const Box &box) const
 {
   const int recursive_depth = 5;
@@ -396,6 +520,81 @@ static void time_sample_bezier3(Bezier3 *bezier, Real time)
   }
 }
 
+// Treats the chord of the segment as a flat ribbon facing the ray.
+// The hit is at the closest points between the ray and the chord.
+static bool ribbon_bezier3_intersect(const Bezier3 &bezier,
+    Real v0, Real vn, const Ray &ray,
+    Real *v_hit, Real *t_hit)
+{
+  const Vector &dir = ray.dir;
+  const Vector axis = bezier.cp[3] - bezier.cp[0];
+  const Vector r = ray.orig - bezier.cp[0];
+
+  const Real a = Dot(dir, dir);
+  const Real b = Dot(dir, axis);
+  const Real c = Dot(dir, r);
+  const Real e = Dot(axis, axis);
+  const Real f = Dot(axis, r);
+  const Real denom = a * e - b * b;
+
+  Real t = denom > 0 ? (b * f - c * e) / denom : ray.tmin;
+  t = Clamp(t, ray.tmin, ray.tmax);
+  const Real s = e > 0 ? Clamp((b * t + f) / e, 0, 1) : 0;
+  t = Clamp((b * s - c) / a, ray.tmin, ray.tmax);
+
+  const Vector d = r + t * dir - s * axis;
+  const Real radius = .5 * get_bezier3_width(bezier, s);
+  if (Dot(d, d) > radius * radius) {
+    return false;
+  }
+
+  *t_hit = t;
+  *v_hit = Lerp(v0, vn, s);
+  return true;
+}
+
+static void get_sub_bezier3(const Bezier3 &bezier, int level, int segment_id,
+    Bezier3 *sub, Real *v0, Real *vn)
+{
+  Real v_begin = 0;
+  Real v_end = 1;
+
+  *sub = bezier;
+
+  // descend binary splits from the most significant bit of segment_id
+  for (int i = level - 1; i >= 0; i--) {
+    Bezier3 left;
+    Bezier3 right;
+    Bezier3 velocity_left;
+    Bezier3 velocity_right;
+    Bezier3 velocity;
+
+    for (int j = 0; j < 4; j++) {
+      velocity.cp[j] = sub->velocity[j];
+    }
+    split_bezier3(*sub, &left, &right);
+    split_bezier3(velocity, &velocity_left, &velocity_right);
+
+    const Real v_mid = (v_begin + v_end) * .5;
+    if ((segment_id >> i) & 1) {
+      *sub = right;
+      for (int j = 0; j < 4; j++) {
+        sub->velocity[j] = velocity_right.cp[j];
+      }
+      v_begin = v_mid;
+    } else {
+      *sub = left;
+      for (int j = 0; j < 4; j++) {
+        sub->velocity[j] = velocity_left.cp[j];
+      }
+      v_end = v_mid;
+    }
+  }
+
+  *v0 = v_begin;
+  *vn = v_end;
+}
+
 static bool box_bezier3_intersect(const Box &box, const Bezier3 &bezier)
 {
   const int N_STEPS = 1;
@@ -15,6 +15,13 @@
 
 namespace fj {
 
+// ray intersection modes
+enum {
+  CURVE_TUBE = 0,
+  CURVE_RIBBON,
+  CURVE_AUTO
+};
+
 class FJ_API Curve : public PrimitiveSet {
 public:
   Curve();
@@ -57,6 +64,21 @@ public:
   void ComputeBounds();
   void Clear();
 
+  // CURVE_AUTO switches to ribbon when width / distance to the ray origin
+  // is smaller than ribbon_width
+  void SetIntersectionMode(int mode);
+  void SetRibbonWidth(Real ribbon_width);
+  int GetIntersectionMode() const;
+  Real GetRibbonWidth() const;
+
+  // pre-split segments for hair accelerator
+  int GetSegmentLevel(Index prim_id) const;
+  void GetSegmentCapsule(Index prim_id, int level, int segment_id,
+      Vector *P0, Vector *P1, Vector *velocity0, Vector *velocity1,
+      Real *radius) const;
+  bool RayIntersectSegment(Index prim_id, int level, int segment_id,
+      const Ray &ray, Real time, Intersection *isect) const;
+
 private:
   virtual bool ray_intersect(Index prim_id, const Ray &ray,
       Real time, Intersection *isect) const;
@@ -79,6 +101,9 @@ private:
 
   std::vector<int> split_depth_;
 
+  int intersection_mode_;
+  Real ribbon_width_;
+
   void cache_split_depth();
 };
 
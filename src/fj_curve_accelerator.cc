@@ -0,0 +1,402 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "fj_curve_accelerator.h"
+#include "fj_intersection.h"
+#include "fj_numeric.h"
+#include "fj_curve.h"
+#include "fj_box.h"
+#include "fj_ray.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace fj {
+
+static const char ACCELERATOR_NAME[] = "Curve-BVH";
+static const int LEAF_SIZE = 8;
+static const int MAX_STACK_DEPTH = 64;
+
+// capsule of a pre-split curve segment
+class Segment {
+public:
+  Segment() :
+      bounds(), centroid(),
+      P0(), P1(), velocity0(), velocity1(), radius(0),
+      prim_id(0), level(0), segment_id(0) {}
+  ~Segment() {}
+
+  Box bounds;
+  Vector centroid;
+
+  Vector P0, P1;
+  Vector velocity0, velocity1;
+  Real radius;
+
+  int prim_id;
+  int level;
+  int segment_id;
+};
+
+// segments in a leaf are stored in structure of arrays
+// so that capsule tests for all lanes run in a single loop
+class CurveLeaf {
+public:
+  CurveLeaf() : count(0)
+  {
+    for (int i = 0; i < LEAF_SIZE; i++) {
+      P0x[i] = P0y[i] = P0z[i] = 0;
+      axisx[i] = axisy[i] = axisz[i] = 0;
+      v0x[i] = v0y[i] = v0z[i] = 0;
+      vaxisx[i] = vaxisy[i] = vaxisz[i] = 0;
+      // empty lanes never hit
+      radius2[i] = -1;
+      prim_id[i] = level[i] = segment_id[i] = 0;
+    }
+  }
+  ~CurveLeaf() {}
+
+  Real P0x[LEAF_SIZE], P0y[LEAF_SIZE], P0z[LEAF_SIZE];
+  Real axisx[LEAF_SIZE], axisy[LEAF_SIZE], axisz[LEAF_SIZE];
+  Real v0x[LEAF_SIZE], v0y[LEAF_SIZE], v0z[LEAF_SIZE];
+  Real vaxisx[LEAF_SIZE], vaxisy[LEAF_SIZE], vaxisz[LEAF_SIZE];
+  Real radius2[LEAF_SIZE];
+
+  int prim_id[LEAF_SIZE];
+  int level[LEAF_SIZE];
+  int segment_id[LEAF_SIZE];
+  int count;
+};
+
+class CurveNode {
+public:
+  CurveNode() : bounds(), left(-1), right(-1), leaf_id(-1) {}
+  ~CurveNode() {}
+
+  bool is_leaf() const
+  {
+    return leaf_id != -1;
+  }
+
+  Box bounds;
+  int left;
+  int right;
+  int leaf_id;
+};
+
+static int build_curve_bvh(std::vector<Segment> &segments, int begin, int end,
+    std::vector<CurveNode> &nodes, std::vector<CurveLeaf> &leaves);
+static void set_leaf_segment(CurveLeaf *leaf, int lane, const Segment &seg);
+static int intersect_leaf_capsules(const CurveLeaf &leaf,
+    const Ray &ray, Real time, Real tmin, Real tmax, int *hit_lanes);
+
+CurveAccelerator::CurveAccelerator() : curve_(NULL)
+{
+}
+
+CurveAccelerator::~CurveAccelerator()
+{
+}
+
+void CurveAccelerator::SetCurve(Curve *curve)
+{
+  curve_ = curve;
+  SetPrimitiveSet(curve);
+}
+
+int CurveAccelerator::build()
+{
+  if (curve_ == NULL) {
+    return -1;
+  }
+
+  const int NCURVES = curve_->GetCurveCount();
+  if (NCURVES == 0) {
+    // TODO is NCURVES == 0 error?
+    return -1;
+  }
+
+  std::vector<Segment> segments;
+
+  for (int i = 0; i < NCURVES; i++) {
+    const int level = curve_->GetSegmentLevel(i);
+    const int NSEGMENTS = 1 << level;
+
+    for (int j = 0; j < NSEGMENTS; j++) {
+      Segment seg;
+      seg.prim_id = i;
+      seg.level = level;
+      seg.segment_id = j;
+
+      curve_->GetSegmentCapsule(i, level, j,
+          &seg.P0, &seg.P1, &seg.velocity0, &seg.velocity1, &seg.radius);
+
+      // swept bounds over shutter interval [0, 1]
+      seg.bounds = Box(seg.P0, seg.P1);
+      seg.bounds.AddPoint(seg.P0 + seg.velocity0);
+      seg.bounds.AddPoint(seg.P1 + seg.velocity1);
+      seg.bounds.Expand(seg.radius);
+      seg.centroid = seg.bounds.Centroid();
+
+      segments.push_back(seg);
+    }
+  }
+
+  std::vector<CurveNode> nodes_tmp;
+  std::vector<CurveLeaf> leaves_tmp;
+  nodes_tmp.reserve(2 * segments.size() / LEAF_SIZE + 1);
+  leaves_tmp.reserve(segments.size() / LEAF_SIZE + 1);
+
+  build_curve_bvh(segments, 0, segments.size(), nodes_tmp, leaves_tmp);
+
+  // commit
+  nodes_.swap(nodes_tmp);
+  leaves_.swap(leaves_tmp);
+
+  return 0;
+}
+
+bool CurveAccelerator::intersect(const Ray &ray, Real time, Intersection *isect) const
+{
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  int stack[MAX_STACK_DEPTH];
+  int stack_size = 0;
+  int node_id = 0;
+  bool hit = false;
+  Real t_nearest = ray.tmax;
+
+  Intersection isect_candidates[2];
+  Intersection *isect_min = &isect_candidates[0];
+  Intersection *isect_tmp = &isect_candidates[1];
+
+  Real boxhit_tmin, boxhit_tmax;
+  if (!BoxRayIntersect(nodes_[0].bounds, ray.orig, ray.dir, ray.tmin, t_nearest,
+        &boxhit_tmin, &boxhit_tmax)) {
+    return false;
+  }
+
+  for (;;) {
+    const CurveNode &node = nodes_[node_id];
+
+    if (node.is_leaf()) {
+      const CurveLeaf &leaf = leaves_[node.leaf_id];
+      int hit_lanes[LEAF_SIZE];
+      const int nhits = intersect_leaf_capsules(leaf, ray, time,
+          ray.tmin, t_nearest, hit_lanes);
+
+      for (int i = 0; i < nhits; i++) {
+        const int lane = hit_lanes[i];
+        const bool hittmp = curve_->RayIntersectSegment(leaf.prim_id[lane],
+            leaf.level[lane], leaf.segment_id[lane], ray, time, isect_tmp);
+
+        if (hittmp &&
+            RayInRange(ray, isect_tmp->t_hit) &&
+            isect_tmp->t_hit < isect_min->t_hit) {
+          std::swap(isect_min, isect_tmp);
+          t_nearest = isect_min->t_hit;
+          hit = true;
+        }
+      }
+
+      if (stack_size == 0)
+        break;
+      node_id = stack[--stack_size];
+      continue;
+    }
+
+    const CurveNode &left = nodes_[node.left];
+    const CurveNode &right = nodes_[node.right];
+    Real left_tmin, left_tmax;
+    Real right_tmin, right_tmax;
+
+    const bool hit_left = BoxRayIntersect(left.bounds,
+        ray.orig, ray.dir, ray.tmin, t_nearest,
+        &left_tmin, &left_tmax);
+    const bool hit_right = BoxRayIntersect(right.bounds,
+        ray.orig, ray.dir, ray.tmin, t_nearest,
+        &right_tmin, &right_tmax);
+
+    if (hit_left && hit_right) {
+      // visit the nearer child first to shrink t_nearest early
+      if (left_tmin <= right_tmin) {
+        stack[stack_size++] = node.right;
+        node_id = node.left;
+      } else {
+        stack[stack_size++] = node.left;
+        node_id = node.right;
+      }
+    }
+    else if (hit_left) {
+      node_id = node.left;
+    }
+    else if (hit_right) {
+      node_id = node.right;
+    }
+    else {
+      if (stack_size == 0)
+        break;
+      node_id = stack[--stack_size];
+    }
+  }
+
+  if (hit) {
+    *isect = *isect_min;
+  }
+
+  return hit;
+}
+
+const char *CurveAccelerator::get_name() const
+{
+  return ACCELERATOR_NAME;
+}
+
+// Compares an axis component of segment centroid for std::nth_element.
+class SegmentCentroidLess {
+public:
+  SegmentCentroidLess(int axis) : axis_(axis) {}
+  bool operator()(const Segment &a, const Segment &b) const
+  {
+    return a.centroid[axis_] < b.centroid[axis_];
+  }
+
+private:
+  int axis_;
+};
+
+static int build_curve_bvh(std::vector<Segment> &segments, int begin, int end,
+    std::vector<CurveNode> &nodes, std::vector<CurveLeaf> &leaves)
+{
+  const int node_id = nodes.size();
+  nodes.push_back(CurveNode());
+
+  Box bounds;
+  Box centroid_bounds;
+  bounds.ReverseInfinite();
+  centroid_bounds.ReverseInfinite();
+  for (int i = begin; i < end; i++) {
+    bounds.AddBox(segments[i].bounds);
+    centroid_bounds.AddPoint(segments[i].centroid);
+  }
+
+  if (end - begin <= LEAF_SIZE) {
+    CurveLeaf leaf;
+    for (int i = begin; i < end; i++) {
+      set_leaf_segment(&leaf, i - begin, segments[i]);
+    }
+    leaf.count = end - begin;
+
+    nodes[node_id].bounds = bounds;
+    nodes[node_id].leaf_id = leaves.size();
+    leaves.push_back(leaf);
+    return node_id;
+  }
+
+  // split at median of the longest centroid axis
+  const Vector diagonal = centroid_bounds.Diagonal();
+  int axis = 0;
+  if (diagonal[1] > diagonal[axis]) axis = 1;
+  if (diagonal[2] > diagonal[axis]) axis = 2;
+
+  const int median = (begin + end) / 2;
+  std::nth_element(segments.begin() + begin,
+      segments.begin() + median,
+      segments.begin() + end,
+      SegmentCentroidLess(axis));
+
+  const int left  = build_curve_bvh(segments, begin, median, nodes, leaves);
+  const int right = build_curve_bvh(segments, median, end, nodes, leaves);
+
+  nodes[node_id].bounds = bounds;
+  nodes[node_id].left = left;
+  nodes[node_id].right = right;
+
+  return node_id;
+}
+
+static void set_leaf_segment(CurveLeaf *leaf, int lane, const Segment &seg)
+{
+  const Vector axis = seg.P1 - seg.P0;
+  const Vector velocity_axis = seg.velocity1 - seg.velocity0;
+
+  leaf->P0x[lane] = seg.P0.x;
+  leaf->P0y[lane] = seg.P0.y;
+  leaf->P0z[lane] = seg.P0.z;
+  leaf->axisx[lane] = axis.x;
+  leaf->axisy[lane] = axis.y;
+  leaf->axisz[lane] = axis.z;
+  leaf->v0x[lane] = seg.velocity0.x;
+  leaf->v0y[lane] = seg.velocity0.y;
+  leaf->v0z[lane] = seg.velocity0.z;
+  leaf->vaxisx[lane] = velocity_axis.x;
+  leaf->vaxisy[lane] = velocity_axis.y;
+  leaf->vaxisz[lane] = velocity_axis.z;
+  leaf->radius2[lane] = seg.radius * seg.radius;
+
+  leaf->prim_id[lane] = seg.prim_id;
+  leaf->level[lane] = seg.level;
+  leaf->segment_id[lane] = seg.segment_id;
+}
+
+// Tests the ray segment [tmin, tmax] against all capsules in the leaf.
+// The closest points between the ray and each capsule axis are found
+// without branches so that the lane loop can be vectorized.
+static int intersect_leaf_capsules(const CurveLeaf &leaf,
+    const Ray &ray, Real time, Real tmin, Real tmax, int *hit_lanes)
+{
+  const Real ox = ray.orig.x;
+  const Real oy = ray.orig.y;
+  const Real oz = ray.orig.z;
+  const Real dx = ray.dir.x;
+  const Real dy = ray.dir.y;
+  const Real dz = ray.dir.z;
+  const Real a = dx * dx + dy * dy + dz * dz;
+  const Real a_inv = 1. / a;
+
+  Real dist2[LEAF_SIZE];
+
+  for (int i = 0; i < LEAF_SIZE; i++) {
+    // capsule axis at time
+    const Real px = leaf.P0x[i] + time * leaf.v0x[i];
+    const Real py = leaf.P0y[i] + time * leaf.v0y[i];
+    const Real pz = leaf.P0z[i] + time * leaf.v0z[i];
+    const Real ux = leaf.axisx[i] + time * leaf.vaxisx[i];
+    const Real uy = leaf.axisy[i] + time * leaf.vaxisy[i];
+    const Real uz = leaf.axisz[i] + time * leaf.vaxisz[i];
+
+    const Real rx = ox - px;
+    const Real ry = oy - py;
+    const Real rz = oz - pz;
+
+    const Real b = dx * ux + dy * uy + dz * uz;
+    const Real c = dx * rx + dy * ry + dz * rz;
+    const Real e = ux * ux + uy * uy + uz * uz;
+    const Real f = ux * rx + uy * ry + uz * rz;
+    const Real denom = a * e - b * b;
+    const Real e_inv = e > 0 ? 1. / e : 0;
+
+    Real t = denom > 0 ? (b * f - c * e) / denom : tmin;
+    t = Clamp(t, tmin, tmax);
+    const Real s = Clamp((b * t + f) * e_inv, 0, 1);
+    t = Clamp((b * s - c) * a_inv, tmin, tmax);
+
+    const Real qx = rx + t * dx - s * ux;
+    const Real qy = ry + t * dy - s * uy;
+    const Real qz = rz + t * dz - s * uz;
+    dist2[i] = qx * qx + qy * qy + qz * qz;
+  }
+
+  int nhits = 0;
+  for (int i = 0; i < LEAF_SIZE; i++) {
+    if (dist2[i] <= leaf.radius2[i]) {
+      hit_lanes[nhits++] = i;
+    }
+  }
+
+  return nhits;
+}
+
+} // namespace xxx
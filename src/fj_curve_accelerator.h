@@ -0,0 +1,37 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#ifndef FJ_CURVE_ACCELERATOR_H
+#define FJ_CURVE_ACCELERATOR_H
+
+#include "fj_accelerator.h"
+#include <vector>
+
+namespace fj {
+
+class Curve;
+class CurveNode;
+class CurveLeaf;
+
+// Accelerator for hair. Curves are pre-split into short segments and
+// each segment is bounded by a capsule oriented along the segment.
+class CurveAccelerator : public Accelerator {
+public:
+  CurveAccelerator();
+  ~CurveAccelerator();
+
+  void SetCurve(Curve *curve);
+
+private:
+  virtual int build();
+  virtual bool intersect(const Ray &ray, Real time, Intersection *isect) const;
+  virtual const char *get_name() const;
+
+  const Curve *curve_;
+  std::vector<CurveNode> nodes_;
+  std::vector<CurveLeaf> leaves_;
+};
+
+} // namespace xxx
+
+#endif // FJ_XXX_H
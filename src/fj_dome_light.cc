@@ -22,7 +22,8 @@ int DomeLight::get_sample_count() const
   return GetSampleDensity();
 }
 
-void DomeLight::get_samples(LightSample *samples, int max_samples) const
+void DomeLight::get_samples(const TraceContext &cxt,
+    LightSample *samples, int max_samples) const
 {
   Transform transform_interp;
   // TODO time sampling
@@ -48,10 +48,11 @@ void FrameBuffer::Resize(int width, int height, int nchannels)
     return;
   }
 
-  std::vector<float> buftmp(total_alloc);
+  std::vector<float, MtFirstTouchAllocator<float>> buftmp(total_alloc);
   if (buftmp.empty()) {
     return;
   }
+  MtParallelFill(&buftmp[0], buftmp.size(), 0.f);
 
   // commit
   buf_.swap(buftmp);
@@ -5,6 +5,7 @@
 #define FJ_FRAMEBUFFER_H
 
 #include "fj_compatibility.h"
+#include "fj_multi_thread.h"
 #include <vector>
 
 namespace fj {
@@ -45,7 +46,8 @@ private:
   int get_index(int x, int y, int z) const;
   bool is_inside(int x, int y, int z) const;
 
-  std::vector<float> buf_;
+  // pages go to the threads that clear them. see MtFirstTouchAllocator
+  std::vector<float, MtFirstTouchAllocator<float>> buf_;
   int width_;
   int height_;
   int nchannels_;
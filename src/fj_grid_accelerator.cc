@@ -39,7 +39,8 @@ static void compute_grid_cellsizes(int nprimitives, const Vector &grid_size,
 static Box get_grid_cell(const Box &grid_bounds, const Vector &cell_size,
     int x, int y, int z);
 
-GridAccelerator::GridAccelerator() : cells_(), cellsize_(), bounds_()
+GridAccelerator::GridAccelerator() : cells_(), cellsize_(), bounds_(),
+    segment_bounds_(), nsegments_(1)
 {
 }
 
@@ -86,9 +87,21 @@ int GridAccelerator::build()
   const Vector cellsize_tmp =
       (bounds_tmp.max - bounds_tmp.min) / Vector(XNCELLS, YNCELLS, ZNCELLS);
 
-  // TODO TEST
-  int total_cell_count = 0;
-  int added_cell_count = 0;
+  // segment bounds for tight culling of deforming primitives
+  const int NSEGMENTS = primset->GetMotionSegmentCount();
+  std::vector<Box> segment_bounds_tmp;
+
+  if (NSEGMENTS > 1) {
+    segment_bounds_tmp.resize(NPRIMS * NSEGMENTS);
+
+    for (int i = 0; i < NPRIMS; i++) {
+      for (int j = 0; j < NSEGMENTS; j++) {
+        Box &segbox = segment_bounds_tmp[i * NSEGMENTS + j];
+        primset->GetPrimitiveSegmentBounds(i, j, &segbox);
+        segbox.Expand(HALF_PADDING);
+      }
+    }
+  }
 
   for (int i = 0; i < NPRIMS; i++) {
     const int prim_id = i;
@@ -115,10 +128,9 @@ int GridAccelerator::build()
     for (int z = Z0; z < Z1; z++) {
       for (int y = Y0; y < Y1; y++) {
         for (int x = X0; x < X1; x++) {
-          // TODO TEST
-          total_cell_count++;
-
-          const Box cellbox = get_grid_cell(bounds_tmp, cellsize_tmp, x, y, z);
+          // padded so that hits on cell faces are not dropped
+          Box cellbox = get_grid_cell(bounds_tmp, cellsize_tmp, x, y, z);
+          cellbox.Expand(HALF_PADDING);
           if (!primset->BoxIntersect(prim_id, cellbox)) {
             continue;
           }
@@ -133,21 +145,11 @@ int GridAccelerator::build()
             cells_tmp[cell_id] = newcell;
             cells_tmp[cell_id]->next = oldcell;
           }
-          // TODO TEST
-          added_cell_count++;
         }
       }
     }
   }
 
-  if (1) {
-    // TODO TEST
-    std::cout << "-------------------------------------\n";
-    std::cout << "total_cell_count: " << total_cell_count << "\n";
-    std::cout << "added_cell_count: " << added_cell_count << "\n";
-    std::cout << "reduced:          " << 100. * added_cell_count/total_cell_count << "%\n";
-  }
-
   // commit
   cells_.swap(cells_tmp);
   ncells_[0] = XNCELLS;
@@ -155,6 +157,8 @@ int GridAccelerator::build()
   ncells_[2] = ZNCELLS;
   cellsize_ = cellsize_tmp;
   bounds_ = bounds_tmp;
+  segment_bounds_.swap(segment_bounds_tmp);
+  nsegments_ = NSEGMENTS;
 
   return 0;
 }
@@ -166,6 +170,7 @@ bool GridAccelerator::intersect(const Ray &ray, Real time, Intersection *isect)
   int cell_step[3] = {0, 0, 0};
   int cell_end[3]  = {0, 0, 0};
   const PrimitiveSet *primset = GetPrimitiveSet();
+  const int segment = segment_bounds_.empty() ? 0 : primset->GetMotionSegment(time);
 
   // check intersection with overall bounds
   // to get boxhit_tmin and boxhit_tmax
@@ -244,6 +249,15 @@ bool GridAccelerator::intersect(const Ray &ray, Real time, Intersection *isect)
 
     // loop over face list that associated in current cell
     for (Cell *cell = cells_[id]; cell != NULL; cell = cell->next) {
+      if (!segment_bounds_.empty()) {
+        const Box &segbox = segment_bounds_[cell->prim_id * nsegments_ + segment];
+        Real seg_tmin = 0, seg_tmax = 0;
+        if (!BoxRayIntersect(segbox, ray.orig, ray.dir, ray.tmin, ray.tmax,
+              &seg_tmin, &seg_tmax)) {
+          continue;
+        }
+      }
+
       const bool hittmp = primset->RayIntersect(cell->prim_id, ray, time, isect_tmp);
       if (!hittmp) {
         continue;
@@ -28,6 +28,10 @@ private:
   int ncells_[3];
   Vector cellsize_;
   Box bounds_;
+
+  // per primitive bounds for each motion segment. empty when no segments
+  std::vector<Box> segment_bounds_;
+  int nsegments_;
 };
 
 } // namespace xxx
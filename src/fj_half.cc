@@ -0,0 +1,134 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "fj_half.h"
+#include <cstring>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace fj {
+
+// decode tables after "Fast Half Float Conversions" by Jeroen van der Zijp.
+// float bits = mantissa[offset[h >> 10] + (h & 0x3ff)] + exponent[h >> 10]
+class HalfTable {
+public:
+  HalfTable()
+  {
+    mantissa[0] = 0;
+    for (uint32_t i = 1; i < 1024; i++) {
+      // subnormal halves are normalized floats
+      uint32_t m = i << 13;
+      uint32_t e = 0;
+      while ((m & 0x00800000) == 0) {
+        e -= 0x00800000;
+        m <<= 1;
+      }
+      m &= ~0x00800000;
+      e += 0x38800000;
+      mantissa[i] = m | e;
+    }
+    for (uint32_t i = 1024; i < 2048; i++) {
+      mantissa[i] = 0x38000000 + ((i - 1024) << 13);
+    }
+
+    exponent[0] = 0;
+    exponent[32] = 0x80000000;
+    for (uint32_t i = 1; i < 31; i++) {
+      exponent[i] = i << 23;
+      exponent[i + 32] = 0x80000000 + (i << 23);
+    }
+    // inf and nan
+    exponent[31] = 0x47800000;
+    exponent[63] = 0xc7800000;
+
+    for (int i = 0; i < 64; i++) {
+      offset[i] = (i == 0 || i == 32) ? 0 : 1024;
+    }
+  }
+  ~HalfTable() {}
+
+  float Decode(uint16_t h) const
+  {
+    const uint32_t bits = mantissa[offset[h >> 10] + (h & 0x3ff)] + exponent[h >> 10];
+    float f = 0;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+
+private:
+  uint32_t mantissa[2048];
+  uint32_t exponent[64];
+  uint16_t offset[64];
+};
+
+static const HalfTable half_table;
+
+uint16_t FloatToHalf(float f)
+{
+  uint32_t bits = 0;
+  memcpy(&bits, &f, sizeof(bits));
+
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff) {
+    // inf or nan
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+  if (exponent >= 31) {
+    // clamp to max half
+    return sign | 0x7bff;
+  }
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return sign;
+    }
+    // subnormal. a carry out of the mantissa gives the min normal
+    mantissa |= 0x800000;
+    const int shift = 14 - exponent;
+    uint32_t h = mantissa >> shift;
+    if ((mantissa >> (shift - 1)) & 1) {
+      h++;
+    }
+    return sign | h;
+  }
+
+  uint32_t h = (exponent << 10) | (mantissa >> 13);
+  // round to nearest. carry goes into exponent
+  if (mantissa & 0x1000) {
+    h++;
+  }
+  // rounding up from the max half must not give inf
+  if (h >= 0x7c00) {
+    h = 0x7bff;
+  }
+  return sign | h;
+}
+
+float HalfToFloat(uint16_t h)
+{
+#if defined(__F16C__)
+  return _cvtsh_ss(h);
+#else
+  return half_table.Decode(h);
+#endif
+}
+
+void HalfToFloatArray(const uint16_t *h, int count, float *f)
+{
+  int i = 0;
+#if defined(__F16C__)
+  for (; i + 8 <= count; i += 8) {
+    const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i));
+    _mm256_storeu_ps(f + i, _mm256_cvtph_ps(packed));
+  }
+#endif
+  for (; i < count; i++) {
+    f[i] = half_table.Decode(h[i]);
+  }
+}
+
+} // namespace xxx
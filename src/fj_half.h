@@ -0,0 +1,22 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#ifndef FJ_HALF_H
+#define FJ_HALF_H
+
+#include "fj_compatibility.h"
+#include <cstdint>
+
+namespace fj {
+
+// IEEE 754 half precision. rounds to nearest with ties away from zero.
+// values beyond the half range clamp to the max finite half
+FJ_API uint16_t FloatToHalf(float f);
+FJ_API float HalfToFloat(uint16_t h);
+
+// decodes many halves at once. uses F16C when the build enables it
+FJ_API void HalfToFloatArray(const uint16_t *h, int count, float *f);
+
+} // namespace xxx
+
+#endif // FJ_XXX_H
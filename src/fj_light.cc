@@ -2,10 +2,14 @@
 // See LICENSE and README
 
 #include "fj_light.h"
+#include "fj_object_instance.h"
 #include "fj_framebuffer_io.h"
 #include "fj_framebuffer.h"
 #include "fj_numeric.h"
 #include "fj_texture.h"
+#include "fj_volume_shadow.h"
+#include "fj_object_group.h"
+#include "fj_shading.h"
 
 namespace fj {
 
@@ -18,13 +22,17 @@ Light::Light() :
   sample_count_(16),
   sample_intensity_(intensity_ / sample_count_),
 
-  environment_map_(NULL)
+  environment_map_(NULL),
+
+  volume_shadow_rate_(0),
+  volume_shadows_()
 {
   XfmInitTransformSampleList(&transform_samples_);
 }
 
 Light::~Light()
 {
+  clear_volume_shadows();
 }
 
 void Light::SetColor(float r, float g, float b)
@@ -56,6 +64,11 @@ void Light::SetEnvironmentMap(Texture *texture)
   environment_map_ = texture;
 }
 
+void Light::SetVolumeShadowRate(float rate)
+{
+  volume_shadow_rate_ = Max(rate, 0);
+}
+
 Color Light::GetColor() const
 {
   return color_;
@@ -71,6 +84,11 @@ int Light::GetSampleDensity() const
   return sample_count_;
 }
 
+float Light::GetVolumeShadowRate() const
+{
+  return volume_shadow_rate_;
+}
+
 bool Light::IsDoulbeSided() const
 {
   return double_sided_;
@@ -106,9 +124,10 @@ void Light::SetRotateOrder(int order)
   XfmSetSampleRotateOrder(&transform_samples_, order);
 }
 
-void Light::GetSamples(LightSample *samples, int max_samples) const
+void Light::GetSamples(const TraceContext &cxt,
+    LightSample *samples, int max_samples) const
 {
-  get_samples(samples, max_samples);
+  get_samples(cxt, samples, max_samples);
 }
 
 int Light::GetSampleCount() const
@@ -121,9 +140,73 @@ Color Light::Illuminate(const LightSample &sample, const Vector &Ps) const
   return illuminate(sample, Ps);
 }
 
-int Light::Preprocess()
+int Light::Preprocess(const TraceContext &cxt, int thread_count)
+{
+  const int err = preprocess();
+  if (err) {
+    return err;
+  }
+
+  clear_volume_shadows();
+  if (volume_shadow_rate_ > 0) {
+    return bake_volume_shadows(cxt, thread_count);
+  }
+
+  return 0;
+}
+
+bool Light::LookupVolumeShadow(const ObjectInstance *object,
+    const Vector &P, float *transmittance) const
+{
+  for (size_t i = 0; i < volume_shadows_.size(); i++) {
+    const VolumeShadow *shadow = volume_shadows_[i];
+    if (shadow->GetObject() == object) {
+      return shadow->GetTransmittance(P, transmittance);
+    }
+  }
+  return false;
+}
+
+int Light::GetVolumeShadowCount() const
+{
+  return static_cast<int>(volume_shadows_.size());
+}
+
+int Light::bake_volume_shadows(const TraceContext &cxt, int thread_count)
+{
+  const ObjectGroup *group = cxt.trace_target;
+  if (group == NULL) {
+    return 0;
+  }
+
+  // samples are fixed during the bake so that all grid points share them
+  const int nsamples = GetSampleCount();
+  std::vector<LightSample> samples(nsamples);
+  GetSamples(cxt, &samples[0], nsamples);
+
+  for (Index i = 0; i < group->GetVolumeObjectCount(); i++) {
+    const ObjectInstance *object = group->GetVolumeObject(i);
+    VolumeShadow *shadow = new VolumeShadow();
+
+    const int err = shadow->Bake(object, &samples[0], nsamples,
+        cxt, volume_shadow_rate_, thread_count);
+    if (err) {
+      delete shadow;
+      continue;
+    }
+
+    volume_shadows_.push_back(shadow);
+  }
+
+  return 0;
+}
+
+void Light::clear_volume_shadows()
 {
-  return preprocess();
+  for (size_t i = 0; i < volume_shadows_.size(); i++) {
+    delete volume_shadows_[i];
+  }
+  volume_shadows_.clear();
 }
 
 void Light::get_transform_sample(Transform &sample, Real time) const
@@ -16,6 +16,9 @@ namespace fj {
 
 class Light;
 class Texture;
+class TraceContext;
+class VolumeShadow;
+class ObjectInstance;
 
 class LightSample {
 public:
@@ -40,12 +43,15 @@ public:
   void SetSampleCount(int sample_count);
   void SetDoubleSided(bool on_or_off);
   void SetEnvironmentMap(Texture *texture);
+  // 0 disables baking. cell size is in units of volume filter size
+  void SetVolumeShadowRate(float rate);
 
   Color GetColor() const;
   float GetIntensity() const;
   int GetSampleDensity() const;
   bool IsDoulbeSided() const;
   Texture *GetEnvironmentMap() const;
+  float GetVolumeShadowRate() const;
 
   // transformation
   void SetTranslate(Real tx, Real ty, Real tz, Real time);
@@ -55,10 +61,16 @@ public:
   void SetRotateOrder(int order);
 
   // samples
-  void GetSamples(LightSample *samples, int max_samples) const;
+  void GetSamples(const TraceContext &cxt,
+      LightSample *samples, int max_samples) const;
   int GetSampleCount() const;
   Color Illuminate(const LightSample &sample, const Vector &Ps) const;
-  int Preprocess();
+  int Preprocess(const TraceContext &cxt, int thread_count);
+
+  // baked transmittance from P to the light through a volume object
+  bool LookupVolumeShadow(const ObjectInstance *object,
+      const Vector &P, float *transmittance) const;
+  int GetVolumeShadowCount() const;
 
 protected:
   void get_transform_sample(Transform &sample, Real time) const;
@@ -76,11 +88,22 @@ private:
   float sample_intensity_;
   Texture *environment_map_;
 
+  float volume_shadow_rate_;
+  std::vector<VolumeShadow*> volume_shadows_;
+
+  int bake_volume_shadows(const TraceContext &cxt, int thread_count);
+  void clear_volume_shadows();
+
 private:
   virtual int get_sample_count() const = 0;
-  virtual void get_samples(LightSample *samples, int max_samples) const = 0;
+  virtual void get_samples(const TraceContext &cxt,
+      LightSample *samples, int max_samples) const = 0;
   virtual Color illuminate(const LightSample &sample, const Vector &Ps) const = 0;
   virtual int preprocess() = 0;
+
+  // not copyable
+  Light(const Light &);
+  const Light &operator=(const Light &);
 };
 
 } // namespace xxx
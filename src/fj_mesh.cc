@@ -5,6 +5,7 @@
 #include "fj_intersection.h"
 #include "fj_primitive_set.h"
 #include "fj_triangle.h"
+#include "fj_numeric.h"
 #include "fj_ray.h"
 
 #define ATTRIBUTE_LIST(ATTR) \
@@ -55,6 +56,9 @@ void Mesh::Clear()
 #define ATTR(Class, Type, Name, Label) std::vector<Type>().swap(Name);
   ATTRIBUTE_LIST(ATTR)
 #undef ATTR
+
+  position_sample_count_ = 1;
+  std::vector<Vector>().swap(P_samples_);
 }
 
 static void get_point_positions(const Mesh &mesh, Index face_index,
@@ -67,6 +71,16 @@ static void get_point_positions(const Mesh &mesh, Index face_index,
   P2 = mesh.GetPointPosition(face.i2);
 }
 
+static void get_point_position_samples(const Mesh &mesh, Index face_index,
+    int sample, Vector &P0, Vector &P1, Vector &P2)
+{
+  const Index3 face = mesh.GetFaceIndices(face_index);
+
+  P0 = mesh.GetPointPositionSample(sample, face.i0);
+  P1 = mesh.GetPointPositionSample(sample, face.i1);
+  P2 = mesh.GetPointPositionSample(sample, face.i2);
+}
+
 static void get_point_normals(const Mesh &mesh, Index face_index,
     Vector &N0, Vector &N1, Vector &N2)
 {
@@ -119,7 +133,8 @@ static Vector compute_shading_normal(const Mesh &mesh, Index face_index, double
   return TriComputeNormal(N0, N1, N2, u, v);
 }
 
-Mesh::Mesh() : point_count_(0), face_count_(0), bounds_()
+Mesh::Mesh() : point_count_(0), face_count_(0), bounds_(),
+    position_sample_count_(1)
 {
   face_group_name_[""] = 0;
 }
@@ -140,6 +155,21 @@ int Mesh::GetFaceCount() const
 
 void Mesh::SetPointCount(int count)
 {
+  // position samples are laid out per point count. keep the points that
+  // still exist in each sample
+  if (position_sample_count_ > 1 && count != point_count_) {
+    const int old_count = point_count_;
+    const int copy_count = Min(old_count, count);
+    std::vector<Vector> samples((position_sample_count_ - 1) * count);
+
+    for (int s = 0; s < position_sample_count_ - 1; s++) {
+      for (int i = 0; i < copy_count && !P_samples_.empty(); i++) {
+        samples[s * count + i] = P_samples_[s * old_count + i];
+      }
+    }
+    P_samples_.swap(samples);
+  }
+
   point_count_ = count;
 }
 
@@ -169,6 +199,63 @@ Vector Mesh::GetVertexNormal(Index vertex_id) const
   }
 }
 
+void Mesh::SetPointPositionSampleCount(int count)
+{
+  if (count < 1)
+    count = 1;
+
+  position_sample_count_ = count;
+  std::vector<Vector>().swap(P_samples_);
+
+  if (position_sample_count_ > 1) {
+    P_samples_.resize((position_sample_count_ - 1) * GetPointCount());
+  }
+}
+
+int Mesh::GetPointPositionSampleCount() const
+{
+  return position_sample_count_;
+}
+
+void Mesh::SetPointPositionSample(int sample, int idx, const Vector &value)
+{
+  if (sample < 0 || sample >= GetPointPositionSampleCount())
+    return;
+
+  if (sample == 0) {
+    SetPointPosition(idx, value);
+    return;
+  }
+
+  const int offset = (sample - 1) * GetPointCount() + idx;
+  if (idx < 0 || idx >= GetPointCount() ||
+      offset >= static_cast<int>(P_samples_.size()))
+    return;
+
+  P_samples_[offset] = value;
+}
+
+Vector Mesh::GetPointPositionSample(int sample, int idx) const
+{
+  if (sample < 0 || sample >= GetPointPositionSampleCount())
+    return Vector();
+
+  if (sample == 0)
+    return GetPointPosition(idx);
+
+  const int offset = (sample - 1) * GetPointCount() + idx;
+  if (idx < 0 || idx >= GetPointCount() ||
+      offset >= static_cast<int>(P_samples_.size()))
+    return Vector();
+
+  return P_samples_[offset];
+}
+
+bool Mesh::HasPointPositionSamples() const
+{
+  return !P_samples_.empty();
+}
+
 int Mesh::CreateFaceGroup(const std::string &group_name)
 {
   std::map<std::string, int>::const_iterator it = face_group_name_.find(group_name);
@@ -247,15 +334,31 @@ bool Mesh::ray_intersect(Index prim_id, const Ray &ray,
     Real time, Intersection *isect) const
 {
   Vector P0, P1, P2;
-  get_point_positions(*this, prim_id, P0, P1, P2);
 
-  if (HasPointVelocity()) {
-    Vector velocity0, velocity1, velocity2;
-    get_point_velocity(*this, prim_id, velocity0, velocity1, velocity2);
+  if (HasPointPositionSamples()) {
+    const int segment = GetMotionSegment(time);
+    const Real NSEGMENTS = GetMotionSegmentCount();
+    const Real weight = Clamp(time * NSEGMENTS - segment, 0, 1);
+
+    Vector Q0, Q1, Q2;
+    get_point_position_samples(*this, prim_id, segment,     P0, P1, P2);
+    get_point_position_samples(*this, prim_id, segment + 1, Q0, Q1, Q2);
+
+    P0 = Lerp(P0, Q0, weight);
+    P1 = Lerp(P1, Q1, weight);
+    P2 = Lerp(P2, Q2, weight);
+  }
+  else {
+    get_point_positions(*this, prim_id, P0, P1, P2);
 
-    P0 += time * velocity0;
-    P1 += time * velocity1;
-    P2 += time * velocity2;
+    if (HasPointVelocity()) {
+      Vector velocity0, velocity1, velocity2;
+      get_point_velocity(*this, prim_id, velocity0, velocity1, velocity2);
+
+      P0 += time * velocity0;
+      P1 += time * velocity1;
+      P2 += time * velocity2;
+    }
   }
 
   double u, v;
@@ -307,114 +410,38 @@ bool Mesh::ray_intersect(Index prim_id, const Ray &ray,
   return true;
 }
 
-struct SubTri {
-  SubTri(): P0(), P1(), P2(), vel0(), vel1(), vel2() {}
-  ~SubTri() {}
-  Vector P0, P1, P2;
-  Vector vel0, vel1, vel2;
-};
-
-static bool box_tri_intersect(const Box &box, const SubTri &tri)
+bool Mesh::box_intersect(Index prim_id, const Box &box) const
 {
-  const int N_STEPS = 8;
-  const Vector step0 = tri.vel0 / N_STEPS;
-  const Vector step1 = tri.vel1 / N_STEPS;
-  const Vector step2 = tri.vel2 / N_STEPS;
-
-  for (int i = 0; i < N_STEPS; i++) {
-    const Vector P0 = tri.P0 + i * step0;
-    const Vector P1 = tri.P1 + i * step1;
-    const Vector P2 = tri.P2 + i * step2;
-
-    Box segment_bounds;
-    TriComputeBounds(P0, P1, P2, &segment_bounds);
-    segment_bounds.AddPoint(P0 + step0);
-    segment_bounds.AddPoint(P1 + step1);
-    segment_bounds.AddPoint(P2 + step2);
+  const Vector centroid = box.Centroid();
+  const Vector halfsize = .5 * box.Diagonal();
 
-    if (BoxBoxIntersect(segment_bounds, box)) {
-      return true;
+  if (HasPointPositionSamples()) {
+    for (int i = 0; i < GetMotionSegmentCount(); i++) {
+      Vector P0, P1, P2;
+      Vector Q0, Q1, Q2;
+      get_point_position_samples(*this, prim_id, i,     P0, P1, P2);
+      get_point_position_samples(*this, prim_id, i + 1, Q0, Q1, Q2);
+
+      if (TriBoxIntersectMotion(P0, P1, P2, Q0 - P0, Q1 - P1, Q2 - P2,
+            centroid, halfsize)) {
+        return true;
+      }
     }
+    return false;
   }
-  return false;
-}
-
-static bool box_tri_intersect_recursive(const Box &box, const SubTri &tri, int depth);
-
-static bool box_tri_intersect_recursive(const Box &box, const SubTri &tri, int depth)
-{
-  if (depth == 0) {
-    return box_tri_intersect(box, tri);
-  }
-
-  const Vector P01 = (tri.P0 + tri.P1) / 2;
-  const Vector P12 = (tri.P1 + tri.P2) / 2;
-  const Vector P20 = (tri.P2 + tri.P0) / 2;
-  const Vector vel01 = (tri.vel0 + tri.vel1) / 2;
-  const Vector vel12 = (tri.vel1 + tri.vel2) / 2;
-  const Vector vel20 = (tri.vel2 + tri.vel0) / 2;
-
-  SubTri t;
-  t.P0 = tri.P0;
-  t.P1 = P01;
-  t.P2 = P20;
-  t.vel0 = tri.vel0;
-  t.vel1 = vel01;
-  t.vel2 = vel20;
-  if (box_tri_intersect_recursive(box, t, depth - 1)) {
-    return true;
-  }
-
-  t.P0 = P01;
-  t.P1 = tri.P1;
-  t.P2 = P12;
-  t.vel0 = vel01;
-  t.vel1 = tri.vel1;
-  t.vel2 = vel12;
-  if (box_tri_intersect_recursive(box, t, depth - 1)) {
-    return true;
-  }
-
-  t.P0 = P12;
-  t.P1 = tri.P2;
-  t.P2 = P20;
-  t.vel0 = vel12;
-  t.vel1 = tri.vel2;
-  t.vel2 = vel20;
-  if (box_tri_intersect_recursive(box, t, depth - 1)) {
-    return true;
-  }
-
-  t.P0 = P01;
-  t.P1 = P12;
-  t.P2 = P20;
-  t.vel0 = vel01;
-  t.vel1 = vel12;
-  t.vel2 = vel20;
-  if (box_tri_intersect_recursive(box, t, depth - 1)) {
-    return true;
-  }
-
-  return false;
-}
-
-bool Mesh::box_intersect(Index prim_id, const Box &box) const
-{
-  const int recursive_depth = 0;
-  SubTri t;
-  get_point_positions(*this, prim_id, t.P0, t.P1, t.P2);
-  get_point_velocity(*this, prim_id, t.vel0, t.vel1, t.vel2);
-  return box_tri_intersect_recursive(box, t, recursive_depth);
 
-#if 0
   Vector P0, P1, P2;
   get_point_positions(*this, prim_id, P0, P1, P2);
 
-  const Vector centroid = box.Centroid();
-  const Vector halfsize = .5 * box.Diagonal();
+  if (HasPointVelocity()) {
+    Vector velocity0, velocity1, velocity2;
+    get_point_velocity(*this, prim_id, velocity0, velocity1, velocity2);
+
+    return TriBoxIntersectMotion(P0, P1, P2, velocity0, velocity1, velocity2,
+        centroid, halfsize);
+  }
 
   return TriBoxIntersect(P0, P1, P2, centroid, halfsize);
-#endif
 }
 
 void Mesh::get_primitive_bounds(Index prim_id, Box *bounds) const
@@ -424,7 +451,15 @@ void Mesh::get_primitive_bounds(Index prim_id, Box *bounds) const
 
   TriComputeBounds(P0, P1, P2, bounds);
 
-  if (HasPointVelocity()) {
+  if (HasPointPositionSamples()) {
+    for (int i = 1; i < GetPointPositionSampleCount(); i++) {
+      get_point_position_samples(*this, prim_id, i, P0, P1, P2);
+      bounds->AddPoint(P0);
+      bounds->AddPoint(P1);
+      bounds->AddPoint(P2);
+    }
+  }
+  else if (HasPointVelocity()) {
     Vector velocity0, velocity1, velocity2;
     get_point_velocity(*this, prim_id, velocity0, velocity1, velocity2);
 
@@ -448,6 +483,32 @@ Index Mesh::get_primitive_count() const
   return GetFaceCount();
 }
 
+int Mesh::get_motion_segment_count() const
+{
+  if (HasPointPositionSamples()) {
+    return GetPointPositionSampleCount() - 1;
+  } else {
+    return 1;
+  }
+}
+
+void Mesh::get_primitive_segment_bounds(Index prim_id, int segment, Box *bounds) const
+{
+  if (!HasPointPositionSamples()) {
+    get_primitive_bounds(prim_id, bounds);
+    return;
+  }
+
+  Vector P0, P1, P2;
+  get_point_position_samples(*this, prim_id, segment, P0, P1, P2);
+  TriComputeBounds(P0, P1, P2, bounds);
+
+  get_point_position_samples(*this, prim_id, segment + 1, P0, P1, P2);
+  bounds->AddPoint(P0);
+  bounds->AddPoint(P1);
+  bounds->AddPoint(P2);
+}
+
 void MshGetFacePointPosition(const Mesh *mesh, int face_index,
     Vector *P0, Vector *P1, Vector *P2)
 {
@@ -182,6 +182,14 @@ public:
   bool HasFaceIndices() const;
   bool HasFaceGroupID() const;
 
+  // deformation motion blur. samples are evenly spaced over shutter
+  // interval [0, 1]. sample 0 is point position. samples override velocity
+  void SetPointPositionSampleCount(int count);
+  int GetPointPositionSampleCount() const;
+  void SetPointPositionSample(int sample, int idx, const Vector &value);
+  Vector GetPointPositionSample(int sample, int idx) const;
+  bool HasPointPositionSamples() const;
+
   int CreateFaceGroup(const std::string &group_name);
   int LookupFaceGroup(const std::string &group_name) const;
 
@@ -196,6 +204,8 @@ private:
   virtual void get_primitive_bounds(Index prim_id, Box *bounds) const;
   virtual void get_bounds(Box *bounds) const;
   virtual Index get_primitive_count() const;
+  virtual int get_motion_segment_count() const;
+  virtual void get_primitive_segment_bounds(Index prim_id, int segment, Box *bounds) const;
 
   int point_count_;
   int face_count_;
@@ -214,6 +224,10 @@ private:
   std::map<std::string, int> face_group_name_;
 
   Box bounds_;
+
+  // positions for sample 1 .. N-1
+  int position_sample_count_;
+  std::vector<Vector>   P_samples_;
 };
 
 FJ_API void MshGetFacePointPosition(const Mesh *mesh, int face_index,
@@ -2,138 +2,510 @@
 // See LICENSE and README
 
 #include "fj_multi_thread.h"
+#include "fj_os.h"
 
-#include <unordered_map>
+#include <condition_variable>
+#include <algorithm>
+#include <atomic>
 #include <utility>
 #include <vector>
 #include <thread>
+#include <memory>
+#include <deque>
 #include <mutex>
 
 namespace fj {
 
-// c++ thread id (0x2384b312) <=> our thread id (0 to N-1)
-static std::unordered_map<std::thread::id, int> thread_id_map;
-static std::mutex thread_id_map_mtx;
+// our thread id (0 to N-1) of this thread. set once when a pool worker
+// starts. threads outside the pool are 0
+static thread_local int this_thread_id = 0;
+static std::atomic<int> registered_thread_count(0);
 static int active_thread_count = 1;
 
-// manage all threads' status
-static LoopStatus global_loop_status = LoopStatus::Continue;
-static std::mutex global_stat_mtx;
+// thread registeration RAII
+class ThreadRegistration {
+public:
+  ThreadRegistration(int thread_id)
+  {
+    this_thread_id = thread_id;
+    registered_thread_count++;
+  }
+  ~ThreadRegistration()
+  {
+    registered_thread_count--;
+    this_thread_id = 0;
+  }
+};
 
-// manage iterations
-static int iteration_que_index = 0;
-static std::mutex iteration_que_index_mtx;
+static int get_thread_id()
+{
+  return this_thread_id;
+}
 
-static void register_thread_id(int id)
+static int get_active_thread_count()
 {
-  std::lock_guard<std::mutex> lock(thread_id_map_mtx);
+  // pool workers and the calling thread
+  return registered_thread_count + 1;
+}
+
+// a unit of work handed to the pool. owner identifies the loop or task group
+// that submitted it so that jobs not started yet can be taken back
+class Job {
+public:
+  Job() {}
+  Job(void (*fn)(void *), void *arg, const void *owner)
+    : fn(fn), arg(arg), owner(owner) {}
+  ~Job() {}
+
+public:
+  void (*fn)(void *arg) = nullptr;
+  void *arg = nullptr;
+  const void *owner = nullptr;
+};
 
-  const auto this_id = std::this_thread::get_id();
-  thread_id_map[this_id] = id;
+// jobs of one thread. the owner pushes and pops at the back (newest first)
+// while other threads steal from the front (oldest first)
+class WorkQueue {
+public:
+  WorkQueue() {}
+  ~WorkQueue() {}
+
+  void PushBack(const Job &job);
+  bool PopBack(Job *job);
+  bool PopFront(Job *job);
+  int Revoke(const void *owner, std::vector<Job> *revoked);
+
+private:
+  std::deque<Job> jobs_;
+  std::mutex mtx_;
+};
+
+void WorkQueue::PushBack(const Job &job)
+{
+  std::lock_guard<std::mutex> lock(mtx_);
+  jobs_.push_back(job);
 }
 
-static void unregister_thread_id()
+bool WorkQueue::PopBack(Job *job)
 {
-  std::lock_guard<std::mutex> lock(thread_id_map_mtx);
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (jobs_.empty()) {
+    return false;
+  }
+  *job = jobs_.back();
+  jobs_.pop_back();
+  return true;
+}
 
-  const auto this_id = std::this_thread::get_id();
-  thread_id_map.erase(this_id);
+bool WorkQueue::PopFront(Job *job)
+{
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (jobs_.empty()) {
+    return false;
+  }
+  *job = jobs_.front();
+  jobs_.pop_front();
+  return true;
 }
 
-// thread registeration RAII
-class ThreadRegistration {
+int WorkQueue::Revoke(const void *owner, std::vector<Job> *revoked)
+{
+  std::lock_guard<std::mutex> lock(mtx_);
+  int count = 0;
+
+  auto it = jobs_.begin();
+  while (it != jobs_.end()) {
+    if (it->owner == owner) {
+      if (revoked != nullptr) {
+        revoked->push_back(*it);
+      }
+      it = jobs_.erase(it);
+      count++;
+    } else {
+      ++it;
+    }
+  }
+  return count;
+}
+
+// work-stealing thread pool. queue 0 takes jobs from threads outside the
+// pool and queue N belongs to the worker with thread id N. a worker runs
+// its own jobs first, then the shared ones, then steals from other workers
+class ThreadPool {
 public:
-  ThreadRegistration(int thread_id)
-  {
-    register_thread_id(thread_id);
+  ThreadPool(int worker_count);
+  ~ThreadPool();
+
+  int GetWorkerCount() const;
+  void Submit(const Job &job);
+  // removes jobs of owner that no worker has picked up yet
+  void Revoke(const void *owner, std::vector<Job> *revoked);
+  // runs one pending job on the calling thread. used while waiting
+  bool RunPendingJob();
+  // workers bind or unbind themselves before their next job
+  void SetPinning(bool enable);
+
+private:
+  ThreadPool(const ThreadPool &);
+  const ThreadPool &operator=(const ThreadPool &);
+
+  bool find_job(int thread_id, Job *job);
+  void worker_main(int thread_id);
+
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::atomic<int> pending_count_;
+
+  // only idle workers take this lock
+  std::mutex sleep_mtx_;
+  std::condition_variable sleep_cv_;
+  bool stop_;
+
+  std::atomic<bool> pinning_;
+  std::atomic<int> pinning_generation_;
+};
+
+ThreadPool::ThreadPool(int worker_count) :
+  pending_count_(0),
+  stop_(false),
+  pinning_(false),
+  pinning_generation_(0)
+{
+  for (int i = 0; i < worker_count + 1; i++) {
+    queues_.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
   }
-  ~ThreadRegistration()
+
+  for (int i = 0; i < worker_count; i++) {
+    const int thread_id = i + 1;
+    workers_.push_back(std::thread(&ThreadPool::worker_main, this, thread_id));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
   {
-    unregister_thread_id();
+    std::lock_guard<std::mutex> lock(sleep_mtx_);
+    stop_ = true;
   }
-};
+  sleep_cv_.notify_all();
 
-static int get_thread_id()
+  for (auto &t: workers_) {
+    t.join();
+  }
+}
+
+int ThreadPool::GetWorkerCount() const
 {
-  std::lock_guard<std::mutex> lock(thread_id_map_mtx);
-  const auto this_id = std::this_thread::get_id();
-  return thread_id_map[this_id];
+  return static_cast<int>(workers_.size());
 }
 
-static int get_active_thread_count()
+void ThreadPool::Submit(const Job &job)
 {
-  std::lock_guard<std::mutex> lock(thread_id_map_mtx);
-  return thread_id_map.size();
+  // workers keep their own jobs. everyone else shares queue 0
+  queues_[get_thread_id()]->PushBack(job);
+  pending_count_++;
+
+  std::lock_guard<std::mutex> lock(sleep_mtx_);
+  sleep_cv_.notify_one();
 }
 
-static LoopStatus get_global_loop_status()
+void ThreadPool::Revoke(const void *owner, std::vector<Job> *revoked)
 {
-  std::lock_guard<std::mutex> lock(global_stat_mtx);
-  return global_loop_status;
+  for (auto &queue: queues_) {
+    pending_count_ -= queue->Revoke(owner, revoked);
+  }
 }
 
-static void cancel_parallel_loop()
+bool ThreadPool::RunPendingJob()
 {
-  std::lock_guard<std::mutex> lock(global_stat_mtx);
-  global_loop_status = LoopStatus::Cancel;
+  Job job;
+  if (!find_job(get_thread_id(), &job)) {
+    return false;
+  }
+  job.fn(job.arg);
+  return true;
 }
 
-static void init_iteration_que_index()
+bool ThreadPool::find_job(int thread_id, Job *job)
 {
-  iteration_que_index = 0;
+  if (pending_count_ <= 0) {
+    return false;
+  }
+
+  const int queue_count = static_cast<int>(queues_.size());
+  bool found = false;
+
+  if (thread_id > 0 && queues_[thread_id]->PopBack(job)) {
+    found = true;
+  } else if (queues_[0]->PopFront(job)) {
+    found = true;
+  } else {
+    // steal the oldest job, which tends to be the largest one
+    for (int i = 1; i < queue_count; i++) {
+      const int victim = (thread_id + i) % queue_count;
+      if (victim != 0 && queues_[victim]->PopFront(job)) {
+        found = true;
+        break;
+      }
+    }
+  }
+
+  if (found) {
+    pending_count_--;
+  }
+  return found;
 }
 
-static int checkout_iteration_id(const std::vector<int> &iteration_que)
+void ThreadPool::SetPinning(bool enable)
 {
-  static std::mutex mtx;
-  std::lock_guard<std::mutex> lock(iteration_que_index_mtx);
+  {
+    std::lock_guard<std::mutex> lock(sleep_mtx_);
+    pinning_ = enable;
+    pinning_generation_++;
+  }
+  sleep_cv_.notify_all();
+}
+
+void ThreadPool::worker_main(int thread_id)
+{
+  ThreadRegistration reg(thread_id);
+  int applied_generation = 0;
+
+  for (;;) {
+    const int generation = pinning_generation_;
+    if (generation != applied_generation) {
+      // thread id N goes to the N-th cpu. the calling thread takes cpu 0
+      OsSetThreadCpu(pinning_ ? thread_id : -1);
+      applied_generation = generation;
+    }
+
+    Job job;
+    if (find_job(thread_id, &job)) {
+      job.fn(job.arg);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mtx_);
+    sleep_cv_.wait(lock, [this, applied_generation]
+        {
+          return stop_ || pending_count_ > 0 ||
+            pinning_generation_ != applied_generation;
+        });
+
+    if (stop_ && pending_count_ <= 0) {
+      break;
+    }
+  }
+}
+
+static ThreadPool &get_thread_pool()
+{
+  // the calling thread works with the pool, so one less worker is enough
+  static ThreadPool pool(MtGetMaxAvailableThreadCount() - 1);
+  return pool;
+}
+
+// state of one parallel loop. it lives on the stack of MtRunParallelLoop
+// so that any number of loops can run at the same time
+class ParallelLoop {
+public:
+  ParallelLoop() {}
+  ~ParallelLoop() {}
+
+  LoopStatus GetStatus();
+  void Cancel();
+  int CheckoutIterationID();
+  int CheckoutThreadID();
+  void FinishJob();
+  void WaitJobs(int job_count);
+
+public:
+  void *data = nullptr;
+  TaskFunction task_fn = nullptr;
+  // iterations come from iteration_que if any, otherwise begin to end - 1
+  const std::vector<int> *iteration_que = nullptr;
+  int begin = 0;
+  int end = 0;
+  int thread_count = 1;
+
+private:
+  // only waiting for jobs takes the lock
+  std::mutex mtx_;
+  std::condition_variable done_cv_;
+  std::atomic<LoopStatus> status_ {LoopStatus::Continue};
+  std::atomic<int> next_index_ {0};
+  std::atomic<int> next_thread_id_ {1};
+  int finished_job_count_ = 0;
+};
+
+LoopStatus ParallelLoop::GetStatus()
+{
+  return status_.load(std::memory_order_relaxed);
+}
+
+void ParallelLoop::Cancel()
+{
+  status_.store(LoopStatus::Cancel, std::memory_order_relaxed);
+}
+
+int ParallelLoop::CheckoutIterationID()
+{
+  const int count = end - begin;
+  // don't even increment once the que is empty, so the index can't overflow
+  if (next_index_.load(std::memory_order_relaxed) >= count) {
+    return -1;
+  }
 
-  const int que_size = static_cast<int>(iteration_que.size());
-  if (iteration_que_index >= que_size) {
+  const int index = next_index_.fetch_add(1, std::memory_order_relaxed);
+  if (index >= count) {
     return -1;
   }
 
-  const int id = iteration_que[iteration_que_index];
-  iteration_que_index++;
+  if (iteration_que != nullptr) {
+    return (*iteration_que)[index];
+  } else {
+    return begin + index;
+  }
+}
 
-  return id;
+int ParallelLoop::CheckoutThreadID()
+{
+  return next_thread_id_.fetch_add(1, std::memory_order_relaxed);
 }
 
-static void parallel_for(int thread_id, const std::vector<int> &iteration_que,
-    void *data, TaskFunction task)
+void ParallelLoop::FinishJob()
 {
-  ThreadRegistration reg(thread_id);
+  // notify while locked. the loop can be gone as soon as the lock is released
+  std::lock_guard<std::mutex> lock(mtx_);
+  finished_job_count_++;
+  done_cv_.notify_one();
+}
+
+void ParallelLoop::WaitJobs(int job_count)
+{
+  ThreadPool &pool = get_thread_pool();
+
+  for (;;) {
+    int finished_count = 0;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      finished_count = finished_job_count_;
+    }
+    if (finished_count == job_count) {
+      break;
+    }
+    // help other loops and tasks instead of just sleeping
+    if (pool.RunPendingJob()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mtx_);
+    done_cv_.wait(lock,
+        [this, finished_count] { return finished_job_count_ != finished_count; });
+  }
+}
 
+static void parallel_for(ParallelLoop *loop, int thread_id)
+{
   for (;;) {
-    // check global loop status
-    const LoopStatus global_status = get_global_loop_status();
-    if (global_status == LoopStatus::Cancel) {
+    // check loop status
+    const LoopStatus loop_status = loop->GetStatus();
+    if (loop_status == LoopStatus::Cancel) {
       break;
     }
 
     // checkout next iteration
-    const int iteration_id = checkout_iteration_id(iteration_que);
+    const int iteration_id = loop->CheckoutIterationID();
     if (iteration_id == -1) {
       break;
     }
 
     ThreadContext cxt;
-    cxt.thread_count = MtGetActiveThreadCount();
-    cxt.thread_id = MtGetThreadID();
-    cxt.iteration_count = iteration_que.size();
+    cxt.thread_count = loop->thread_count;
+    cxt.thread_id = thread_id;
+    cxt.iteration_count = loop->end - loop->begin;
     cxt.iteration_id = iteration_id;
 
-    const LoopStatus local_status = task(data, cxt);
+    const LoopStatus local_status = loop->task_fn(loop->data, cxt);
     if (local_status == LoopStatus::Cancel) {
-      cancel_parallel_loop();
+      loop->Cancel();
       break;
     }
   }
 }
 
+static void parallel_for_job(void *arg)
+{
+  ParallelLoop *loop = static_cast<ParallelLoop *>(arg);
+
+  parallel_for(loop, loop->CheckoutThreadID());
+  loop->FinishJob();
+}
+
+static LoopStatus run_parallel_loop(ParallelLoop *loop, int thread_count)
+{
+  ThreadPool &pool = get_thread_pool();
+
+  int n = thread_count < 1 ? 1 : thread_count;
+  n = n > pool.GetWorkerCount() + 1 ? pool.GetWorkerCount() + 1 : n;
+  loop->thread_count = n;
+
+  const int job_count = n - 1;
+  for (int i = 0; i < job_count; i++) {
+    pool.Submit(Job(parallel_for_job, loop, loop));
+  }
+
+  // the calling thread is always the thread 0 of the loop
+  parallel_for(loop, 0);
+
+  // jobs still in the pool queue would only find the loop done. taking them
+  // back also keeps nested loops from waiting on busy workers
+  std::vector<Job> revoked;
+  pool.Revoke(loop, &revoked);
+  loop->WaitJobs(job_count - static_cast<int>(revoked.size()));
+
+  return loop->GetStatus();
+}
+
 int MtGetMaxAvailableThreadCount()
 {
-  return std::thread::hardware_concurrency();
+  // cpus given to this process, not all cpus of the machine
+  static const int max_count = []()
+    {
+      int count = OsGetAvailableCpuCount();
+      if (count < 1) {
+        count = std::thread::hardware_concurrency();
+      }
+      return count < 1 ? 1 : count;
+    }();
+  return max_count;
+}
+
+void MtSetThreadPinning(bool enable)
+{
+  get_thread_pool().SetPinning(enable);
+  OsSetThreadCpu(enable ? 0 : -1);
+}
+
+static LoopStatus fill_chunk(void *data, const ThreadContext &context)
+{
+  const MtFillChunk *fill = static_cast<const MtFillChunk *>(data);
+  const std::size_t begin = context.iteration_id * fill->chunk_size;
+  const std::size_t end = std::min(begin + fill->chunk_size, fill->size);
+
+  fill->fill_fn(fill->data, begin, end, fill->value);
+  return LoopStatus::Continue;
+}
+
+void MtRunParallelFill(MtFillChunk *fill)
+{
+  const std::size_t chunk_count = (fill->size + fill->chunk_size - 1) / fill->chunk_size;
+
+  if (chunk_count < 2) {
+    fill->fill_fn(fill->data, 0, fill->size, fill->value);
+    return;
+  }
+  MtRunParallelFor(fill, fill_chunk, MtGetMaxAvailableThreadCount(),
+      0, static_cast<int>(chunk_count));
 }
 
 int MtGetActiveThreadCount()
@@ -158,20 +530,27 @@ int MtGetThreadID()
 LoopStatus MtRunParallelLoop(void *data, TaskFunction task_fn,
     int thread_count, const std::vector<int> &iteration_que)
 {
-  std::vector<std::thread> threads;
-  init_iteration_que_index();
-
-  for (int i = 0; i < thread_count; i++) {
-    const int thread_id = i;
-    threads.push_back(std::thread(parallel_for, thread_id, std::cref(iteration_que),
-          data, task_fn));
-  }
-
-  for (auto &t: threads) {
-    t.join();
-  }
+  ParallelLoop loop;
+  loop.data = data;
+  loop.task_fn = task_fn;
+  loop.iteration_que = &iteration_que;
+  loop.begin = 0;
+  loop.end = static_cast<int>(iteration_que.size());
+
+  return run_parallel_loop(&loop, thread_count);
+}
 
-  return get_global_loop_status();
+LoopStatus MtRunParallelFor(void *data, TaskFunction task_fn,
+    int thread_count, int begin, int end)
+{
+  ParallelLoop loop;
+  loop.data = data;
+  loop.task_fn = task_fn;
+  loop.iteration_que = nullptr;
+  loop.begin = begin;
+  loop.end = end < begin ? begin : end;
+
+  return run_parallel_loop(&loop, thread_count);
 }
 
 void MtCriticalSection(void *data, CriticalFunction critical_fn)
@@ -181,4 +560,155 @@ void MtCriticalSection(void *data, CriticalFunction critical_fn)
   critical_fn(data);
 }
 
+class Task {
+public:
+  Task() {}
+  ~Task() {}
+
+public:
+  TaskGroupState *group = nullptr;
+  void *data = nullptr;
+  TaskFunction task_fn = nullptr;
+  int task_id = 0;
+};
+
+class TaskGroupState {
+public:
+  TaskGroupState() {}
+  ~TaskGroupState() {}
+
+public:
+  // deque keeps addresses of tasks while new ones are added
+  std::deque<Task> tasks;
+  std::mutex mtx;
+  std::condition_variable done_cv;
+  LoopStatus status = LoopStatus::Continue;
+  int submitted_count = 0;
+  int finished_count = 0;
+};
+
+static void run_task(Task *task)
+{
+  TaskGroupState *group = task->group;
+  LoopStatus status = LoopStatus::Continue;
+  int task_count = 0;
+  {
+    std::lock_guard<std::mutex> lock(group->mtx);
+    status = group->status;
+    task_count = group->submitted_count;
+  }
+
+  if (status == LoopStatus::Continue) {
+    ThreadContext cxt;
+    cxt.thread_count = get_thread_pool().GetWorkerCount() + 1;
+    cxt.thread_id = MtGetThreadID();
+    cxt.iteration_count = task_count;
+    cxt.iteration_id = task->task_id;
+
+    status = task->task_fn(task->data, cxt);
+  }
+
+  std::lock_guard<std::mutex> lock(group->mtx);
+  if (status == LoopStatus::Cancel) {
+    group->status = LoopStatus::Cancel;
+  }
+  group->finished_count++;
+  group->done_cv.notify_all();
+}
+
+static void task_job(void *arg)
+{
+  run_task(static_cast<Task *>(arg));
+}
+
+MtTaskGroup::MtTaskGroup() : state_(new TaskGroupState())
+{
+}
+
+MtTaskGroup::~MtTaskGroup()
+{
+  Wait();
+  delete state_;
+}
+
+void MtTaskGroup::Run(void *data, TaskFunction task_fn, int task_id)
+{
+  Task *task = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(state_->mtx);
+    state_->tasks.push_back(Task());
+    state_->submitted_count++;
+    task = &state_->tasks.back();
+  }
+  task->group = state_;
+  task->data = data;
+  task->task_fn = task_fn;
+  task->task_id = task_id;
+
+  ThreadPool &pool = get_thread_pool();
+  if (pool.GetWorkerCount() == 0) {
+    // nobody to hand it to. run it when waiting
+    return;
+  }
+  pool.Submit(Job(task_job, task, state_));
+}
+
+LoopStatus MtTaskGroup::Wait()
+{
+  ThreadPool &pool = get_thread_pool();
+
+  if (pool.GetWorkerCount() == 0) {
+    // tasks were never submitted. run the ones not run yet in order
+    for (;;) {
+      Task *task = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(state_->mtx);
+        if (state_->finished_count == state_->submitted_count) {
+          break;
+        }
+        task = &state_->tasks[state_->finished_count];
+      }
+      run_task(task);
+    }
+  }
+
+  std::vector<Job> revoked;
+  for (;;) {
+    int finished_count = 0;
+    {
+      std::lock_guard<std::mutex> lock(state_->mtx);
+      finished_count = state_->finished_count;
+      if (finished_count == state_->submitted_count) {
+        break;
+      }
+    }
+    // take back tasks no worker has started. this includes tasks added
+    // by running tasks of this group
+    pool.Revoke(state_, &revoked);
+    for (auto &job: revoked) {
+      job.fn(job.arg);
+    }
+    if (!revoked.empty()) {
+      revoked.clear();
+      continue;
+    }
+    if (pool.RunPendingJob()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(state_->mtx);
+    state_->done_cv.wait(lock,
+        [this, finished_count] { return state_->finished_count != finished_count; });
+  }
+
+  std::lock_guard<std::mutex> lock(state_->mtx);
+
+  state_->tasks.clear();
+  state_->submitted_count = 0;
+  state_->finished_count = 0;
+
+  const LoopStatus status = state_->status;
+  state_->status = LoopStatus::Continue;
+  return status;
+}
+
 } // namespace xxx
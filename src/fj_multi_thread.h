@@ -5,7 +5,12 @@
 #define FJ_MULTI_THREAD_H
 
 #include "fj_compatibility.h"
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+#include <memory>
 #include <vector>
+#include <new>
 
 namespace fj {
 
@@ -29,15 +34,111 @@ enum class LoopStatus {
 using TaskFunction = LoopStatus (*)(void *data, const ThreadContext &context);
 using CriticalFunction = void (*)(void *data);
 
-int MtGetMaxAvailableThreadCount();
+FJ_API int MtGetMaxAvailableThreadCount();
 int MtGetActiveThreadCount();
 void MtSetActiveThreadCount(int count);
 // TODO possible to hide this from plugin?
 FJ_API int MtGetThreadID();
 
-LoopStatus MtRunParallelLoop(void *data, TaskFunction task_fn,
+// Parallel loops run on a persistent work-stealing thread pool created on
+// first use. The calling thread joins the loop as context.thread_id 0, so
+// loops can be nested or run from several threads at the same time.
+// A thread waiting for a loop or a task group runs other pending jobs
+// meanwhile, so don't wait while holding a lock that those jobs may need.
+FJ_API LoopStatus MtRunParallelLoop(void *data, TaskFunction task_fn,
     int thread_count, const std::vector<int> &iteration_que);
-void MtCriticalSection(void *data, CriticalFunction critical_fn);
+// Runs iteration_id from begin to end - 1 without building an iteration que.
+FJ_API LoopStatus MtRunParallelFor(void *data, TaskFunction task_fn,
+    int thread_count, int begin, int end);
+FJ_API void MtCriticalSection(void *data, CriticalFunction critical_fn);
+
+// Binds each pool worker and the calling thread to a cpu of its own, so
+// that memory a thread touches first stays on its NUMA node. Off by default.
+FJ_API void MtSetThreadPinning(bool enable);
+
+// Allocator for large arrays that MtParallelFill initializes. resize()
+// leaves elements of plain types uninitialized, so each page is first
+// touched, and placed, by the thread that fills it.
+template<typename T>
+class MtFirstTouchAllocator : public std::allocator<T> {
+public:
+  template<typename U>
+  struct rebind {
+    typedef MtFirstTouchAllocator<U> other;
+  };
+
+  MtFirstTouchAllocator() {}
+  template<typename U>
+  MtFirstTouchAllocator(const MtFirstTouchAllocator<U> &) {}
+
+  template<typename U>
+  void construct(U *p)
+  {
+    ::new(static_cast<void *>(p)) U;
+  }
+  template<typename U, typename... Args>
+  void construct(U *p, Args&&... args)
+  {
+    ::new(static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+};
+
+class MtFillChunk {
+public:
+  MtFillChunk() {}
+  ~MtFillChunk() {}
+
+public:
+  void *data = nullptr;
+  std::size_t size = 0;
+  std::size_t chunk_size = 1;
+  const void *value = nullptr;
+  void (*fill_fn)(void *data, std::size_t begin, std::size_t end,
+      const void *value) = nullptr;
+};
+
+FJ_API void MtRunParallelFill(MtFillChunk *fill);
+
+// Fills array in chunks of about 1MB on all available threads.
+template<typename T>
+void MtParallelFill(T *data, std::size_t size, const T &value)
+{
+  MtFillChunk fill;
+  fill.data = data;
+  fill.size = size;
+  fill.chunk_size = std::max(static_cast<std::size_t>(1), (1 << 20) / sizeof(T));
+  fill.value = &value;
+  fill.fill_fn = [](void *data, std::size_t begin, std::size_t end, const void *value)
+    {
+      T *array = static_cast<T *>(data);
+      std::fill(array + begin, array + end, *static_cast<const T *>(value));
+    };
+
+  MtRunParallelFill(&fill);
+}
+
+class TaskGroupState;
+
+// MtTaskGroup submits independent tasks to the thread pool. Tasks can run
+// task groups or loops of their own. Idle workers steal the oldest tasks.
+// Wait() runs tasks that no worker has picked up yet on the calling thread,
+// then waits until the rest are done. Once a task returns
+// LoopStatus::Cancel, tasks not started yet are skipped.
+class FJ_API MtTaskGroup {
+public:
+  MtTaskGroup();
+  ~MtTaskGroup();
+
+  // task_fn gets task_id as context.iteration_id
+  void Run(void *data, TaskFunction task_fn, int task_id);
+  LoopStatus Wait();
+
+private:
+  MtTaskGroup(const MtTaskGroup &);
+  const MtTaskGroup &operator=(const MtTaskGroup &);
+
+  TaskGroupState *state_;
+};
 
 } // namespace xxx
 
@@ -4,7 +4,9 @@ See LICENSE and README
 */
 
 #include "fj_noise.h"
+#include "fj_multi_thread.h"
 #include "fj_vector.h"
+#include <cassert>
 #include <cmath>
 
 #define PERMUTAION \
@@ -30,6 +32,9 @@ static const int perm[] = {
   PERMUTAION
 };
 
+// number of points processed together by batch functions
+static const int NOISE_BATCH_SIZE = 64;
+
 Real PerlinNoise(const Vector &position,
     Real lacunarity, Real persistence, int octaves)
 {
@@ -56,10 +61,10 @@ Vector PerlinNoise3d(const Vector &position,
   P = position;
   P_out.x = PerlinNoise(P, lacunarity, persistence, octaves);
 
-  P = position + Vector(131.977, 21.1823, 71.0231);
+  P = position + NOISE3D_OFFSET_Y;
   P_out.y = PerlinNoise(P, lacunarity, persistence, octaves);
 
-  P = position + Vector(237.492, 11.1312, 133.129);
+  P = position + NOISE3D_OFFSET_Z;
   P_out.z = PerlinNoise(P, lacunarity, persistence, octaves);
 
   return P_out;
@@ -85,6 +90,17 @@ static inline Real grad(int hash, Real x, Real y, Real z)
   return ((h&1) == 0 ? u : -u) + ((h&2) == 0 ? v : -v);
 }
 
+// gradient directions of grad() as tables for branch free evaluation
+static const Real GRAD_X[16] = {1, -1,  1, -1, 1, -1,  1, -1, 0,  0,  0,  0, 1,  0, -1,  0};
+static const Real GRAD_Y[16] = {1,  1, -1, -1, 0,  0,  0,  0, 1, -1,  1, -1, 1, -1,  1, -1};
+static const Real GRAD_Z[16] = {0,  0,  0,  0, 1,  1, -1, -1, 1,  1, -1, -1, 0,  1,  0, -1};
+
+static inline Real grad_table(int hash, Real x, Real y, Real z)
+{
+  const int h = hash & 15;
+  return GRAD_X[h] * x + GRAD_Y[h] * y + GRAD_Z[h] * z;
+}
+
 Real PeriodicNoise3d(Real x, Real y, Real z)
 {
   // Find unit cube that contains point.
@@ -127,4 +143,292 @@ Real PeriodicNoise3d(Real x, Real y, Real z)
   return result;
 }
 
+void PerlinNoiseBatch(const Vector *positions, int count,
+    Real lacunarity, Real persistence, int octaves, Real *noise)
+{
+  Real x[NOISE_BATCH_SIZE];
+  Real y[NOISE_BATCH_SIZE];
+  Real z[NOISE_BATCH_SIZE];
+  Real octave_noise[NOISE_BATCH_SIZE];
+
+  for (int start = 0; start < count; start += NOISE_BATCH_SIZE) {
+    const int N = count - start < NOISE_BATCH_SIZE ? count - start : NOISE_BATCH_SIZE;
+    Real *dst = &noise[start];
+    Real amp = 1;
+
+    for (int i = 0; i < N; i++) {
+      x[i] = positions[start + i].x;
+      y[i] = positions[start + i].y;
+      z[i] = positions[start + i].z;
+      dst[i] = 0;
+    }
+
+    for (int octave = 0; octave < octaves; octave++) {
+      PeriodicNoise3dBatch(x, y, z, N, octave_noise);
+
+      for (int i = 0; i < N; i++) {
+        dst[i] += amp * octave_noise[i];
+      }
+      for (int i = 0; i < N; i++) {
+        x[i] *= lacunarity;
+        y[i] *= lacunarity;
+        z[i] *= lacunarity;
+      }
+      amp *= persistence;
+    }
+  }
+}
+
+void PerlinNoise3dBatch(const Vector *positions, int count,
+    Real lacunarity, Real persistence, int octaves, Vector *noise)
+{
+  Vector P[NOISE_BATCH_SIZE];
+  Real component[NOISE_BATCH_SIZE];
+
+  for (int start = 0; start < count; start += NOISE_BATCH_SIZE) {
+    const int N = count - start < NOISE_BATCH_SIZE ? count - start : NOISE_BATCH_SIZE;
+    const Vector *src = &positions[start];
+    Vector *dst = &noise[start];
+
+    PerlinNoiseBatch(src, N, lacunarity, persistence, octaves, component);
+    for (int i = 0; i < N; i++) {
+      dst[i].x = component[i];
+    }
+
+    for (int i = 0; i < N; i++) {
+      P[i] = src[i] + NOISE3D_OFFSET_Y;
+    }
+    PerlinNoiseBatch(P, N, lacunarity, persistence, octaves, component);
+    for (int i = 0; i < N; i++) {
+      dst[i].y = component[i];
+    }
+
+    for (int i = 0; i < N; i++) {
+      P[i] = src[i] + NOISE3D_OFFSET_Z;
+    }
+    PerlinNoiseBatch(P, N, lacunarity, persistence, octaves, component);
+    for (int i = 0; i < N; i++) {
+      dst[i].z = component[i];
+    }
+  }
+}
+
+void PeriodicNoise3dBatch(const Real *x, const Real *y, const Real *z,
+    int count, Real *noise)
+{
+  int X[NOISE_BATCH_SIZE], Y[NOISE_BATCH_SIZE], Z[NOISE_BATCH_SIZE];
+  Real xx[NOISE_BATCH_SIZE], yy[NOISE_BATCH_SIZE], zz[NOISE_BATCH_SIZE];
+  Real g[8][NOISE_BATCH_SIZE];
+
+  for (int start = 0; start < count; start += NOISE_BATCH_SIZE) {
+    const int N = count - start < NOISE_BATCH_SIZE ? count - start : NOISE_BATCH_SIZE;
+    const Real *px = &x[start];
+    const Real *py = &y[start];
+    const Real *pz = &z[start];
+
+    // floor by truncation then correction so that the loops vectorize.
+    // same as floor() in int range
+    for (int i = 0; i < N; i++) {
+      const int ix = (int) px[i];
+      const int iy = (int) py[i];
+      const int iz = (int) pz[i];
+      const int fx = ix - (px[i] < ix);
+      const int fy = iy - (py[i] < iy);
+      const int fz = iz - (pz[i] < iz);
+      xx[i] = px[i] - fx;
+      yy[i] = py[i] - fy;
+      zz[i] = pz[i] - fz;
+      X[i] = fx & 255;
+      Y[i] = fy & 255;
+      Z[i] = fz & 255;
+    }
+
+    // hashes and gradients of the 8 cube corners
+    for (int i = 0; i < N; i++) {
+      const int A =  perm[X[i]] + Y[i];
+      const int AA = perm[A] + Z[i];
+      const int AB = perm[A + 1] + Z[i];
+      const int B =  perm[X[i] + 1] + Y[i];
+      const int BA = perm[B] + Z[i];
+      const int BB = perm[B + 1] + Z[i];
+
+      g[0][i] = grad_table(perm[AA],   xx[i],   yy[i],   zz[i]);
+      g[1][i] = grad_table(perm[BA],   xx[i]-1, yy[i],   zz[i]);
+      g[2][i] = grad_table(perm[AB],   xx[i],   yy[i]-1, zz[i]);
+      g[3][i] = grad_table(perm[BB],   xx[i]-1, yy[i]-1, zz[i]);
+      g[4][i] = grad_table(perm[AA+1], xx[i],   yy[i],   zz[i]-1);
+      g[5][i] = grad_table(perm[BA+1], xx[i]-1, yy[i],   zz[i]-1);
+      g[6][i] = grad_table(perm[AB+1], xx[i],   yy[i]-1, zz[i]-1);
+      g[7][i] = grad_table(perm[BB+1], xx[i]-1, yy[i]-1, zz[i]-1);
+    }
+
+    for (int i = 0; i < N; i++) {
+      const Real u = fade(xx[i]);
+      const Real v = fade(yy[i]);
+      const Real w = fade(zz[i]);
+
+      noise[start + i] =
+        lerp(w,
+          lerp(v,
+            lerp(u, g[0][i], g[1][i]),
+            lerp(u, g[2][i], g[3][i])),
+          lerp(v,
+            lerp(u, g[4][i], g[5][i]),
+            lerp(u, g[6][i], g[7][i])));
+    }
+  }
+}
+
+// PeriodicNoise3d with lattice wrapping around at period. for x, y, z >= 0
+static Real tiled_noise(Real x, Real y, Real z, int period)
+{
+  const int X = (int) floor(x) % period;
+  const int Y = (int) floor(y) % period;
+  const int Z = (int) floor(z) % period;
+  const int X1 = (X + 1) % period;
+  const int Y1 = (Y + 1) % period;
+  const int Z1 = (Z + 1) % period;
+
+  const Real xx = x - floor(x);
+  const Real yy = y - floor(y);
+  const Real zz = z - floor(z);
+
+  const Real u = fade(xx);
+  const Real v = fade(yy);
+  const Real w = fade(zz);
+
+  const int A0 = perm[perm[X]  + Y];
+  const int A1 = perm[perm[X]  + Y1];
+  const int B0 = perm[perm[X1] + Y];
+  const int B1 = perm[perm[X1] + Y1];
+
+  return
+    lerp(w,
+      lerp(v,
+        lerp(u, grad(perm[A0 + Z],  xx,   yy,   zz),
+            grad(perm[B0 + Z],  xx-1, yy,   zz)),
+        lerp(u, grad(perm[A1 + Z],  xx,   yy-1, zz),
+            grad(perm[B1 + Z],  xx-1, yy-1, zz))),
+      lerp(v,
+        lerp(u, grad(perm[A0 + Z1], xx,   yy,   zz-1),
+            grad(perm[B0 + Z1], xx-1, yy,   zz-1)),
+        lerp(u, grad(perm[A1 + Z1], xx,   yy-1, zz-1),
+            grad(perm[B1 + Z1], xx-1, yy-1, zz-1))));
+}
+
+struct TileBaking {
+  float *values;
+  int period;
+  int resolution;
+  int size;
+};
+
+static LoopStatus bake_slice(void *data, const ThreadContext &context)
+{
+  const TileBaking *baking = static_cast<const TileBaking *>(data);
+  const int size = baking->size;
+  const int k = context.iteration_id;
+  const Real delta = 1. / baking->resolution;
+  float *dst = &baking->values[static_cast<size_t>(k) * size * size];
+
+  for (int j = 0; j < size; j++) {
+    for (int i = 0; i < size; i++) {
+      *dst++ = tiled_noise(i * delta, j * delta, k * delta, baking->period);
+    }
+  }
+  return LoopStatus::Continue;
+}
+
+NoiseTile::NoiseTile() :
+    values_(),
+    period_(0),
+    resolution_(0),
+    size_(0)
+{
+}
+
+NoiseTile::~NoiseTile()
+{
+}
+
+void NoiseTile::Bake(int period, int resolution)
+{
+  assert(period > 0 && period <= 256);
+  assert(resolution > 0);
+
+  period_ = period;
+  resolution_ = resolution;
+  size_ = period * resolution;
+  values_.resize(size_ * size_ * size_);
+
+  TileBaking baking;
+  baking.values = &values_[0];
+  baking.period = period_;
+  baking.resolution = resolution_;
+  baking.size = size_;
+
+  // bake z slices in parallel
+  MtRunParallelFor(&baking, bake_slice, MtGetMaxAvailableThreadCount(), 0, size_);
+}
+
+void NoiseTile::Clear()
+{
+  std::vector<float>().swap(values_);
+  period_ = 0;
+  resolution_ = 0;
+  size_ = 0;
+}
+
+bool NoiseTile::IsEmpty() const
+{
+  return values_.empty();
+}
+
+Real NoiseTile::Sample(Real x, Real y, Real z) const
+{
+  if (IsEmpty()) {
+    return 0;
+  }
+
+  const Real gx = x * resolution_;
+  const Real gy = y * resolution_;
+  const Real gz = z * resolution_;
+  const int fx = (int) floor(gx);
+  const int fy = (int) floor(gy);
+  const int fz = (int) floor(gz);
+  const Real tx = gx - fx;
+  const Real ty = gy - fy;
+  const Real tz = gz - fz;
+
+  // wrap into the tile
+  int i0 = fx % size_;
+  int j0 = fy % size_;
+  int k0 = fz % size_;
+  if (i0 < 0) {
+    i0 += size_;
+  }
+  if (j0 < 0) {
+    j0 += size_;
+  }
+  if (k0 < 0) {
+    k0 += size_;
+  }
+  const int i1 = i0 + 1 == size_ ? 0 : i0 + 1;
+  const int j1 = j0 + 1 == size_ ? 0 : j0 + 1;
+  const int k1 = k0 + 1 == size_ ? 0 : k0 + 1;
+
+  const float *v = &values_[0];
+  const int row = size_;
+  const int slice = size_ * size_;
+
+  return
+    lerp(tz,
+      lerp(ty,
+        lerp(tx, v[k0 * slice + j0 * row + i0], v[k0 * slice + j0 * row + i1]),
+        lerp(tx, v[k0 * slice + j1 * row + i0], v[k0 * slice + j1 * row + i1])),
+      lerp(ty,
+        lerp(tx, v[k1 * slice + j0 * row + i0], v[k1 * slice + j0 * row + i1]),
+        lerp(tx, v[k1 * slice + j1 * row + i0], v[k1 * slice + j1 * row + i1])));
+}
+
 } // namespace xxx
@@ -6,10 +6,14 @@
 
 #include "fj_compatibility.h"
 #include "fj_types.h"
+#include "fj_vector.h"
+#include <vector>
 
 namespace  fj {
 
-class Vector;
+// offsets of y and z components of PerlinNoise3d
+const Vector NOISE3D_OFFSET_Y(131.977, 21.1823, 71.0231);
+const Vector NOISE3D_OFFSET_Z(237.492, 11.1312, 133.129);
 
 FJ_API Real PerlinNoise(const Vector &position,
     Real lacunarity, Real persistence, int octaves);
@@ -19,6 +23,37 @@ FJ_API Vector PerlinNoise3d(const Vector &position,
 
 FJ_API Real PeriodicNoise3d(Real x, Real y, Real z);
 
+// batch versions evaluate count points per call and give the same values
+// as the functions above
+FJ_API void PerlinNoiseBatch(const Vector *positions, int count,
+    Real lacunarity, Real persistence, int octaves, Real *noise);
+
+FJ_API void PerlinNoise3dBatch(const Vector *positions, int count,
+    Real lacunarity, Real persistence, int octaves, Vector *noise);
+
+FJ_API void PeriodicNoise3dBatch(const Real *x, const Real *y, const Real *z,
+    int count, Real *noise);
+
+// PeriodicNoise3d made to repeat every period lattice units and baked into
+// a grid of resolution samples per unit. sampled trilinearly
+class FJ_API NoiseTile {
+public:
+  NoiseTile();
+  ~NoiseTile();
+
+  void Bake(int period, int resolution);
+  void Clear();
+  bool IsEmpty() const;
+
+  Real Sample(Real x, Real y, Real z) const;
+
+private:
+  std::vector<float> values_;
+  int period_;
+  int resolution_;
+  int size_;
+};
+
 } // namespace xxx
 
 #endif // FJ_XXX_H
@@ -62,6 +62,16 @@ const VolumeAccelerator *ObjectGroup::GetVolumeAccelerator() const
   return volume_set_acc_;
 }
 
+Index ObjectGroup::GetVolumeObjectCount() const
+{
+  return volume_set_.GetObjectCount();
+}
+
+const ObjectInstance *ObjectGroup::GetVolumeObject(Index index) const
+{
+  return volume_set_.GetObject(index);
+}
+
 void ObjectGroup::ComputeBounds()
 {
   surface_set_.ComputeBounds();
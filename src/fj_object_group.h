@@ -21,6 +21,9 @@ public:
   const Accelerator *GetSurfaceAccelerator() const;
   const VolumeAccelerator *GetVolumeAccelerator() const;
 
+  Index GetVolumeObjectCount() const;
+  const ObjectInstance *GetVolumeObject(Index index) const;
+
   void ComputeBounds();
 
 private:
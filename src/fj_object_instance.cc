@@ -22,6 +22,8 @@ ObjectInstance::ObjectInstance() :
     bounds_(),
 
     transform_samples_(),
+    static_transform_(),
+    is_static_transform_(true),
 
     shader_list_(1, NULL),
     target_lights_(NULL),
@@ -33,6 +35,7 @@ ObjectInstance::ObjectInstance() :
     self_target_(NULL)
 {
   XfmInitTransformSampleList(&transform_samples_);
+  update_transform_cache();
   update_bounds();
 }
 
@@ -88,33 +91,43 @@ bool ObjectInstance::IsVolume() const
   return true;
 }
 
+const Volume *ObjectInstance::GetVolume() const
+{
+  return volume_;
+}
+
 void ObjectInstance::SetTranslate(Real tx, Real ty, Real tz, Real time)
 {
   XfmPushTranslateSample(&transform_samples_, tx, ty, tz, time);
+  update_transform_cache();
   update_bounds();
 }
 
 void ObjectInstance::SetRotate(Real rx, Real ry, Real rz, Real time)
 {
   XfmPushRotateSample(&transform_samples_, rx, ry, rz, time);
+  update_transform_cache();
   update_bounds();
 }
 
 void ObjectInstance::SetScale(Real sx, Real sy, Real sz, Real time)
 {
   XfmPushScaleSample(&transform_samples_, sx, sy, sz, time);
+  update_transform_cache();
   update_bounds();
 }
 
 void ObjectInstance::SetTransformOrder(int order)
 {
   XfmSetSampleTransformOrder(&transform_samples_, order);
+  update_transform_cache();
   update_bounds();
 }
 
 void ObjectInstance::SetRotateOrder(int order)
 {
   XfmSetSampleRotateOrder(&transform_samples_, order);
+  update_transform_cache();
   update_bounds();
 }
 
@@ -217,7 +230,7 @@ bool ObjectInstance::RayIntersect(const Ray &ray, Real time, Intersection *isect
   }
 
   Transform transform_interp;
-  XfmLerpTransformSample(&transform_samples_, time, &transform_interp);
+  lerp_transform(time, &transform_interp);
 
   // transform ray to object space
   Ray ray_object_space = ray;
@@ -250,7 +263,7 @@ bool ObjectInstance::RayVolumeIntersect(const Ray &ray, Real time,
   }
 
   Transform transform_interp;
-  XfmLerpTransformSample(&transform_samples_, time, &transform_interp);
+  lerp_transform(time, &transform_interp);
 
   // transform ray to object space
   Ray ray_object_space = ray;
@@ -287,7 +300,7 @@ bool ObjectInstance::GetVolumeSample(const Vector &point, Real time,
   }
 
   Transform transform_interp;
-  XfmLerpTransformSample(&transform_samples_, time, &transform_interp);
+  lerp_transform(time, &transform_interp);
 
   Vector point_in_objspace = point;
   XfmTransformPointInverse(&transform_interp, &point_in_objspace);
@@ -296,6 +309,137 @@ bool ObjectInstance::GetVolumeSample(const Vector &point, Real time,
   return hit;
 }
 
+bool ObjectInstance::GetVolumeSamples(const Vector &point, const Vector &step,
+    int count, int level, Real time, float *densities) const
+{
+  if (!IsVolume()) {
+    return false;
+  }
+
+  Transform transform_interp;
+  lerp_transform(time, &transform_interp);
+
+  // affine transform maps evenly spaced points to evenly spaced points
+  Vector point_in_objspace = point;
+  Vector step_in_objspace = step;
+  XfmTransformPointInverse(&transform_interp, &point_in_objspace);
+  XfmTransformVectorInverse(&transform_interp, &step_in_objspace);
+
+  volume_->GetSamples(point_in_objspace, step_in_objspace, count, level,
+      densities);
+  return true;
+}
+
+// transforms ray to object space. t is preserved
+Ray ObjectInstance::to_object_space(const Ray &ray, Real time) const
+{
+  Transform transform_interp;
+  lerp_transform(time, &transform_interp);
+
+  Ray ray_object_space = ray;
+  XfmTransformPointInverse(&transform_interp, &ray_object_space.orig);
+  XfmTransformVectorInverse(&transform_interp, &ray_object_space.dir);
+
+  return ray_object_space;
+}
+
+int ObjectInstance::FindVolumeOccupiedIntervals(const Ray &ray, Real time,
+    IntervalList *intervals) const
+{
+  if (!IsVolume()) {
+    return 0;
+  }
+
+  const Ray ray_object_space = to_object_space(ray, time);
+
+  return volume_->FindOccupiedIntervals(
+      ray_object_space.orig,
+      ray_object_space.dir,
+      ray_object_space.tmin,
+      ray_object_space.tmax,
+      this, intervals);
+}
+
+Real ObjectInstance::GetVolumeVoxelStep(const Ray &ray, Real time) const
+{
+  if (!IsVolume()) {
+    return 0;
+  }
+
+  const Ray ray_object_space = to_object_space(ray, time);
+  const Vector &dir = ray_object_space.dir;
+  const Vector voxelsize = volume_->GetVoxelSize();
+  if (voxelsize.x <= 0 || voxelsize.y <= 0 || voxelsize.z <= 0) {
+    return 0;
+  }
+
+  // the axis crossed fastest decides the distance
+  const Real rate = Max(Max(
+      Abs(dir.x) / voxelsize.x,
+      Abs(dir.y) / voxelsize.y),
+      Abs(dir.z) / voxelsize.z);
+  if (rate <= 0) {
+    return 0;
+  }
+
+  return 1 / rate;
+}
+
+bool ObjectInstance::SampleVolumeFreeFlight(const Ray &ray, Real time,
+    XorShift *rng, Real *t_collision) const
+{
+  if (!IsVolume()) {
+    return false;
+  }
+
+  const Ray ray_object_space = to_object_space(ray, time);
+
+  return volume_->SampleFreeFlight(
+      ray_object_space.orig,
+      ray_object_space.dir,
+      ray_object_space.tmin,
+      ray_object_space.tmax,
+      rng, t_collision);
+}
+
+Real ObjectInstance::EstimateVolumeTransmittance(const Ray &ray, Real time,
+    XorShift *rng) const
+{
+  if (!IsVolume()) {
+    return 1;
+  }
+
+  const Ray ray_object_space = to_object_space(ray, time);
+
+  return volume_->EstimateTransmittance(
+      ray_object_space.orig,
+      ray_object_space.dir,
+      ray_object_space.tmin,
+      ray_object_space.tmax,
+      rng);
+}
+
+void ObjectInstance::lerp_transform(Real time, Transform *transform) const
+{
+  if (is_static_transform_) {
+    *transform = static_transform_;
+    return;
+  }
+  XfmLerpTransformSample(&transform_samples_, time, transform);
+}
+
+void ObjectInstance::update_transform_cache()
+{
+  is_static_transform_ =
+      transform_samples_.translate.sample_count == 1 &&
+      transform_samples_.rotate.sample_count == 1 &&
+      transform_samples_.scale.sample_count == 1;
+
+  if (is_static_transform_) {
+    XfmLerpTransformSample(&transform_samples_, 0, &static_transform_);
+  }
+}
+
 void ObjectInstance::update_bounds()
 {
   if (IsSurface()) {
@@ -15,7 +15,9 @@ namespace fj {
 class Intersection;
 class VolumeSample;
 class Accelerator;
+class IntervalList;
 class Interval;
+class XorShift;
 class Shader;
 class Volume;
 class Light;
@@ -33,6 +35,7 @@ public:
   int SetVolume(const Volume *volume);
   bool IsSurface() const;
   bool IsVolume() const;
+  const Volume *GetVolume() const;
 
   // transformation
   void SetTranslate(Real tx, Real ty, Real tz, Real time);
@@ -64,11 +67,27 @@ public:
   bool RayIntersect(const Ray &ray, Real time, Intersection *isect) const;
   bool RayVolumeIntersect(const Ray &ray, Real time, Interval *interval) const;
   bool GetVolumeSample(const Vector &point, Real time, VolumeSample *sample) const;
+  // densities at count points of point + i * step in world space
+  bool GetVolumeSamples(const Vector &point, const Vector &step, int count,
+      int level, Real time, float *densities) const;
+  int FindVolumeOccupiedIntervals(const Ray &ray, Real time,
+      IntervalList *intervals) const;
+  // ray distance to cross one voxel. 0 for non volume objects
+  Real GetVolumeVoxelStep(const Ray &ray, Real time) const;
+  bool SampleVolumeFreeFlight(const Ray &ray, Real time,
+      XorShift *rng, Real *t_collision) const;
+  Real EstimateVolumeTransmittance(const Ray &ray, Real time,
+      XorShift *rng) const;
 
 private:
   void update_bounds();
   void merge_sampled_bounds();
 
+  // transform at time. not interpolated again unless animated
+  void lerp_transform(Real time, Transform *transform) const;
+  void update_transform_cache();
+  Ray to_object_space(const Ray &ray, Real time) const;
+
   // geometric properties
   const Accelerator *acc_;
   const Volume *volume_;
@@ -76,6 +95,8 @@ private:
 
   // transformation properties
   TransformSampleList transform_samples_;
+  Transform static_transform_;
+  bool is_static_transform_;
 
   // non-geometric properties
   std::vector<const Shader *> shader_list_;
@@ -6,6 +6,8 @@ See LICENSE and README
 #ifndef FJ_OS_H
 #define FJ_OS_H
 
+#include <cstddef>
+
 namespace fj {
 
 extern void *OsDlopen(const char *filename);
@@ -13,6 +15,17 @@ extern void *OsDlsym(void *handle, const char *symbol);
 extern char *OsDlerror(void *handle);
 extern int OsDlclose(void *handle);
 
+// maps whole file read only. returns NULL on failure
+extern void *OsMapFile(const char *filename, size_t *size);
+extern int OsUnmapFile(void *addr, size_t size);
+
+// number of cpus this process may run on. it honors the affinity mask and
+// cgroup cpu quota where available. returns 0 if unknown
+extern int OsGetAvailableCpuCount();
+// binds the calling thread to the n-th cpu this process may run on.
+// -1 lets it run on any of them again
+extern int OsSetThreadCpu(int cpu_index);
+
 } // namespace xxx
 
 #endif /* FJ_XXX_H */
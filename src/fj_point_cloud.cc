@@ -44,13 +44,16 @@ bool PointCloud::ray_intersect(Index prim_id, const Ray &ray,
   }
 
   const Real disc_sqrt = sqrt(discriminant);
-  const Real t0 = -b - disc_sqrt;
-  const Real t1 = -b + disc_sqrt;
+  const Real t0 = (-b - disc_sqrt) / a;
+  const Real t1 = (-b + disc_sqrt) / a;
 
-  if (t1 <= 0.) {
+  if (t1 <= ray.tmin) {
+    return false;
+  }
+  const Real t_hit = (t0 < ray.tmin) ? t1 : t0;
+  if (!RayInRange(ray, t_hit)) {
     return false;
   }
-  const Real t_hit = (t1 <= 0.) ? t1 : t0;
 
   isect->P = RayPointAt(ray, t_hit);
   isect->N = isect->P - center;
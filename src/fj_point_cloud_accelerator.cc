@@ -0,0 +1,360 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "fj_point_cloud_accelerator.h"
+#include "fj_intersection.h"
+#include "fj_point_cloud.h"
+#include "fj_numeric.h"
+#include "fj_box.h"
+#include "fj_ray.h"
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+namespace fj {
+
+static const char ACCELERATOR_NAME[] = "PointCloud-BVH";
+static const int LEAF_SIZE = 8;
+static const int MAX_STACK_DEPTH = 64;
+
+class Point {
+public:
+  Point() : bounds(), centroid(), index(0) {}
+  ~Point() {}
+
+  Box bounds;
+  Vector centroid;
+  int index;
+};
+
+// spheres in a leaf are stored in float arrays relative to the leaf origin
+// so that all lanes are tested in a single loop. the float test only culls
+// candidates and hits are refined with PointCloud::RayIntersect.
+class PointLeaf {
+public:
+  PointLeaf() : origin(), epsilon(0), count(0)
+  {
+    for (int i = 0; i < LEAF_SIZE; i++) {
+      cx[i] = cy[i] = cz[i] = 0;
+      vx[i] = vy[i] = vz[i] = 0;
+      // empty lanes never hit
+      radius[i] = -1;
+      prim_id[i] = 0;
+    }
+  }
+  ~PointLeaf() {}
+
+  Vector origin;
+  float epsilon;
+
+  float cx[LEAF_SIZE], cy[LEAF_SIZE], cz[LEAF_SIZE];
+  float vx[LEAF_SIZE], vy[LEAF_SIZE], vz[LEAF_SIZE];
+  float radius[LEAF_SIZE];
+
+  int prim_id[LEAF_SIZE];
+  int count;
+};
+
+class PointNode {
+public:
+  PointNode() : bounds(), left(-1), right(-1), leaf_id(-1) {}
+  ~PointNode() {}
+
+  bool is_leaf() const
+  {
+    return leaf_id != -1;
+  }
+
+  Box bounds;
+  int left;
+  int right;
+  int leaf_id;
+};
+
+static int build_point_bvh(const PointCloud *ptc,
+    std::vector<Point> &points, int begin, int end,
+    std::vector<PointNode> &nodes, std::vector<PointLeaf> &leaves);
+static int intersect_leaf_spheres(const PointLeaf &leaf,
+    const Ray &ray, Real time, Real tmax, int *hit_lanes);
+
+PointCloudAccelerator::PointCloudAccelerator() : ptc_(NULL)
+{
+}
+
+PointCloudAccelerator::~PointCloudAccelerator()
+{
+}
+
+void PointCloudAccelerator::SetPointCloud(PointCloud *ptc)
+{
+  ptc_ = ptc;
+  SetPrimitiveSet(ptc);
+}
+
+int PointCloudAccelerator::build()
+{
+  if (ptc_ == NULL) {
+    return -1;
+  }
+
+  const int NPOINTS = ptc_->GetPointCount();
+  if (NPOINTS == 0) {
+    // TODO is NPOINTS == 0 error?
+    return -1;
+  }
+
+  std::vector<Point> points(NPOINTS);
+
+  for (int i = 0; i < NPOINTS; i++) {
+    ptc_->GetPrimitiveBounds(i, &points[i].bounds);
+    points[i].centroid = points[i].bounds.Centroid();
+    points[i].index = i;
+  }
+
+  std::vector<PointNode> nodes_tmp;
+  std::vector<PointLeaf> leaves_tmp;
+  nodes_tmp.reserve(2 * NPOINTS / LEAF_SIZE + 1);
+  leaves_tmp.reserve(NPOINTS / LEAF_SIZE + 1);
+
+  build_point_bvh(ptc_, points, 0, NPOINTS, nodes_tmp, leaves_tmp);
+
+  // commit
+  nodes_.swap(nodes_tmp);
+  leaves_.swap(leaves_tmp);
+
+  return 0;
+}
+
+bool PointCloudAccelerator::intersect(const Ray &ray, Real time, Intersection *isect) const
+{
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  int stack[MAX_STACK_DEPTH];
+  int stack_size = 0;
+  int node_id = 0;
+  bool hit = false;
+  Real t_nearest = ray.tmax;
+
+  Intersection isect_candidates[2];
+  Intersection *isect_min = &isect_candidates[0];
+  Intersection *isect_tmp = &isect_candidates[1];
+
+  Real boxhit_tmin, boxhit_tmax;
+  if (!BoxRayIntersect(nodes_[0].bounds, ray.orig, ray.dir, ray.tmin, t_nearest,
+        &boxhit_tmin, &boxhit_tmax)) {
+    return false;
+  }
+
+  for (;;) {
+    const PointNode &node = nodes_[node_id];
+
+    if (node.is_leaf()) {
+      const PointLeaf &leaf = leaves_[node.leaf_id];
+      int hit_lanes[LEAF_SIZE];
+      const int nhits = intersect_leaf_spheres(leaf, ray, time, t_nearest, hit_lanes);
+
+      for (int i = 0; i < nhits; i++) {
+        const int lane = hit_lanes[i];
+        const bool hittmp = ptc_->RayIntersect(leaf.prim_id[lane], ray, time, isect_tmp);
+
+        if (hittmp && isect_tmp->t_hit < t_nearest) {
+          std::swap(isect_min, isect_tmp);
+          t_nearest = isect_min->t_hit;
+          hit = true;
+        }
+      }
+
+      if (stack_size == 0)
+        break;
+      node_id = stack[--stack_size];
+      continue;
+    }
+
+    const PointNode &left = nodes_[node.left];
+    const PointNode &right = nodes_[node.right];
+    Real left_tmin, left_tmax;
+    Real right_tmin, right_tmax;
+
+    const bool hit_left = BoxRayIntersect(left.bounds,
+        ray.orig, ray.dir, ray.tmin, t_nearest,
+        &left_tmin, &left_tmax);
+    const bool hit_right = BoxRayIntersect(right.bounds,
+        ray.orig, ray.dir, ray.tmin, t_nearest,
+        &right_tmin, &right_tmax);
+
+    if (hit_left && hit_right) {
+      // visit the nearer child first to shrink t_nearest early
+      if (left_tmin <= right_tmin) {
+        stack[stack_size++] = node.right;
+        node_id = node.left;
+      } else {
+        stack[stack_size++] = node.left;
+        node_id = node.right;
+      }
+    }
+    else if (hit_left) {
+      node_id = node.left;
+    }
+    else if (hit_right) {
+      node_id = node.right;
+    }
+    else {
+      if (stack_size == 0)
+        break;
+      node_id = stack[--stack_size];
+    }
+  }
+
+  if (hit) {
+    *isect = *isect_min;
+  }
+
+  return hit;
+}
+
+const char *PointCloudAccelerator::get_name() const
+{
+  return ACCELERATOR_NAME;
+}
+
+// Compares an axis component of point centroid for std::nth_element.
+class PointCentroidLess {
+public:
+  PointCentroidLess(int axis) : axis_(axis) {}
+  bool operator()(const Point &a, const Point &b) const
+  {
+    return a.centroid[axis_] < b.centroid[axis_];
+  }
+
+private:
+  int axis_;
+};
+
+static int build_point_bvh(const PointCloud *ptc,
+    std::vector<Point> &points, int begin, int end,
+    std::vector<PointNode> &nodes, std::vector<PointLeaf> &leaves)
+{
+  const int node_id = nodes.size();
+  nodes.push_back(PointNode());
+
+  Box bounds;
+  Box centroid_bounds;
+  bounds.ReverseInfinite();
+  centroid_bounds.ReverseInfinite();
+  for (int i = begin; i < end; i++) {
+    bounds.AddBox(points[i].bounds);
+    centroid_bounds.AddPoint(points[i].centroid);
+  }
+
+  if (end - begin <= LEAF_SIZE) {
+    PointLeaf leaf;
+    leaf.origin = bounds.Centroid();
+    leaf.epsilon = 1e-5 * Length(bounds.Diagonal());
+
+    for (int i = begin; i < end; i++) {
+      const int lane = i - begin;
+      const int index = points[i].index;
+      const Vector center = ptc->GetPointPosition(index) - leaf.origin;
+      const Vector velocity = ptc->GetPointVelocity(index);
+
+      leaf.cx[lane] = center.x;
+      leaf.cy[lane] = center.y;
+      leaf.cz[lane] = center.z;
+      leaf.vx[lane] = velocity.x;
+      leaf.vy[lane] = velocity.y;
+      leaf.vz[lane] = velocity.z;
+      leaf.radius[lane] = ptc->GetPointRadius(index);
+      leaf.prim_id[lane] = index;
+    }
+    leaf.count = end - begin;
+
+    nodes[node_id].bounds = bounds;
+    nodes[node_id].leaf_id = leaves.size();
+    leaves.push_back(leaf);
+    return node_id;
+  }
+
+  // split at median of the longest centroid axis
+  const Vector diagonal = centroid_bounds.Diagonal();
+  int axis = 0;
+  if (diagonal[1] > diagonal[axis]) axis = 1;
+  if (diagonal[2] > diagonal[axis]) axis = 2;
+
+  const int median = (begin + end) / 2;
+  std::nth_element(points.begin() + begin,
+      points.begin() + median,
+      points.begin() + end,
+      PointCentroidLess(axis));
+
+  const int left  = build_point_bvh(ptc, points, begin, median, nodes, leaves);
+  const int right = build_point_bvh(ptc, points, median, end, nodes, leaves);
+
+  nodes[node_id].bounds = bounds;
+  nodes[node_id].left = left;
+  nodes[node_id].right = right;
+
+  return node_id;
+}
+
+// Tests the ray segment [ray.tmin, tmax] against all spheres in the leaf.
+// The ray origin is moved to the point closest to the leaf origin first
+// so that float precision is enough regardless of the ray length.
+static int intersect_leaf_spheres(const PointLeaf &leaf,
+    const Ray &ray, Real time, Real tmax, int *hit_lanes)
+{
+  const Real dir_len2 = Dot(ray.dir, ray.dir);
+  const Real t_center = Dot(leaf.origin - ray.orig, ray.dir) / dir_len2;
+  const Vector orig_local = RayPointAt(ray, t_center) - leaf.origin;
+
+  const float ox = orig_local.x;
+  const float oy = orig_local.y;
+  const float oz = orig_local.z;
+  const float dx = ray.dir.x;
+  const float dy = ray.dir.y;
+  const float dz = ray.dir.z;
+  const float a_inv = 1. / dir_len2;
+  const float tmin_local = ray.tmin - t_center;
+  const float tmax_local = tmax - t_center;
+  const float ftime = time;
+  const float eps = leaf.epsilon;
+
+  int mask[LEAF_SIZE];
+
+  for (int i = 0; i < LEAF_SIZE; i++) {
+    const float lx = ox - (leaf.cx[i] + ftime * leaf.vx[i]);
+    const float ly = oy - (leaf.cy[i] + ftime * leaf.vy[i]);
+    const float lz = oz - (leaf.cz[i] + ftime * leaf.vz[i]);
+
+    // closest approach to the center and distance from it
+    const float t_mid = -(dx * lx + dy * ly + dz * lz) * a_inv;
+    const float px = lx + t_mid * dx;
+    const float py = ly + t_mid * dy;
+    const float pz = lz + t_mid * dz;
+    const float dist2 = px * px + py * py + pz * pz;
+
+    const float r = leaf.radius[i] + eps;
+    const float r2 = r * r;
+    const float half2 = (r2 - dist2) * a_inv;
+    const float half = std::sqrt(half2 > 0 ? half2 : 0.f);
+
+    mask[i] =
+        (leaf.radius[i] >= 0) &
+        (dist2 <= r2) &
+        (t_mid + half >= tmin_local) &
+        (t_mid - half <= tmax_local);
+  }
+
+  int nhits = 0;
+  for (int i = 0; i < LEAF_SIZE; i++) {
+    if (mask[i]) {
+      hit_lanes[nhits++] = i;
+    }
+  }
+
+  return nhits;
+}
+
+} // namespace xxx
@@ -0,0 +1,37 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#ifndef FJ_POINT_CLOUD_ACCELERATOR_H
+#define FJ_POINT_CLOUD_ACCELERATOR_H
+
+#include "fj_accelerator.h"
+#include <vector>
+
+namespace fj {
+
+class PointCloud;
+class PointNode;
+class PointLeaf;
+
+// Accelerator for particles. Leaves store sphere centers, velocities
+// and radii in float arrays and test all spheres in a single loop.
+class PointCloudAccelerator : public Accelerator {
+public:
+  PointCloudAccelerator();
+  ~PointCloudAccelerator();
+
+  void SetPointCloud(PointCloud *ptc);
+
+private:
+  virtual int build();
+  virtual bool intersect(const Ray &ray, Real time, Intersection *isect) const;
+  virtual const char *get_name() const;
+
+  const PointCloud *ptc_;
+  std::vector<PointNode> nodes_;
+  std::vector<PointLeaf> leaves_;
+};
+
+} // namespace xxx
+
+#endif // FJ_XXX_H
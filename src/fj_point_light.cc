@@ -18,7 +18,8 @@ int PointLight::get_sample_count() const
   return 1;
 }
 
-void PointLight::get_samples(LightSample *samples, int max_samples) const
+void PointLight::get_samples(const TraceContext &cxt,
+    LightSample *samples, int max_samples) const
 {
   if (max_samples == 0)
     return;
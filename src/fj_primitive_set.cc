@@ -45,4 +45,26 @@ Index PrimitiveSet::GetPrimitiveCount() const
   return get_primitive_count();
 }
 
+int PrimitiveSet::GetMotionSegmentCount() const
+{
+  return get_motion_segment_count();
+}
+
+int PrimitiveSet::GetMotionSegment(Real time) const
+{
+  const int NSEGMENTS = GetMotionSegmentCount();
+  const int segment = static_cast<int>(time * NSEGMENTS);
+
+  if (segment < 0)
+    return 0;
+  if (segment > NSEGMENTS - 1)
+    return NSEGMENTS - 1;
+  return segment;
+}
+
+void PrimitiveSet::GetPrimitiveSegmentBounds(Index prim_id, int segment, Box *bounds) const
+{
+  get_primitive_segment_bounds(prim_id, segment, bounds);
+}
+
 } // namespace xxx
@@ -26,6 +26,11 @@ public:
   void GetEntireBounds(Box *bounds) const;
   Index GetPrimitiveCount() const;
 
+  // motion segments split shutter interval [0, 1] evenly
+  int GetMotionSegmentCount() const;
+  int GetMotionSegment(Real time) const;
+  void GetPrimitiveSegmentBounds(Index prim_id, int segment, Box *bounds) const;
+
 private:
   virtual bool ray_intersect(Index prim_id, const Ray &ray,
       Real time, Intersection *isect) const = 0;
@@ -38,6 +43,15 @@ private:
   // TODO rename this
   virtual void get_bounds(Box *bounds) const = 0;
   virtual Index get_primitive_count() const = 0;
+
+  virtual int get_motion_segment_count() const
+  {
+    return 1;
+  }
+  virtual void get_primitive_segment_bounds(Index prim_id, int segment, Box *bounds) const
+  {
+    get_primitive_bounds(prim_id, bounds);
+  }
 };
 
 } // namespace xxx
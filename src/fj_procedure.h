@@ -8,6 +8,7 @@
 #include "fj_volume_filling.h"
 #include "fj_turbulence.h"
 #include "fj_point_cloud.h"
+#include "fj_multi_thread.h"
 #include "fj_progress.h"
 #include "fj_triangle.h"
 #include "fj_numeric.h"
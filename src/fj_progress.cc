@@ -25,6 +25,11 @@ void Progress::Start(Iteration total_iterations)
 }
 
 ProgressStatus Progress::Increment()
+{
+  return Increment(1);
+}
+
+ProgressStatus Progress::Increment(Iteration count)
 {
   static const int TOTAL_OUTPUTS = 50;
   static const float OUTPUTS_DIV = 100./TOTAL_OUTPUTS;
@@ -35,7 +40,7 @@ ProgressStatus Progress::Increment()
   }
 
   const float prev_percent = iteration_ / (float)total_iterations_ * 100.;
-  iteration_++;
+  iteration_ += count;
   const float next_percent = iteration_ / (float)total_iterations_ * 100.;
 
   const int prev_outputs = (int) (prev_percent / OUTPUTS_DIV);
@@ -53,6 +58,11 @@ ProgressStatus Progress::Increment()
   }
 }
 
+Iteration Progress::GetRemainingIterations() const
+{
+  return total_iterations_ - iteration_;
+}
+
 void Progress::Done()
 {
   if (iteration_ != total_iterations_) {
@@ -23,8 +23,12 @@ public:
 
   void Start(Iteration total_iterations);
   ProgressStatus Increment();
+  // advances count iterations at once
+  ProgressStatus Increment(Iteration count);
   void Done();
 
+  Iteration GetRemainingIterations() const;
+
 private:
   Iteration total_iterations_;
   Iteration iteration_;
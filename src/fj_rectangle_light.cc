@@ -2,10 +2,12 @@
 // See LICENSE and README
 
 #include "fj_rectangle_light.h"
+#include "fj_shading_context.h"
+#include "fj_shading.h"
 
 namespace fj {
 
-RectangleLight::RectangleLight() : rng_()
+RectangleLight::RectangleLight()
 {
 }
 
@@ -18,7 +20,8 @@ int RectangleLight::get_sample_count() const
   return GetSampleDensity();
 }
 
-void RectangleLight::get_samples(LightSample *samples, int max_samples) const
+void RectangleLight::get_samples(const TraceContext &cxt,
+    LightSample *samples, int max_samples) const
 {
   Transform transform_interp;
   // TODO time sampling
@@ -32,10 +35,10 @@ void RectangleLight::get_samples(LightSample *samples, int max_samples) const
   int nsamples = GetSampleCount();
   nsamples = Min(nsamples, max_samples);
 
+  XorShift &rng = SlGetShadingContext(&cxt)->GetRandom();
   for (int i = 0; i < nsamples; i++) {
-    XorShift &mutable_rng = const_cast<XorShift &>(rng_);
-    const Real x = mutable_rng.NextFloat01() - .5;
-    const Real z = mutable_rng.NextFloat01() - .5;
+    const Real x = rng.NextFloat01() - .5;
+    const Real z = rng.NextFloat01() - .5;
     Vector P_sample(x, 0, z);
 
     XfmTransformPoint(&transform_interp, &P_sample);
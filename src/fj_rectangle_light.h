@@ -5,7 +5,6 @@
 #define FJ_RECTANGLE_LIGHT_H
 
 #include "fj_light.h"
-#include "fj_random.h"
 
 namespace fj {
 
@@ -16,11 +15,10 @@ public:
 
 private:
   virtual int get_sample_count() const;
-  virtual void get_samples(LightSample *samples, int max_samples) const;
+  virtual void get_samples(const TraceContext &cxt,
+      LightSample *samples, int max_samples) const;
   virtual Color illuminate(const LightSample &sample, const Vector &Ps) const;
   virtual int preprocess();
-
-  XorShift rng_;
 };
 
 } // namespace xxx
@@ -4,6 +4,7 @@
 #include "fj_renderer.h"
 #include "fj_adaptive_grid_sampler.h"
 #include "fj_fixed_grid_sampler.h"
+#include "fj_shading_context.h"
 #include "fj_multi_thread.h"
 #include "fj_pixel_sample.h"
 #include "fj_framebuffer.h"
@@ -23,6 +24,9 @@
 #include "fj_box.h"
 
 #include <vector>
+#include <deque>
+#include <chrono>
+#include <mutex>
 #include <cassert>
 #include <cstring>
 #include <cstdio>
@@ -45,6 +49,14 @@ static int32_t generate_frame_id()
   return id < 0 ? -id : id;
 }
 
+// seconds on a clock that never goes back
+static double get_wall_time()
+{
+  const std::chrono::steady_clock::duration now =
+      std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration<double>(now).count();
+}
+
 static void distribute_progress_iterations(FrameProgress *progress, Iteration total_iteration_count)
 {
   const Iteration partial_itr = (Iteration) floor(total_iteration_count / 10.);
@@ -110,10 +122,9 @@ static Interrupt default_tile_start(void *data, const TileInfo *info)
 {
   return CALLBACK_CONTINUE;
 }
-static void increment_progress(void *data)
+static void increment_progress(FrameProgress *fp, Iteration count)
 {
-  FrameProgress *fp = reinterpret_cast<FrameProgress *>(data);
-  const ProgressStatus status = fp->progress.Increment();
+  const ProgressStatus status = fp->progress.Increment(count);
 
   if (status == PROGRESS_DONE) {
     Elapse elapse;
@@ -136,6 +147,51 @@ static void increment_progress(void *data)
     }
   }
 }
+// progress counts pixels so that split tiles add up to the whole frame
+class ProgressIncrement {
+public:
+  ProgressIncrement() {}
+  ~ProgressIncrement() {}
+
+  FrameProgress *progress = NULL;
+  Iteration pixel_count = 0;
+};
+
+static void increment_progress_by_pixels(void *data)
+{
+  ProgressIncrement *increment = reinterpret_cast<ProgressIncrement *>(data);
+  FrameProgress *fp = increment->progress;
+  Iteration pixel_count = increment->pixel_count;
+
+  // a tile can cross segments. advance segment by segment
+  while (pixel_count > 0) {
+    const Iteration remaining = fp->progress.GetRemainingIterations();
+    const Iteration count = remaining > 0 && remaining < pixel_count ?
+        remaining : pixel_count;
+
+    increment_progress(fp, count);
+    pixel_count -= count;
+  }
+}
+
+// advances progress to the end when the frame stops before all passes.
+// progress only moves when reporting to the viewer
+static void finish_frame_progress(void *data)
+{
+  FrameProgress *fp = reinterpret_cast<FrameProgress *>(data);
+  if (fp->report_to_viewer == false || fp->current_segment >= 10) {
+    return;
+  }
+
+  ProgressIncrement increment;
+  increment.progress = fp;
+  increment.pixel_count = fp->progress.GetRemainingIterations();
+  for (int i = fp->current_segment + 1; i < 10; i++) {
+    increment.pixel_count += fp->iteration_list[i];
+  }
+  increment_progress_by_pixels(&increment);
+}
+
 static Interrupt default_sample_done(void *data)
 {
   return CALLBACK_CONTINUE;
@@ -356,7 +412,10 @@ static Interrupt default_tile_done2(void *data, const TileInfo *info)
   }
 
   // increment progress
-  MtCriticalSection(data, increment_progress);
+  ProgressIncrement increment;
+  increment.progress = fp;
+  increment.pixel_count = static_cast<Iteration>(tile_w) * tile_h;
+  MtCriticalSection(&increment, increment_progress_by_pixels);
 
   return CALLBACK_CONTINUE;
 }
@@ -371,6 +430,8 @@ Renderer::Renderer()
 
   SetResolution(320, 240);
   SetTileSize(64, 64);
+  SetTileOrder(TILE_ORDER_SCANLINE);
+  SetPriorityRegion(0, 0, 0, 0);
   SetFilterWidth(2, 2);
 
   SetSamplerType(RENDERER_FIXED_GRID_SAMPLER);
@@ -388,9 +449,15 @@ Renderer::Renderer()
   SetRaymarchShadowStep(.1);
   SetRaymarchReflectStep(.1);
   SetRaymarchRefractStep(.1);
+  SetVolumeIntegrator(VOLUME_RAYMARCH);
+  SetRaymarchQuality(0);
+  SetRaymarchLod(0);
 
   SetUseMaxThread(0);
   SetThreadCount(1);
+  SetPinThreads(0);
+  SetTimeBudget(0);
+  render_start_time_ = 0;
 
   // TODO TEST
   if (0) {
@@ -476,6 +543,29 @@ void Renderer::SetTileSize(int xtilesize, int ytilesize)
   tilesize_[1] = ytilesize;
 }
 
+void Renderer::SetTileOrder(int tile_order)
+{
+  switch (tile_order) {
+  case TILE_ORDER_SCANLINE:
+  case TILE_ORDER_SPIRAL:
+  case TILE_ORDER_HILBERT:
+  case TILE_ORDER_MORTON:
+    tile_order_ = tile_order;
+    break;
+  default:
+    tile_order_ = TILE_ORDER_SCANLINE;
+    break;
+  }
+}
+
+void Renderer::SetPriorityRegion(int xmin, int ymin, int xmax, int ymax)
+{
+  priority_region_.min[0] = xmin;
+  priority_region_.min[1] = ymin;
+  priority_region_.max[0] = xmax;
+  priority_region_.max[1] = ymax;
+}
+
 void Renderer::SetFilterWidth(float xfwidth, float yfwidth)
 {
   assert(xfwidth > 0);
@@ -585,6 +675,31 @@ void Renderer::SetRaymarchRefractStep(double step)
   raymarch_refract_step_ = Max(step, .001);
 }
 
+void Renderer::SetVolumeIntegrator(int integrator)
+{
+  switch (integrator) {
+  case VOLUME_RAYMARCH:
+  case VOLUME_DELTA_TRACKING:
+    volume_integrator_ = integrator;
+    break;
+  default:
+    volume_integrator_ = VOLUME_RAYMARCH;
+    break;
+  }
+}
+
+void Renderer::SetRaymarchQuality(double quality)
+{
+  assert(quality >= 0);
+  raymarch_quality_ = Max(quality, 0);
+}
+
+void Renderer::SetRaymarchLod(double lod)
+{
+  assert(lod >= 0);
+  raymarch_lod_ = Max(lod, 0);
+}
+
 void Renderer::SetCamera(Camera *cam)
 {
   assert(cam != NULL);
@@ -629,6 +744,17 @@ void Renderer::SetThreadCount(int thread_count)
   }
 }
 
+void Renderer::SetPinThreads(int pin_threads)
+{
+  pin_threads_ = (pin_threads != 0);
+}
+
+void Renderer::SetTimeBudget(double seconds)
+{
+  assert(seconds >= 0);
+  time_budget_ = Max(seconds, 0);
+}
+
 int Renderer::GetThreadCount() const
 {
   const int max_thread_count = MtGetMaxAvailableThreadCount();
@@ -668,13 +794,23 @@ int Renderer::RenderScene()
 {
   int err = 0;
 
+  render_start_time_ = get_wall_time();
+
+  // before the framebuffer is first touched
+  if (pin_threads_) {
+    MtSetThreadPinning(true);
+  }
+
   err = prepare_rendering();
-  if (err) {
-    /* TODO error handling */
-    return -1;
+  if (!err) {
+    err = execute_rendering();
+  }
+
+  // pool work after the frame and the calling thread run unbound again
+  if (pin_threads_) {
+    MtSetThreadPinning(false);
   }
 
-  err = execute_rendering();
   if (err) {
     /* TODO error handling */
     return -1;
@@ -683,10 +819,103 @@ int Renderer::RenderScene()
   return 0;
 }
 
+// Tiles waiting to be rendered. Near the end of a frame there are fewer
+// tiles than idle threads, so a tile is split in halves when it is checked
+// out until every idle thread can get a piece. Each piece is sampled with its own
+// filter margin, so pieces reconstruct the same region as the whole tile.
+class TileQueue {
+public:
+  TileQueue(const Tiler &tiler, const std::vector<int> &iteration_que,
+      int thread_count);
+  ~TileQueue() {}
+
+  // returns false when no tiles are left or rendering is canceled.
+  // call Finish() when done with the tile
+  bool Checkout(Tile *tile);
+  void Finish();
+  void Cancel();
+
+private:
+  TileQueue(const TileQueue &);
+  const TileQueue &operator=(const TileQueue &);
+
+  std::deque<Tile> tiles_;
+  std::mutex mtx_;
+  int thread_count_;
+  int busy_count_;
+  bool canceled_;
+};
+
+// pieces smaller than this cost more in margin samples than they save
+static const int MIN_SPLIT_TILE_SIZE = 8;
+
+TileQueue::TileQueue(const Tiler &tiler, const std::vector<int> &iteration_que,
+    int thread_count) :
+  tiles_(),
+  thread_count_(thread_count),
+  busy_count_(0),
+  canceled_(false)
+{
+  for (std::size_t i = 0; i < iteration_que.size(); i++) {
+    tiles_.push_back(*tiler.GetTile(iteration_que[i]));
+  }
+}
+
+bool TileQueue::Checkout(Tile *tile)
+{
+  std::lock_guard<std::mutex> lock(mtx_);
+
+  if (canceled_ || tiles_.empty()) {
+    return false;
+  }
+
+  *tile = tiles_.front();
+  tiles_.pop_front();
+  busy_count_++;
+
+  // give the other half to a thread that would be idle otherwise.
+  // both halves keep the id of the original tile
+  const int idle_count = thread_count_ - busy_count_;
+  while (static_cast<int>(tiles_.size()) < idle_count) {
+    const int w = tile->xmax - tile->xmin;
+    const int h = tile->ymax - tile->ymin;
+    Tile half = *tile;
+
+    if (w >= h && w >= 2 * MIN_SPLIT_TILE_SIZE) {
+      const int xmid = tile->xmin + w / 2;
+      tile->xmax = xmid;
+      half.xmin = xmid;
+    } else if (h >= 2 * MIN_SPLIT_TILE_SIZE) {
+      const int ymid = tile->ymin + h / 2;
+      tile->ymax = ymid;
+      half.ymin = ymid;
+    } else {
+      break;
+    }
+    tiles_.push_front(half);
+  }
+
+  return true;
+}
+
+void TileQueue::Finish()
+{
+  std::lock_guard<std::mutex> lock(mtx_);
+  busy_count_--;
+}
+
+void TileQueue::Cancel()
+{
+  std::lock_guard<std::mutex> lock(mtx_);
+  canceled_ = true;
+}
+
 // TODO TMP REMOVE LATER
 class Worker {
 public:
-  Worker() : camera(NULL), framebuffer(NULL), sampler(NULL) {}
+  Worker() : camera(NULL), framebuffer(NULL), sampler(NULL), tile_queue(NULL),
+      deadline(0), stratum_stride(1), pass_strata(0, 1),
+      pixel_sums(NULL), weight_sums(NULL) {}
   ~Worker()
   {
     delete sampler;
@@ -706,17 +935,32 @@ public:
   std::vector<Sample> pixel_samples;
 
   TraceContext context;
+  ShadingContext shading_context;
   Rectangle tile_region;
 
   TileReport tile_report;
 
   const Tiler *tiler;
+  TileQueue *tile_queue;
+  // wall time to give up the current pass. 0 means no limit
+  double deadline;
+
+  // with several passes, each pass traces the samples of the pixel strata
+  // ranked in pass_strata and adds them to the sums of the frame
+  int stratum_stride;
+  Int2 pass_strata;
+  Color4 *pixel_sums;
+  float *weight_sums;
 };
 //class Worker;
+static void init_trace_context(const Renderer *renderer, TraceContext *cxt);
 static void init_worker(Worker *worker, int id,
     const Renderer *renderer, const Tiler *tiler);
+static void generate_sample_passes(const Renderer *renderer,
+    std::vector<Int2> *pass_list);
+static int get_stratum_stride(int strata_count);
 static int render_frame_start(Renderer *renderer, const Tiler *tiler);
-static LoopStatus render_tile(void *data, const ThreadContext &context);
+static LoopStatus render_tiles(void *data, const ThreadContext &context);
 static void render_frame_done(Renderer *renderer, const Tiler *tiler);
 
 int Renderer::prepare_rendering()
@@ -760,7 +1004,6 @@ int Renderer::execute_rendering()
   Tiler tiler;
   tiler.Divide(xres, yres, xtilesize, ytilesize);
   tiler.GenerateTiles(frame_region_);
-  const int tile_count = tiler.GetTileCount();
 
   // Worker
   std::vector<Worker> worker_list(thread_count);
@@ -768,8 +1011,24 @@ int Renderer::execute_rendering()
     init_worker(&worker_list[i], i, this, &tiler);
   }
 
+  // Passes. without a time budget, a single pass with all strata
+  std::vector<Int2> pass_list;
+  generate_sample_passes(this, &pass_list);
+  const int pass_count = static_cast<int>(pass_list.size());
+  const int strata_count = pixelsamples_[0] * pixelsamples_[1];
+
+  // filtered samples of finished passes
+  std::vector<Color4> pixel_sums;
+  std::vector<float> weight_sums;
+  if (pass_count > 1) {
+    pixel_sums.resize(xres * yres);
+    weight_sums.resize(xres * yres, 0.f);
+  }
+
   // FrameProgress
-  init_frame_progress(&frame_progress_, tile_count);
+  const Int2 frame_size = frame_region_.Size();
+  init_frame_progress(&frame_progress_,
+      static_cast<Iteration>(frame_size[0]) * frame_size[1] * pass_count);
 
   // Run sampling
   const int err = render_frame_start(this, &tiler);
@@ -777,13 +1036,42 @@ int Renderer::execute_rendering()
     return -1;
   }
 
-  // Iteration number que for parallel loop
-  std::vector<int> iteration_que(tile_count);
-  for (int i = 0; i <tile_count; i++) {
-    iteration_que[i] = i;
+  // Tiles in rendering order. each thread takes tiles from the que
+  std::vector<int> iteration_que;
+  tiler.GenerateTileOrder(tile_order_, priority_region_, &iteration_que);
+
+  // each pass adds its samples to the tiles it finishes. tiles a pass
+  // gives up at the deadline keep the samples of the passes before
+  const double deadline = render_start_time_ + time_budget_;
+  const int stratum_stride = get_stratum_stride(strata_count);
+  int pass = 0;
+
+  for (pass = 0; pass < pass_count; pass++) {
+    TileQueue tile_queue(tiler, iteration_que, thread_count);
+    for (std::size_t i = 0; i < worker_list.size(); i++) {
+      Worker &worker = worker_list[i];
+      worker.tile_queue = &tile_queue;
+      worker.deadline = (time_budget_ > 0 && pass > 0) ? deadline : 0;
+      worker.stratum_stride = stratum_stride;
+      worker.pass_strata = pass_list[pass];
+      worker.pixel_sums = pass_count > 1 ? &pixel_sums[0] : NULL;
+      worker.weight_sums = pass_count > 1 ? &weight_sums[0] : NULL;
+    }
+
+    const LoopStatus status = MtRunParallelFor(&worker_list[0], render_tiles,
+        thread_count, 0, thread_count);
+    if (status == LoopStatus::Cancel) {
+      break;
+    }
   }
 
-  MtRunParallelLoop(&worker_list[0], render_tile, thread_count, iteration_que);
+  if (pass > 0 && pass < pass_count && get_wall_time() >= deadline) {
+    printf("# Time Budget Reached\n");
+    printf("#   Finished Passes: %d / %d\n", pass, pass_count);
+    printf("#   Pixel Samples:   %d / %d\n\n",
+        pass_list[pass - 1][1], strata_count);
+    MtCriticalSection(&frame_progress_, finish_frame_progress);
+  }
 
   render_frame_done(this, &tiler);
 
@@ -824,14 +1112,22 @@ int Renderer::preprocess_lights()
   Timer timer;
   timer.Start();
 
+  TraceContext cxt;
+  init_trace_context(this, &cxt);
+
+  int volume_shadow_count = 0;
   for (int i = 0; i < NLIGHTS; i++) {
     Light *light = target_lights_[i];
-    const int err = light->Preprocess();
+    const int err = light->Preprocess(cxt, GetThreadCount());
 
     if (err) {
       /* TODO error handling */
       return -1;
     }
+    volume_shadow_count += light->GetVolumeShadowCount();
+  }
+  if (volume_shadow_count > 0) {
+    printf("#   Volume Shadow Count: %d\n", volume_shadow_count);
   }
 
   const Elapse elapse = timer.GetElapse();
@@ -841,6 +1137,23 @@ int Renderer::preprocess_lights()
   return 0;
 }
 
+static void init_trace_context(const Renderer *renderer, TraceContext *cxt)
+{
+  *cxt = SlCameraContext(renderer->target_objects_);
+  cxt->cast_shadow = renderer->cast_shadow_;
+  cxt->max_diffuse_depth = renderer->max_diffuse_depth_;
+  cxt->max_reflect_depth = renderer->max_reflect_depth_;
+  cxt->max_refract_depth = renderer->max_refract_depth_;
+  cxt->raymarch_step = renderer->raymarch_step_;
+  cxt->raymarch_shadow_step = renderer->raymarch_shadow_step_;
+  cxt->raymarch_diffuse_step = renderer->raymarch_diffuse_step_;
+  cxt->raymarch_reflect_step = renderer->raymarch_reflect_step_;
+  cxt->raymarch_refract_step = renderer->raymarch_refract_step_;
+  cxt->volume_integrator = renderer->volume_integrator_;
+  cxt->raymarch_quality = renderer->raymarch_quality_;
+  cxt->raymarch_lod = renderer->raymarch_lod_;
+}
+
 static void init_worker(Worker *worker, int id,
     const Renderer *renderer, const Tiler *tiler)
 {
@@ -899,16 +1212,8 @@ static void init_worker(Worker *worker, int id,
   worker->filter.SetFilterType(FLT_GAUSSIAN, xfwidth, yfwidth);
 
   /* context */
-  worker->context = SlCameraContext(renderer->target_objects_);
-  worker->context.cast_shadow = renderer->cast_shadow_;
-  worker->context.max_diffuse_depth = renderer->max_diffuse_depth_;
-  worker->context.max_reflect_depth = renderer->max_reflect_depth_;
-  worker->context.max_refract_depth = renderer->max_refract_depth_;
-  worker->context.raymarch_step = renderer->raymarch_step_;
-  worker->context.raymarch_shadow_step = renderer->raymarch_shadow_step_;
-  worker->context.raymarch_diffuse_step = renderer->raymarch_diffuse_step_;
-  worker->context.raymarch_reflect_step = renderer->raymarch_reflect_step_;
-  worker->context.raymarch_refract_step = renderer->raymarch_refract_step_;
+  init_trace_context(renderer, &worker->context);
+  worker->context.shading_context = &worker->shading_context;
 
   /* region */
   worker->tile_region.min[0] = 0;
@@ -920,23 +1225,91 @@ static void init_worker(Worker *worker, int id,
   worker->tile_report = renderer->tile_report_;
 }
 
-static void set_working_region(Worker *worker, int region_id)
+// range of stratum ranks each pass traces. samples per pixel double
+// every pass until all strata of the pixel samples are traced. the
+// adaptive sampler subdivides from traced neighbors, so it takes one pass
+static void generate_sample_passes(const Renderer *renderer,
+    std::vector<Int2> *pass_list)
+{
+  const int strata_count = renderer->pixelsamples_[0] * renderer->pixelsamples_[1];
+  const bool progressive = renderer->time_budget_ > 0 &&
+      renderer->sampler_type_ == RENDERER_FIXED_GRID_SAMPLER;
+
+  pass_list->clear();
+  if (!progressive) {
+    pass_list->push_back(Int2(0, strata_count));
+    return;
+  }
+
+  int begin = 0;
+  int end = 1;
+  while (begin < strata_count) {
+    pass_list->push_back(Int2(begin, end));
+    begin = end;
+    end = Min(2 * end, strata_count);
+  }
+}
+
+static int greatest_common_divisor(int a, int b)
+{
+  while (b != 0) {
+    const int r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// strata are ranked by stride * stratum mod count. a stride coprime to
+// count near its golden ratio spreads early passes over the pixel
+static int get_stratum_stride(int strata_count)
+{
+  int stride = static_cast<int>(Ceil(.618 * strata_count));
+  while (greatest_common_divisor(stride, strata_count) != 1) {
+    stride++;
+  }
+  return stride;
+}
+
+static bool is_in_pass(const Worker *worker, const Sample &sample)
+{
+  const Int2 rate = worker->sampler->GetPixelSamples();
+  const int strata_count = rate[0] * rate[1];
+  if (worker->pass_strata[0] == 0 && worker->pass_strata[1] == strata_count) {
+    return true;
+  }
+
+  // sample grid position. margin samples are outside the frame
+  const int gx = static_cast<int>(floor(sample.uv.x * worker->xres * rate[0]));
+  const int gy = static_cast<int>(floor((1 - sample.uv.y) * worker->yres * rate[1]));
+  const int sx = ((gx % rate[0]) + rate[0]) % rate[0];
+  const int sy = ((gy % rate[1]) + rate[1]) % rate[1];
+  const int rank = (worker->stratum_stride * (sy * rate[0] + sx)) % strata_count;
+
+  return rank >= worker->pass_strata[0] && rank < worker->pass_strata[1];
+}
+
+static bool is_past_deadline(const Worker *worker)
 {
-  const Tile *tile = worker->tiler->GetTile(region_id);
+  return worker->deadline > 0 && get_wall_time() >= worker->deadline;
+}
 
-  worker->region_id = region_id;
+static void set_working_region(Worker *worker, const Tile &tile)
+{
+  worker->region_id = tile.id;
   worker->region_count = worker->tiler->GetTileCount();
-  worker->tile_region.min[0] = tile->xmin;
-  worker->tile_region.min[1] = tile->ymin;
-  worker->tile_region.max[0] = tile->xmax;
-  worker->tile_region.max[1] = tile->ymax;
+  worker->tile_region.min[0] = tile.xmin;
+  worker->tile_region.min[1] = tile.ymin;
+  worker->tile_region.max[0] = tile.xmax;
+  worker->tile_region.max[1] = tile.ymax;
 
   if (worker->sampler->GenerateSamples(worker->tile_region)) {
     /* TODO error handling */
   }
 }
 
-static Color4 apply_pixel_filter(Worker *worker, int x, int y)
+// weighted sum of the samples of the current pass around the pixel
+static Color4 sum_pixel_samples(Worker *worker, int x, int y, float *wgt_sum)
 {
   const int nsamples = worker->pixel_samples.size();
   const int xres = worker->xres;
@@ -944,15 +1317,19 @@ static Color4 apply_pixel_filter(Worker *worker, int x, int y)
   const Filter &filter = worker->filter;
 
   Color4 pixel;
-  float wgt_sum = 0.f;
-  float inv_sum = 0.f;
   int i;
 
+  *wgt_sum = 0.f;
+
   for (i = 0; i < nsamples; i++) {
     const Sample &sample = worker->pixel_samples[i];
     double filtx = 0, filty = 0;
     double wgt = 0;
 
+    if (!is_in_pass(worker, sample)) {
+      continue;
+    }
+
     filtx = xres * sample.uv.x - (x + .5);
     filty = yres * (1-sample.uv.y) - (y + .5);
     wgt = filter.Evaluate(filtx, filty);
@@ -961,10 +1338,18 @@ static Color4 apply_pixel_filter(Worker *worker, int x, int y)
     pixel.g += wgt * sample.data[1];
     pixel.b += wgt * sample.data[2];
     pixel.a += wgt * sample.data[3];
-    wgt_sum += wgt;
+    *wgt_sum += wgt;
   }
 
-  inv_sum = 1.f / wgt_sum;
+  return pixel;
+}
+
+static Color4 apply_pixel_filter(Worker *worker, int x, int y)
+{
+  float wgt_sum = 0.f;
+  Color4 pixel = sum_pixel_samples(worker, x, y, &wgt_sum);
+
+  const float inv_sum = 1.f / wgt_sum;
   pixel.r *= inv_sum;
   pixel.g *= inv_sum;
   pixel.b *= inv_sum;
@@ -987,7 +1372,25 @@ static void reconstruct_image(Worker *worker)
       Color4 pixel;
 
       worker->sampler->GetSampleSetInPixel(worker->pixel_samples, x, y);
-      pixel = apply_pixel_filter(worker, x, y);
+
+      if (worker->pixel_sums == NULL) {
+        pixel = apply_pixel_filter(worker, x, y);
+      } else {
+        // blend into the samples of the passes before
+        const int index = y * worker->xres + x;
+        float wgt_sum = 0.f;
+        worker->pixel_sums[index] += sum_pixel_samples(worker, x, y, &wgt_sum);
+        worker->weight_sums[index] += wgt_sum;
+
+        if (worker->weight_sums[index] > 0) {
+          pixel = worker->pixel_sums[index];
+          const float inv_sum = 1.f / worker->weight_sums[index];
+          pixel.r *= inv_sum;
+          pixel.g *= inv_sum;
+          pixel.b *= inv_sum;
+          pixel.a *= inv_sum;
+        }
+      }
 
       fb->SetColor(x, y, pixel);
     }
@@ -1058,6 +1461,7 @@ static void render_tile_done(Worker *worker)
   CbReportTileDone(&worker->tile_report, &info);
 }
 
+// returns -1 if interrupted by the callback, 1 if past the deadline
 static int integrate_samples(Worker *worker)
 {
   Sample *smp = NULL;
@@ -1070,6 +1474,11 @@ static int integrate_samples(Worker *worker)
     int hit = 0;
     int interrupted = 0;
 
+    // traced by another pass
+    if (!is_in_pass(worker, *smp)) {
+      continue;
+    }
+
     worker->camera->GetRay(smp->uv, smp->time, &ray);
     cxt.time = smp->time;
 
@@ -1091,17 +1500,23 @@ static int integrate_samples(Worker *worker)
       printf("integrate_samples CANCELED!\n");
       return -1;
     }
+
+    if (is_past_deadline(worker)) {
+      return 1;
+    }
   }
   return 0;
 }
 
-static LoopStatus render_tile(void *data, const ThreadContext &context)
+static LoopStatus render_tile(Worker *worker, const Tile &tile)
 {
-  Worker *worker_list = (Worker *) data;
-  Worker *worker = &worker_list[context.thread_id];
   int interrupted = 0;
 
-  set_working_region(worker, context.iteration_id);
+  if (is_past_deadline(worker)) {
+    return LoopStatus::Cancel;
+  }
+
+  set_working_region(worker, tile);
 
   interrupted = render_tile_start(worker);
   if (interrupted) {
@@ -1109,7 +1524,10 @@ static LoopStatus render_tile(void *data, const ThreadContext &context)
   }
 
   interrupted = integrate_samples(worker);
-  reconstruct_image(worker);
+  // an unfinished pass leaves the tile as the previous pass did
+  if (interrupted != 1) {
+    reconstruct_image(worker);
+  }
 
   render_tile_done(worker);
 
@@ -1120,4 +1538,24 @@ static LoopStatus render_tile(void *data, const ThreadContext &context)
   return LoopStatus::Continue;
 }
 
+// one iteration per thread. each takes tiles until the que is empty
+static LoopStatus render_tiles(void *data, const ThreadContext &context)
+{
+  Worker *worker_list = (Worker *) data;
+  Worker *worker = &worker_list[context.iteration_id];
+  Tile tile;
+
+  while (worker->tile_queue->Checkout(&tile)) {
+    const LoopStatus status = render_tile(worker, tile);
+    worker->tile_queue->Finish();
+
+    if (status == LoopStatus::Cancel) {
+      worker->tile_queue->Cancel();
+      return LoopStatus::Cancel;
+    }
+  }
+
+  return LoopStatus::Continue;
+}
+
 } // namespace xxx
@@ -49,6 +49,9 @@ public:
   void SetResolution(int xres, int yres);
   void SetRenderRegion(int xmin, int ymin, int xmax, int ymax);
   void SetTileSize(int xtilesize, int ytilesize);
+  void SetTileOrder(int tile_order);
+  // tiles overlapping this region are rendered first
+  void SetPriorityRegion(int xmin, int ymin, int xmax, int ymax);
   void SetFilterWidth(float xfwidth, float yfwidth);
 
   void SetSamplerType(int sampler_type);
@@ -68,6 +71,13 @@ public:
   void SetRaymarchDiffuseStep(double step);
   void SetRaymarchReflectStep(double step);
   void SetRaymarchRefractStep(double step);
+  void SetVolumeIntegrator(int integrator);
+  // steps of raymarch follow voxel size and density if quality > 0.
+  // higher quality gives shorter steps. 0 uses raymarch step sizes
+  void SetRaymarchQuality(double quality);
+  // secondary rays sample coarser volume mip levels as they go further.
+  // larger values pick coarser levels. 0 always uses full resolution
+  void SetRaymarchLod(double lod);
 
   void SetCamera(Camera *cam);
   void SetFrameBuffers(FrameBuffer *fb);
@@ -77,8 +87,15 @@ public:
   // use max thread if use_max_thread is 1, otherwise takes account for thread_count
   void SetUseMaxThread(int use_max_thread);
   void SetThreadCount(int thread_count);
+  void SetPinThreads(int pin_threads);
   int GetThreadCount() const;
 
+  // wall-clock seconds for RenderScene. renders a quick pass over all
+  // pixels first, then adds samples until pixel samples are reached or
+  // time runs out. the first pass always completes. the adaptive sampler
+  // renders a single pass. 0 renders without limit
+  void SetTimeBudget(double seconds);
+
   void SetFrameReportCallback(void *data,
       FrameStartCallback frame_start,
       FrameAbortCallback frame_abort,
@@ -108,6 +125,8 @@ public:
   int resolution_[2];
   Rectangle frame_region_;
   int tilesize_[2];
+  int tile_order_;
+  Rectangle priority_region_;
   float filterwidth_[2];
 
   int sampler_type_;
@@ -128,9 +147,16 @@ public:
   double raymarch_diffuse_step_;
   double raymarch_reflect_step_;
   double raymarch_refract_step_;
+  int volume_integrator_;
+  double raymarch_quality_;
+  double raymarch_lod_;
 
   int use_max_thread_;
   int thread_count_;
+  int pin_threads_;
+
+  double time_budget_;
+  double render_start_time_;
 
   FrameReport frame_report_;
   TileReport tile_report_;
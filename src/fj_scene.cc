@@ -2,6 +2,8 @@
 // See LICENSE and README
 
 #include "fj_scene.h"
+#include "fj_point_cloud_accelerator.h"
+#include "fj_curve_accelerator.h"
 #include "fj_grid_accelerator.h"
 #include "fj_bvh_accelerator.h"
 
@@ -75,6 +77,20 @@ Accelerator *Scene::NewBVHAccelerator()
   return push_entry_(AcceleratorList, acc);
 }
 
+CurveAccelerator *Scene::NewCurveAccelerator()
+{
+  CurveAccelerator *acc = new CurveAccelerator();
+  push_entry_<Accelerator>(AcceleratorList, acc);
+  return acc;
+}
+
+PointCloudAccelerator *Scene::NewPointCloudAccelerator()
+{
+  PointCloudAccelerator *acc = new PointCloudAccelerator();
+  push_entry_<Accelerator>(AcceleratorList, acc);
+  return acc;
+}
+
 // FrameBuffer
 FrameBuffer *Scene::NewFrameBuffer()
 {
@@ -194,6 +210,13 @@ Mesh *Scene::NewMesh()
   return push_entry_(MeshList, mesh);
 }
 
+// TessellatedMesh
+TessellatedMesh *Scene::NewTessellatedMesh()
+{
+  TessellatedMesh *mesh = new TessellatedMesh();
+  return push_entry_(TessellatedMeshList, mesh);
+}
+
 DEFINE_LIST_FUNCTIONS(ObjectInstance)
 DEFINE_LIST_FUNCTIONS(Accelerator)
 DEFINE_LIST_FUNCTIONS(FrameBuffer)
@@ -210,6 +233,7 @@ DEFINE_LIST_FUNCTIONS(Volume)
 DEFINE_LIST_FUNCTIONS(Curve)
 DEFINE_LIST_FUNCTIONS(Light)
 DEFINE_LIST_FUNCTIONS(Mesh)
+DEFINE_LIST_FUNCTIONS(TessellatedMesh)
 
 void Scene::free_all_node_list()
 {
@@ -228,6 +252,7 @@ void Scene::free_all_node_list()
   delete_entries(CurveList);
   delete_entries(LightList);
   delete_entries(MeshList);
+  delete_entries(TessellatedMeshList);
 
   // plugins should be freed the last since they contain freeing functions for others
   delete_entries(PluginList);
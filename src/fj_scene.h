@@ -6,6 +6,8 @@
 
 #include "fj_object_instance.h"
 #include "fj_object_group.h"
+#include "fj_point_cloud_accelerator.h"
+#include "fj_curve_accelerator.h"
 #include "fj_accelerator.h"
 #include "fj_framebuffer.h"
 #include "fj_point_cloud.h"
@@ -16,6 +18,7 @@
 #include "fj_camera.h"
 #include "fj_plugin.h"
 #include "fj_shader.h"
+#include "fj_tessellated_mesh.h"
 #include "fj_volume.h"
 #include "fj_curve.h"
 #include "fj_light.h"
@@ -38,6 +41,8 @@ public:
   // Accelerator
   Accelerator *NewGridAccelerator();
   Accelerator *NewBVHAccelerator();
+  CurveAccelerator *NewCurveAccelerator();
+  PointCloudAccelerator *NewPointCloudAccelerator();
   Accelerator **GetAcceleratorList() const;
   Accelerator *GetAccelerator(int index) const;
   size_t GetAcceleratorCount() const;
@@ -129,6 +134,12 @@ public:
   Mesh *GetMesh(int index) const;
   size_t GetMeshCount() const;
 
+  // TessellatedMesh
+  TessellatedMesh *NewTessellatedMesh();
+  TessellatedMesh **GetTessellatedMeshList() const;
+  TessellatedMesh *GetTessellatedMesh(int index) const;
+  size_t GetTessellatedMeshCount() const;
+
 private:
   void free_all_node_list();
 
@@ -148,6 +159,7 @@ private:
   std::vector<Curve *> CurveList;
   std::vector<Light *> LightList;
   std::vector<Mesh *> MeshList;
+  std::vector<TessellatedMesh *> TessellatedMeshList;
 };
 
 } // namespace xxx
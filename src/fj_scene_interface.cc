@@ -4,6 +4,7 @@
 #include "fj_scene_interface.h"
 #include "fj_volume_accelerator.h"
 #include "fj_framebuffer_io.h"
+#include "fj_volume_io.h"
 #include "fj_primitive_set.h"
 #include "fj_multi_thread.h"
 #include "fj_shader.h"
@@ -37,7 +38,8 @@
   T_(Volume) \
   T_(Curve) \
   T_(Light) \
-  T_(Mesh)
+  T_(Mesh) \
+  T_(TessellatedMesh)
 
 namespace fj {
 
@@ -61,6 +63,7 @@ enum EntryType {
   Type_Curve,
   Type_Light,
   Type_Mesh,
+  Type_TessellatedMesh,
   Type_End
 };
 
@@ -327,6 +330,63 @@ Status SiRunProcedure(ID procedure)
   return SI_SUCCESS;
 }
 
+Status SiSaveVolume(ID volume, const char *filename)
+{
+  const Entry entry = decode_id(volume);
+  Volume *volume_ptr = NULL;
+  int err = 0;
+
+  if (entry.type != Type_Volume) {
+    /* TODO error handling */
+    return SI_FAIL;
+  }
+
+  volume_ptr = get_scene()->GetVolume(entry.index);
+  if (volume_ptr == NULL) {
+    /* TODO error handling */
+    return SI_FAIL;
+  }
+
+  // writes bricks in the voxel format of the volume
+  volume_ptr->Compact();
+
+  err = WriteVolume(filename, *volume_ptr);
+  if (err) {
+    /* TODO error handling */
+    return SI_FAIL;
+  }
+
+  set_errno(SI_ERR_NONE);
+  return SI_SUCCESS;
+}
+
+Status SiLoadVolume(ID volume, const char *filename)
+{
+  const Entry entry = decode_id(volume);
+  Volume *volume_ptr = NULL;
+  int err = 0;
+
+  if (entry.type != Type_Volume) {
+    /* TODO error handling */
+    return SI_FAIL;
+  }
+
+  volume_ptr = get_scene()->GetVolume(entry.index);
+  if (volume_ptr == NULL) {
+    /* TODO error handling */
+    return SI_FAIL;
+  }
+
+  err = ReadVolume(filename, *volume_ptr);
+  if (err) {
+    fprintf(stderr, "error: %s: %s\n", filename, VolGetErrorMessage(VolGetErrorNo()));
+    return SI_FAIL;
+  }
+
+  set_errno(SI_ERR_NONE);
+  return SI_SUCCESS;
+}
+
 Status SiAddObjectToGroup(ID group, ID object)
 {
   ObjectGroup *group_ptr = NULL;
@@ -448,7 +508,7 @@ ID SiNewObjectGroup(void)
 ID SiNewPointCloud(void)
 {
   PointCloud *ptc = NULL;
-  Accelerator *acc = NULL;
+  PointCloudAccelerator *acc = NULL;
 
   ID ptc_id = SI_BADID;
   ID accel_id = SI_BADID;
@@ -459,13 +519,13 @@ ID SiNewPointCloud(void)
     return SI_BADID;
   }
 
-  acc = get_scene()->NewGridAccelerator();
+  acc = get_scene()->NewPointCloudAccelerator();
   if (acc == NULL) {
     set_errno(SI_ERR_NO_MEMORY);
     return SI_BADID;
   }
 
-  acc->SetPrimitiveSet(ptc);
+  acc->SetPointCloud(ptc);
 
   ptc_id = encode_id(Type_PointCloud, GET_LAST_ADDED_ID(PointCloud));
   accel_id = encode_id(Type_Accelerator, GET_LAST_ADDED_ID(Accelerator));
@@ -604,7 +664,7 @@ ID SiNewVolume(void)
 ID SiNewCurve(void)
 {
   Curve *curve = NULL;
-  Accelerator *acc = NULL;
+  CurveAccelerator *acc = NULL;
 
   ID curve_id = SI_BADID;
   ID accel_id = SI_BADID;
@@ -615,18 +675,20 @@ ID SiNewCurve(void)
     return SI_BADID;
   }
 
-  acc = get_scene()->NewGridAccelerator();
+  acc = get_scene()->NewCurveAccelerator();
   if (acc == NULL) {
     set_errno(SI_ERR_NO_MEMORY);
     return SI_BADID;
   }
 
-  acc->SetPrimitiveSet(curve);
+  acc->SetCurve(curve);
 
   curve_id = encode_id(Type_Curve, GET_LAST_ADDED_ID(Curve));
   accel_id = encode_id(Type_Accelerator, GET_LAST_ADDED_ID(Accelerator));
   bind_primset_to_accelerator(curve_id, accel_id);
 
+  PropSetAllDefaultValues(curve, get_builtin_type_property_list(Type_Curve));
+
   set_errno(SI_ERR_NONE);
   return curve_id;
 }
@@ -695,6 +757,39 @@ ID SiNewMesh(void)
   return mesh_id;
 }
 
+ID SiNewTessellatedMesh(void)
+{
+  TessellatedMesh *mesh = NULL;
+  Accelerator *acc = NULL;
+
+  ID mesh_id = SI_BADID;
+  ID accel_id = SI_BADID;
+
+  mesh = get_scene()->NewTessellatedMesh();
+  if (mesh == NULL) {
+    set_errno(SI_ERR_NO_MEMORY);
+    return SI_BADID;
+  }
+
+  // patch bounds are known without tessellation. BVH only needs bounds
+  acc = get_scene()->NewBVHAccelerator();
+  if (acc == NULL) {
+    set_errno(SI_ERR_NO_MEMORY);
+    return SI_BADID;
+  }
+
+  acc->SetPrimitiveSet(mesh);
+
+  mesh_id = encode_id(Type_TessellatedMesh, GET_LAST_ADDED_ID(TessellatedMesh));
+  accel_id = encode_id(Type_Accelerator, GET_LAST_ADDED_ID(Accelerator));
+  bind_primset_to_accelerator(mesh_id, accel_id);
+
+  PropSetAllDefaultValues(mesh, get_builtin_type_property_list(Type_TessellatedMesh));
+
+  set_errno(SI_ERR_NONE);
+  return mesh_id;
+}
+
 Status SiAssignShader(ID object, const char *shading_group, ID shader)
 {
   ObjectInstance *object_ptr = NULL;
@@ -1164,10 +1259,12 @@ static void build_accelerators(void)
   Elapse elapse;
   int NOBJTECTS = 0;
   int NGROUPS = 0;
+  int NVOLUMES = 0;
   int i;
 
   NOBJTECTS = get_scene()->GetAcceleratorCount();
   NGROUPS = get_scene()->GetObjectGroupCount();
+  NVOLUMES = get_scene()->GetVolumeCount();
 
   printf("# Building Accelerators\n");
   printf("#   Accelerator Count: %d\n", NOBJTECTS + NGROUPS);
@@ -1196,6 +1293,14 @@ static void build_accelerators(void)
     }
   }
 
+  // compact voxels, macro grids for empty space skipping and mipmaps
+  for (i = 0; i < NVOLUMES; i++) {
+    Volume *volume = get_scene()->GetVolume(i);
+    volume->Compact();
+    volume->ComputeMacroGrid();
+    volume->BuildMipmaps();
+  }
+
   elapse = timer.GetElapse();
   printf("# Building Accelerators Done\n");
   printf("#   %dh %dm %ds\n\n", elapse.hour, elapse.min, elapse.sec);
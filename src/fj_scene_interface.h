@@ -72,6 +72,8 @@ FJ_API Status SiCloseScene(void);
 FJ_API Status SiRenderScene(ID renderer);
 FJ_API Status SiSaveFrameBuffer(ID framebuffer, const char *filename);
 FJ_API Status SiRunProcedure(ID procedure);
+FJ_API Status SiSaveVolume(ID volume, const char *filename);
+FJ_API Status SiLoadVolume(ID volume, const char *filename);
 
 FJ_API Status SiAddObjectToGroup(ID group, ID object);
 
@@ -89,6 +91,7 @@ FJ_API ID SiNewVolume(void);
 FJ_API ID SiNewCurve(void);
 FJ_API ID SiNewLight(int light_type);
 FJ_API ID SiNewMesh(void);
+FJ_API ID SiNewTessellatedMesh(void);
 
 FJ_API Status SiAssignFrameBuffer(ID renderer, ID framebuffer);
 FJ_API Status SiAssignObjectGroup(ID id, const char *name, ID group);
@@ -5,6 +5,7 @@
 #define FJ_SHADER_H
 
 #include "fj_compatibility.h"
+#include "fj_shading_context.h"
 #include "fj_numeric.h"
 #include "fj_shading.h"
 #include "fj_texture.h"
@@ -3,6 +3,7 @@
 
 #include "fj_shading.h"
 #include "fj_volume_accelerator.h"
+#include "fj_shading_context.h"
 #include "fj_object_instance.h"
 #include "fj_intersection.h"
 #include "fj_object_group.h"
@@ -12,17 +13,34 @@
 #include "fj_texture.h"
 #include "fj_shader.h"
 #include "fj_volume.h"
+#include "fj_random.h"
 #include "fj_light.h"
 #include "fj_ray.h"
 
 #include <cassert>
+#include <cstring>
 #include <cstdio>
 #include <cfloat>
 #include <cmath>
+#include <vector>
+#include <algorithm>
 
 namespace fj {
 
 static const Color NO_SHADER_COLOR(.5, 1., 0.);
+// max number of raymarch samples fetched from volumes in one call
+static const int RAYMARCH_BATCH_SIZE = 32;
+// adaptive raymarch. samples per batch, limit of step growth over voxel
+// size, and opacities per step that decide shorter or longer steps
+static const int ADAPTIVE_BATCH_SIZE = 8;
+static const double ADAPTIVE_MAX_STEP_SCALE = 8;
+static const double ADAPTIVE_EDGE_OPACITY = .02;
+static const double ADAPTIVE_FLAT_OPACITY = .002;
+// rough cone angles of secondary rays for volume mip level selection
+static const double LOD_SHADOW_SPREAD = .05;
+static const double LOD_DIFFUSE_SPREAD = .2;
+static const double LOD_SPECULAR_SPREAD = .02;
+static const int LOD_MAX_LEVEL = 7;
 
 static int has_reached_bounce_limit(const TraceContext *cxt);
 static int shadow_ray_has_reached_opcity_limit(const TraceContext *cxt, float opac);
@@ -38,6 +56,9 @@ static int trace_surface(const TraceContext *cxt, const Ray &ray,
     Color4 *out_rgba, double *t_hit);
 static int raymarch_volume(const TraceContext *cxt, const Ray *ray,
     Color4 *out_rgba);
+static uint32_t ray_seed(const Ray &ray, double time);
+static int track_volume(const TraceContext *cxt, const Ray *ray,
+    const IntervalList &intervals, Color4 *out_rgba);
 
 void SlFaceforward(const Vector *I, const Vector *N, Vector *Nf)
 {
@@ -214,6 +235,7 @@ TraceContext SlCameraContext(const ObjectGroup *target)
   cxt.max_refract_depth = 5;
   cxt.cast_shadow = 1;
   cxt.trace_target = target;
+  cxt.shading_context = NULL;
 
   cxt.time = 0;
 
@@ -223,6 +245,9 @@ TraceContext SlCameraContext(const ObjectGroup *target)
   cxt.raymarch_diffuse_step = .05;
   cxt.raymarch_reflect_step = .05;
   cxt.raymarch_refract_step = .05;
+  cxt.raymarch_quality = 0;
+  cxt.raymarch_lod = 0;
+  cxt.volume_integrator = VOLUME_RAYMARCH;
 
   return cxt;
 }
@@ -335,7 +360,15 @@ int SlIlluminance(const TraceContext *cxt, const LightSample *sample,
     return 0;
   }
 
-  if (cxt->cast_shadow) {
+  float transmittance = 1;
+  if (cxt->cast_shadow && sample->light->LookupVolumeShadow(
+        in->shaded_object, *Ps, &transmittance)) {
+    // baked in Light::Preprocess
+    light_color.r *= transmittance;
+    light_color.g *= transmittance;
+    light_color.b *= transmittance;
+  }
+  else if (cxt->cast_shadow) {
     TraceContext shad_cxt;
     Color4 C_occl;
     double t_hit = FLT_MAX;
@@ -377,7 +410,8 @@ int SlGetLightSampleCount(const SurfaceInput *in)
   return nsamples;
 }
 
-LightSample *SlNewLightSamples(const SurfaceInput *in)
+LightSample *SlNewLightSamples(const TraceContext *cxt,
+    const SurfaceInput *in)
 {
   const Light **lights = in->shaded_object->GetLightList();
   const int nlights = SlGetLightCount(in);
@@ -392,22 +426,31 @@ LightSample *SlNewLightSamples(const SurfaceInput *in)
     return NULL;
   }
 
-  samples = new LightSample[nsamples];
+  ScratchAllocator &scratch = SlGetShadingContext(cxt)->GetScratch();
+  samples = scratch.AllocateArray<LightSample>(nsamples);
   sample = samples;
   for (i = 0; i < nlights; i++) {
     const int nsmp = lights[i]->GetSampleCount();
-    lights[i]->GetSamples(sample, nsmp);
+    lights[i]->GetSamples(*cxt, sample, nsmp);
     sample += nsmp;
   }
 
   return samples;
 }
 
-void SlFreeLightSamples(LightSample * samples)
+void SlFreeLightSamples(const TraceContext *cxt, LightSample *samples)
 {
   if (samples == NULL)
     return;
-  delete [] samples;
+  SlGetShadingContext(cxt)->GetScratch().Free(samples);
+}
+
+ShadingContext *SlGetShadingContext(const TraceContext *cxt)
+{
+  if (cxt->shading_context != NULL) {
+    return cxt->shading_context;
+  }
+  return GetThreadShadingContext();
 }
 
 #define MUL(a,val) do { \
@@ -571,6 +614,227 @@ static int trace_surface(const TraceContext *cxt, const Ray &ray,
   return hit;
 }
 
+// fetches densities of nsamples from P to P + (nsamples-1) * delta for every
+// volume candidate. densities of k-th candidate start at k * RAYMARCH_BATCH_SIZE
+static void fetch_densities(const TraceContext *cxt, const IntervalList &intervals,
+    const Vector &P, const Vector &delta, int nsamples, int level, float *densities)
+{
+  int k = 0;
+  for (const Interval *interval = intervals.GetHead();
+      interval != NULL; interval = interval->next, k++) {
+    float *dst = &densities[k * RAYMARCH_BATCH_SIZE];
+    if (!interval->object->GetVolumeSamples(P, delta, nsamples, level,
+        cxt->time, dst)) {
+      std::fill(dst, dst + nsamples, 0.f);
+    }
+  }
+}
+
+// shades one raymarch sample of the length t_delta and composites it over
+// out_rgba. densities points at the sample of the first candidate.
+// exponential opacity does not depend on how the segment is divided
+static void composite_sample(const TraceContext *cxt, const IntervalList &intervals,
+    const float *densities, const Vector &P, double t_delta, bool exponential,
+    Color4 *out_rgba)
+{
+  const Interval *interval = intervals.GetHead();
+  Color color;
+  float opacity = 0;
+
+  // loop over volume candidates at this sample point
+  for (int k = 0; interval != NULL; interval = interval->next, k++) {
+    const float density = densities[k * RAYMARCH_BATCH_SIZE];
+    const float sample_opacity = exponential ?
+        1 - exp(-t_delta * density) : t_delta * density;
+
+    // merge volume with max density
+    opacity = Max(opacity, sample_opacity);
+
+    if (cxt->ray_context != CXT_SHADOW_RAY && opacity > 0) {
+      SurfaceInput in;
+      SurfaceOutput out;
+
+      in.shaded_object = interval->object;
+      in.P = P;
+      in.N = Vector(0, 0, 0);
+
+      // TODO shading group
+      const Shader *shader = interval->object->GetShader(0);
+      if (shader != NULL) {
+        shader->Evaluate(*cxt, in, &out);
+      } else {
+        out.Cs = NO_SHADER_COLOR;
+        out.Os = 1;
+      }
+
+      color.r = out.Cs.r * opacity;
+      color.g = out.Cs.g * opacity;
+      color.b = out.Cs.b * opacity;
+    }
+  }
+
+  // composite color
+  out_rgba->r = out_rgba->r + color.r * (1-out_rgba->a);
+  out_rgba->g = out_rgba->g + color.g * (1-out_rgba->a);
+  out_rgba->b = out_rgba->b + color.b * (1-out_rgba->a);
+  out_rgba->a = out_rgba->a + Clamp(opacity, 0, 1) * (1-out_rgba->a);
+}
+
+// the finest voxel among candidates along this ray. 0 if none
+static double find_voxel_step(const TraceContext *cxt, const Ray *ray,
+    const IntervalList &intervals)
+{
+  double voxel_step = REAL_MAX;
+  for (const Interval *interval = intervals.GetHead();
+      interval != NULL; interval = interval->next) {
+    const double step = interval->object->GetVolumeVoxelStep(*ray, cxt->time);
+    if (step > 0) {
+      voxel_step = Min(voxel_step, step);
+    }
+  }
+  return voxel_step == REAL_MAX ? 0 : voxel_step;
+}
+
+// volume mip level at distance t of ray and distance where the next level
+// starts. like ray differentials the footprint grows from one voxel by the
+// cone angle of the ray type
+static int find_lod_level(const TraceContext *cxt, double voxel_step, double t,
+    double *t_next_level)
+{
+  *t_next_level = REAL_MAX;
+
+  if (cxt->raymarch_lod <= 0 || voxel_step <= 0) {
+    return 0;
+  }
+
+  double spread = 0;
+  switch (cxt->ray_context) {
+  case CXT_SHADOW_RAY:
+    spread = LOD_SHADOW_SPREAD;
+    break;
+  case CXT_DIFFUSE_RAY:
+    spread = LOD_DIFFUSE_SPREAD;
+    break;
+  case CXT_REFLECT_RAY:
+  case CXT_REFRACT_RAY:
+    spread = LOD_SPECULAR_SPREAD;
+    break;
+  default:
+    return 0;
+  }
+
+  // footprint in voxels
+  double footprint = cxt->raymarch_lod * (voxel_step + spread * Max(t, 0)) / voxel_step;
+  int level = 0;
+  while (footprint >= 2 && level < LOD_MAX_LEVEL) {
+    footprint *= .5;
+    level++;
+  }
+
+  if (level < LOD_MAX_LEVEL) {
+    const double next_footprint = 2 << level;
+    *t_next_level = (next_footprint / cxt->raymarch_lod - 1) * voxel_step / spread;
+  }
+  return level;
+}
+
+// raymarch with steps starting from voxel size divided by quality. steps are
+// doubled while opacity and its change per step stay low, and a batch is
+// marched again with halved steps when opacity changes sharply
+static void raymarch_adaptive(const TraceContext *cxt, const Ray *ray,
+    const IntervalList &intervals, const IntervalList &occupied, double t_limit,
+    float *densities, Color4 *out_rgba)
+{
+  const float opacity_threshold = cxt->opacity_threshold;
+
+  const double voxel_step = find_voxel_step(cxt, ray, intervals);
+  if (voxel_step == 0) {
+    return;
+  }
+
+  // secondary rays take twice as long steps like default step sizes
+  const double rate = cxt->ray_context == CXT_CAMERA_RAY ? 1 : 2;
+  const double min_step = rate * voxel_step / cxt->raymarch_quality;
+  const double max_step = min_step * ADAPTIVE_MAX_STEP_SCALE;
+
+  const Interval *occupied_interval = occupied.GetHead();
+  double t_delta = min_step;
+  double t = Max(occupied.GetMinT(), ray->tmin);
+  float prev_density = 0;
+
+  while (t <= t_limit && out_rgba->a < opacity_threshold) {
+    // skip empty space
+    while (occupied_interval != NULL && occupied_interval->tmax < t) {
+      occupied_interval = occupied_interval->next;
+    }
+    if (occupied_interval == NULL) {
+      break;
+    }
+    if (occupied_interval->tmin > t) {
+      t = occupied_interval->tmin;
+      prev_density = 0;
+    }
+
+    // steps no shorter than voxels of mip level
+    double t_next_level = 0;
+    const int level = find_lod_level(cxt, voxel_step, t, &t_next_level);
+    const double level_step = min_step * (1 << level);
+    t_delta = Max(t_delta, level_step);
+
+    const double t_end = Min(Min(occupied_interval->tmax, t_limit), t_next_level);
+    int nsamples = (int) ((t_end - t) / t_delta) + 1;
+    if (nsamples > ADAPTIVE_BATCH_SIZE) {
+      nsamples = ADAPTIVE_BATCH_SIZE;
+    }
+
+    // samples at middle of steps not to pick up density at ray origin
+    const Vector P0 = RayPointAt(*ray, t + .5 * t_delta);
+    const Vector delta(
+        t_delta * ray->dir.x,
+        t_delta * ray->dir.y,
+        t_delta * ray->dir.z);
+    fetch_densities(cxt, intervals, P0, delta, nsamples, level, densities);
+
+    // opacity and its change per step over max of candidates
+    const int ncandidates = intervals.GetCount();
+    float max_density = 0;
+    float max_change = 0;
+    float last_density = prev_density;
+    for (int i = 0; i < nsamples; i++) {
+      float density = 0;
+      for (int k = 0; k < ncandidates; k++) {
+        density = Max(density, densities[k * RAYMARCH_BATCH_SIZE + i]);
+      }
+      max_density = Max(max_density, density);
+      max_change = Max(max_change, Abs(density - last_density));
+      last_density = density;
+    }
+    const double max_opacity = t_delta * max_density;
+    const double max_opacity_change = t_delta * max_change;
+
+    if (max_opacity_change > ADAPTIVE_EDGE_OPACITY && t_delta > level_step) {
+      t_delta = Max(.5 * t_delta, level_step);
+      continue;
+    }
+
+    Vector P = P0;
+    for (int i = 0; i < nsamples && out_rgba->a < opacity_threshold; i++) {
+      composite_sample(cxt, intervals, &densities[i], P, t_delta, true, out_rgba);
+
+      P.x += delta.x;
+      P.y += delta.y;
+      P.z += delta.z;
+      t += t_delta;
+    }
+    prev_density = last_density;
+
+    if (max_opacity < ADAPTIVE_FLAT_OPACITY &&
+        max_opacity_change < ADAPTIVE_FLAT_OPACITY) {
+      t_delta = Min(2 * t_delta, max_step);
+    }
+  }
+}
+
 static int raymarch_volume(const TraceContext *cxt, const Ray *ray,
     Color4 *out_rgba)
 {
@@ -590,6 +854,10 @@ static int raymarch_volume(const TraceContext *cxt, const Ray *ray,
     return 0;
   }
 
+  if (cxt->volume_integrator == VOLUME_DELTA_TRACKING) {
+    return track_volume(cxt, ray, intervals, out_rgba);
+  }
+
   {
     Vector P;
     Vector ray_delta;
@@ -634,54 +902,76 @@ static int raymarch_volume(const TraceContext *cxt, const Ray *ray,
     ray_delta.z = t_delta * ray->dir.z;
     t = t_start;
 
-    // raymarch
-    while (t <= t_limit && out_rgba->a < opacity_threshold) {
-      const Interval *interval = intervals.GetHead();
-      Color color;
-      float opacity = 0;
-
-      // loop over volume candidates at this sample point
-      for (; interval != NULL; interval = interval->next) {
-        VolumeSample sample;
-        interval->object->GetVolumeSample(P, cxt->time, &sample);
-
-        // merge volume with max density
-        opacity = Max(opacity, t_delta * sample.density);
-
-        if (cxt->ray_context != CXT_SHADOW_RAY) {
-          SurfaceInput in;
-          SurfaceOutput out;
-
-          in.shaded_object = interval->object;
-          in.P = P;
-          in.N = Vector(0, 0, 0);
-
-          // TODO shading group
-          const Shader *shader = interval->object->GetShader(0);
-          if (shader != NULL) {
-            shader->Evaluate(*cxt, in, &out);
-          } else {
-            out.Cs = NO_SHADER_COLOR;
-            out.Os = 1;
-          }
-
-          color.r = out.Cs.r * opacity;
-          color.g = out.Cs.g * opacity;
-          color.b = out.Cs.b * opacity;
-        }
-      }
+    // parts of volumes where density can be non-zero
+    IntervalList occupied;
+    for (const Interval *interval = intervals.GetHead();
+        interval != NULL; interval = interval->next) {
+      interval->object->FindVolumeOccupiedIntervals(*ray, cxt->time, &occupied);
+    }
+    const Interval *occupied_interval = occupied.GetHead();
 
-      // composite color
-      out_rgba->r = out_rgba->r + color.r * (1-out_rgba->a);
-      out_rgba->g = out_rgba->g + color.g * (1-out_rgba->a);
-      out_rgba->b = out_rgba->b + color.b * (1-out_rgba->a);
-      out_rgba->a = out_rgba->a + Clamp(opacity, 0, 1) * (1-out_rgba->a);
+    // densities of a batch of samples for each volume candidate
+    int interval_count = 0;
+    for (const Interval *interval = intervals.GetHead();
+        interval != NULL; interval = interval->next) {
+      interval_count++;
+    }
+    std::vector<float> densities(interval_count * RAYMARCH_BATCH_SIZE);
 
-      // advance sample point
-      P.x += ray_delta.x;
-      P.y += ray_delta.y;
-      P.z += ray_delta.z;
-      t += t_delta;
+    // voxel size is needed only to pick mip levels of secondary rays
+    const double voxel_step =
+        cxt->raymarch_lod > 0 && cxt->ray_context != CXT_CAMERA_RAY ?
+        find_voxel_step(cxt, ray, intervals) : 0;
+
+    if (cxt->raymarch_quality > 0) {
+      raymarch_adaptive(cxt, ray, intervals, occupied, t_limit,
+          &densities[0], out_rgba);
+    }
+    else {
+      // raymarch
+      while (t <= t_limit && out_rgba->a < opacity_threshold) {
+        // skip empty space keeping samples on the same step grid
+        while (occupied_interval != NULL && occupied_interval->tmax < t) {
+          occupied_interval = occupied_interval->next;
+        }
+        if (occupied_interval == NULL) {
+          break;
+        }
+        if (occupied_interval->tmin > t) {
+          t += t_delta * Ceil((occupied_interval->tmin - t) / t_delta);
+          P = RayPointAt(*ray, t);
+          continue;
+        }
+
+        // coarser mip levels take proportionally longer steps
+        double t_next_level = 0;
+        const int level = find_lod_level(cxt, voxel_step, t, &t_next_level);
+        const double step = t_delta * (1 << level);
+        const Vector delta(
+            ray_delta.x * (1 << level),
+            ray_delta.y * (1 << level),
+            ray_delta.z * (1 << level));
+
+        // fetch densities up to the end of occupied interval or level in one call
+        const double t_end = Min(Min(occupied_interval->tmax, t_limit), t_next_level);
+        int nsamples = (int) ((t_end - t) / step) + 1;
+        if (nsamples > RAYMARCH_BATCH_SIZE) {
+          nsamples = RAYMARCH_BATCH_SIZE;
+        }
+        fetch_densities(cxt, intervals, P, delta, nsamples, level, &densities[0]);
+
+        // long steps of coarse levels use exponential opacity not to overshoot
+        for (int i = 0; i < nsamples && out_rgba->a < opacity_threshold; i++) {
+          composite_sample(cxt, intervals, &densities[i], P, step, level > 0,
+              out_rgba);
+
+          // advance sample point
+          P.x += delta.x;
+          P.y += delta.y;
+          P.z += delta.z;
+          t += step;
+        }
+      }
     }
     if (out_rgba->a >= opacity_threshold) {
       out_rgba->a = 1;
@@ -692,6 +982,95 @@ static int raymarch_volume(const TraceContext *cxt, const Ray *ray,
   return hit;
 }
 
+// seed from ray so that results do not depend on thread scheduling
+static uint32_t ray_seed(const Ray &ray, double time)
+{
+  const double values[7] = {
+    ray.orig.x, ray.orig.y, ray.orig.z,
+    ray.dir.x, ray.dir.y, ray.dir.z,
+    time
+  };
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+
+  for (int i = 0; i < 7; i++) {
+    uint64_t bits = 0;
+    memcpy(&bits, &values[i], sizeof(bits));
+    h ^= bits;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+  }
+
+  return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+// delta tracking for free-flight distance and ratio tracking for shadow.
+// overlapping volumes add their densities
+static int track_volume(const TraceContext *cxt, const Ray *ray,
+    const IntervalList &intervals, Color4 *out_rgba)
+{
+  XorShift rng(ray_seed(*ray, cxt->time));
+
+  if (cxt->ray_context == CXT_SHADOW_RAY) {
+    Real transmittance = 1;
+
+    for (const Interval *interval = intervals.GetHead();
+        interval != NULL; interval = interval->next) {
+      transmittance *= interval->object->EstimateVolumeTransmittance(
+          *ray, cxt->time, &rng);
+      if (transmittance == 0) {
+        break;
+      }
+    }
+
+    out_rgba->a = Clamp(1 - transmittance, 0, 1);
+    return 1;
+  }
+
+  // the nearest collision among volumes
+  const ObjectInstance *collided_object = NULL;
+  Real t_collision = REAL_MAX;
+
+  for (const Interval *interval = intervals.GetHead();
+      interval != NULL; interval = interval->next) {
+    Ray ray_to_collision = *ray;
+    ray_to_collision.tmax = Min(ray->tmax, t_collision);
+
+    Real t = REAL_MAX;
+    if (interval->object->SampleVolumeFreeFlight(
+          ray_to_collision, cxt->time, &rng, &t)) {
+      t_collision = t;
+      collided_object = interval->object;
+    }
+  }
+
+  if (collided_object == NULL) {
+    return 1;
+  }
+
+  SurfaceInput in;
+  SurfaceOutput out;
+
+  in.shaded_object = collided_object;
+  in.P = RayPointAt(*ray, t_collision);
+  in.N = Vector(0, 0, 0);
+
+  // TODO shading group
+  const Shader *shader = collided_object->GetShader(0);
+  if (shader != NULL) {
+    shader->Evaluate(*cxt, in, &out);
+  } else {
+    out.Cs = NO_SHADER_COLOR;
+    out.Os = 1;
+  }
+
+  out_rgba->r = out.Cs.r;
+  out_rgba->g = out.Cs.g;
+  out_rgba->b = out.Cs.b;
+  out_rgba->a = 1;
+
+  return 1;
+}
+
 static int shadow_ray_has_reached_opcity_limit(const TraceContext *cxt, float opac)
 {
   if (cxt->ray_context == CXT_SHADOW_RAY && opac > cxt->opacity_threshold) {
@@ -14,6 +14,7 @@ namespace fj {
 class ObjectInstance;
 class ObjectGroup;
 class Texture;
+class ShadingContext;
 
 enum RayContext {
   CXT_CAMERA_RAY = 0,
@@ -23,6 +24,11 @@ enum RayContext {
   CXT_REFRACT_RAY
 };
 
+enum VolumeIntegrator {
+  VOLUME_RAYMARCH = 0,
+  VOLUME_DELTA_TRACKING
+};
+
 class FJ_API TraceContext {
 public:
   int ray_context;
@@ -42,8 +48,16 @@ public:
   double raymarch_diffuse_step;
   double raymarch_reflect_step;
   double raymarch_refract_step;
+  int volume_integrator;
+  // adaptive raymarch steps relative to voxel size if > 0
+  double raymarch_quality;
+  // coarser volume mip levels for secondary rays if > 0
+  double raymarch_lod;
 
   const ObjectGroup *trace_target;
+  // per-thread state of the thread tracing this ray. NULL falls back
+  // to GetThreadShadingContext()
+  ShadingContext *shading_context;
 };
 
 class FJ_API SurfaceInput {
@@ -116,8 +130,10 @@ FJ_API int SlIlluminance(const TraceContext *cxt, const LightSample *sample,
 
 FJ_API int SlGetLightCount(const SurfaceInput *in);
 FJ_API int SlGetLightSampleCount(const SurfaceInput *in);
-FJ_API LightSample *SlNewLightSamples(const SurfaceInput *in);
-FJ_API void SlFreeLightSamples(LightSample * samples);
+FJ_API LightSample *SlNewLightSamples(const TraceContext *cxt,
+    const SurfaceInput *in);
+FJ_API void SlFreeLightSamples(const TraceContext *cxt, LightSample *samples);
+FJ_API ShadingContext *SlGetShadingContext(const TraceContext *cxt);
 
 // texture functions
 FJ_API void SlBumpMapping(const Texture *bump_map,
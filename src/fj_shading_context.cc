@@ -0,0 +1,126 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "fj_shading_context.h"
+#include <algorithm>
+
+namespace fj {
+
+static const std::size_t SCRATCH_BLOCK_SIZE = 64 * 1024;
+static const std::size_t SCRATCH_ALIGNMENT = 16;
+
+ScratchAllocator::ScratchAllocator() : blocks_(), current_(0), offset_(0)
+{
+}
+
+ScratchAllocator::~ScratchAllocator()
+{
+  for (std::size_t i = 0; i < blocks_.size(); i++) {
+    delete [] blocks_[i].data;
+  }
+}
+
+void *ScratchAllocator::Allocate(std::size_t size)
+{
+  size = (size + SCRATCH_ALIGNMENT - 1) & ~(SCRATCH_ALIGNMENT - 1);
+
+  // blocks after the current one are kept from earlier allocations
+  while (current_ < blocks_.size()) {
+    Block &block = blocks_[current_];
+    if (offset_ + size <= block.size) {
+      void *ptr = block.data + offset_;
+      offset_ += size;
+      return ptr;
+    }
+    current_++;
+    offset_ = 0;
+  }
+
+  Block block;
+  block.size = std::max(size, SCRATCH_BLOCK_SIZE);
+  block.data = new char[block.size];
+  blocks_.push_back(block);
+
+  current_ = blocks_.size() - 1;
+  offset_ = size;
+  return block.data;
+}
+
+void ScratchAllocator::Free(void *ptr)
+{
+  if (ptr == NULL) {
+    return;
+  }
+
+  const char *p = static_cast<const char *>(ptr);
+  for (std::size_t i = std::min(current_ + 1, blocks_.size()); i-- > 0; ) {
+    const Block &block = blocks_[i];
+    if (p >= block.data && p < block.data + block.size) {
+      current_ = i;
+      offset_ = p - block.data;
+      return;
+    }
+  }
+}
+
+ShadingContext::ShadingContext() : rng_(), scratch_(), caches_()
+{
+}
+
+ShadingContext::~ShadingContext()
+{
+  for (std::size_t i = 0; i < caches_.size(); i++) {
+    if (caches_[i].delete_data != NULL) {
+      caches_[i].delete_data(caches_[i].data);
+    }
+  }
+}
+
+XorShift &ShadingContext::GetRandom()
+{
+  return rng_;
+}
+
+ScratchAllocator &ShadingContext::GetScratch()
+{
+  return scratch_;
+}
+
+void *ShadingContext::GetCache(const void *owner) const
+{
+  for (std::size_t i = 0; i < caches_.size(); i++) {
+    if (caches_[i].owner == owner) {
+      return caches_[i].data;
+    }
+  }
+  return NULL;
+}
+
+void ShadingContext::SetCache(const void *owner, void *cache,
+    void (*delete_cache)(void *))
+{
+  for (std::size_t i = 0; i < caches_.size(); i++) {
+    if (caches_[i].owner == owner) {
+      if (caches_[i].delete_data != NULL && caches_[i].data != cache) {
+        caches_[i].delete_data(caches_[i].data);
+      }
+      caches_[i].data = cache;
+      caches_[i].delete_data = delete_cache;
+      return;
+    }
+  }
+
+  Cache entry;
+  entry.owner = owner;
+  entry.data = cache;
+  entry.delete_data = delete_cache;
+  caches_.push_back(entry);
+}
+
+ShadingContext *GetThreadShadingContext()
+{
+  static thread_local ShadingContext context;
+  return &context;
+}
+
+} // namespace xxx
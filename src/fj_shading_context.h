@@ -0,0 +1,84 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#ifndef FJ_SHADING_CONTEXT_H
+#define FJ_SHADING_CONTEXT_H
+
+#include "fj_compatibility.h"
+#include "fj_random.h"
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace fj {
+
+// bump allocator for short lived memory. allocations have to be freed
+// in reverse order. freeing a pointer also frees everything after it
+class FJ_API ScratchAllocator {
+public:
+  ScratchAllocator();
+  ~ScratchAllocator();
+
+  void *Allocate(std::size_t size);
+  void Free(void *ptr);
+
+  template<typename T>
+  T *AllocateArray(std::size_t count)
+  {
+    T *array = static_cast<T *>(Allocate(sizeof(T) * count));
+    for (std::size_t i = 0; i < count; i++) {
+      new (&array[i]) T();
+    }
+    return array;
+  }
+
+private:
+  struct Block {
+    char *data;
+    std::size_t size;
+  };
+  std::vector<Block> blocks_;
+  std::size_t current_;
+  std::size_t offset_;
+
+  // not copyable
+  ScratchAllocator(const ScratchAllocator &);
+  const ScratchAllocator &operator=(const ScratchAllocator &);
+};
+
+// state owned by one thread and handed to shaders and lights through
+// TraceContext. never share a context between threads
+class FJ_API ShadingContext {
+public:
+  ShadingContext();
+  ~ShadingContext();
+
+  XorShift &GetRandom();
+  ScratchAllocator &GetScratch();
+
+  // per-thread data of a plugin keyed by the plugin object itself.
+  // the context deletes it with delete_cache when it goes away
+  void *GetCache(const void *owner) const;
+  void SetCache(const void *owner, void *cache, void (*delete_cache)(void *));
+
+private:
+  struct Cache {
+    const void *owner;
+    void *data;
+    void (*delete_data)(void *);
+  };
+  XorShift rng_;
+  ScratchAllocator scratch_;
+  std::vector<Cache> caches_;
+
+  // not copyable
+  ShadingContext(const ShadingContext &);
+  const ShadingContext &operator=(const ShadingContext &);
+};
+
+// context of the calling thread for callers that do not own one
+FJ_API ShadingContext *GetThreadShadingContext();
+
+} // namespace xxx
+
+#endif // FJ_XXX_H
@@ -2,11 +2,12 @@
 // See LICENSE and README
 
 #include "fj_sphere_light.h"
-#include "fj_multi_thread.h"
+#include "fj_shading_context.h"
+#include "fj_shading.h"
 
 namespace fj {
 
-SphereLight::SphereLight() : rng_()
+SphereLight::SphereLight()
 {
 }
 
@@ -19,7 +20,8 @@ int SphereLight::get_sample_count() const
   return GetSampleDensity();
 }
 
-void SphereLight::get_samples(LightSample *samples, int max_samples) const
+void SphereLight::get_samples(const TraceContext &cxt,
+    LightSample *samples, int max_samples) const
 {
   Transform transform_interp;
   // TODO time sampling
@@ -29,9 +31,9 @@ void SphereLight::get_samples(LightSample *samples, int max_samples) const
   int nsamples = GetSampleCount();
   nsamples = Min(nsamples, max_samples);
 
+  XorShift &rng = SlGetShadingContext(&cxt)->GetRandom();
   for (int i = 0; i < nsamples; i++) {
-    XorShift &mutable_rng = const_cast<XorShift &>(rng_);
-    Vector P_sample = mutable_rng.HollowSphereRand();
+    Vector P_sample = rng.HollowSphereRand();
     Vector N_sample = P_sample;
 
     XfmTransformPoint(&transform_interp, &P_sample);
@@ -0,0 +1,559 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "fj_tessellated_mesh.h"
+#include "fj_intersection.h"
+#include "fj_tex_coord.h"
+#include "fj_triangle.h"
+#include "fj_texture.h"
+#include "fj_numeric.h"
+#include "fj_color.h"
+#include "fj_mesh.h"
+#include "fj_ray.h"
+
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <list>
+
+namespace fj {
+
+static const int MAX_SUBDIVISION_LEVEL = 8;
+// Phong tessellation shape factor
+static const Real PHONG_ALPHA = .75;
+// cache is split into shards to reduce lock contention
+static const int CACHE_SHARD_COUNT = 16;
+static const size_t DEFAULT_CACHE_SIZE = 256 * 1024 * 1024;
+
+// a diced control face. vertices are laid out in rows of
+// the barycentric grid (i, j) with i + j <= N
+class Patch {
+public:
+  Patch() : N(0) {}
+  ~Patch() {}
+
+  size_t GetMemorySize() const
+  {
+    return sizeof(Patch) +
+        P.capacity() * sizeof(Vector) +
+        N_vtx.capacity() * sizeof(Vector) +
+        row_bounds.capacity() * sizeof(Box);
+  }
+
+  int N;
+  std::vector<Vector> P;
+  std::vector<Vector> N_vtx;
+  std::vector<Box> row_bounds;
+};
+
+class PatchCache {
+public:
+  PatchCache() : cache_size_(DEFAULT_CACHE_SIZE) {}
+  ~PatchCache() {}
+
+  std::shared_ptr<const Patch> Find(Index prim_id)
+  {
+    Shard &shard = get_shard(prim_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    EntryMap::iterator it = shard.entries.find(prim_id);
+    if (it == shard.entries.end()) {
+      return std::shared_ptr<const Patch>();
+    }
+    // move to most recently used
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_pos);
+    return it->second.patch;
+  }
+
+  // returns the resident patch when another thread inserted it first
+  std::shared_ptr<const Patch> Insert(Index prim_id, std::shared_ptr<const Patch> patch)
+  {
+    Shard &shard = get_shard(prim_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    EntryMap::iterator it = shard.entries.find(prim_id);
+    if (it != shard.entries.end()) {
+      return it->second.patch;
+    }
+
+    Entry entry;
+    entry.patch = patch;
+    entry.size = patch->GetMemorySize();
+    shard.lru.push_front(prim_id);
+    entry.lru_pos = shard.lru.begin();
+    shard.entries[prim_id] = entry;
+    shard.usage += entry.size;
+
+    // patches in use by other threads stay alive via shared_ptr
+    const size_t shard_size = cache_size_ / CACHE_SHARD_COUNT;
+    while (shard.usage > shard_size && shard.lru.size() > 1) {
+      const Index victim = shard.lru.back();
+      EntryMap::iterator vit = shard.entries.find(victim);
+      shard.usage -= vit->second.size;
+      shard.entries.erase(vit);
+      shard.lru.pop_back();
+    }
+
+    return patch;
+  }
+
+  void Clear()
+  {
+    for (int i = 0; i < CACHE_SHARD_COUNT; i++) {
+      std::lock_guard<std::mutex> lock(shards_[i].mutex);
+      shards_[i].entries.clear();
+      shards_[i].lru.clear();
+      shards_[i].usage = 0;
+    }
+  }
+
+  size_t GetMemoryUsage()
+  {
+    size_t usage = 0;
+    for (int i = 0; i < CACHE_SHARD_COUNT; i++) {
+      std::lock_guard<std::mutex> lock(shards_[i].mutex);
+      usage += shards_[i].usage;
+    }
+    return usage;
+  }
+
+  void SetCacheSize(size_t bytes) { cache_size_ = bytes; }
+  size_t GetCacheSize() const { return cache_size_; }
+
+private:
+  class Entry {
+  public:
+    Entry() : patch(), lru_pos(), size(0) {}
+    ~Entry() {}
+
+    std::shared_ptr<const Patch> patch;
+    std::list<Index>::iterator lru_pos;
+    size_t size;
+  };
+  typedef std::unordered_map<Index, Entry> EntryMap;
+
+  class Shard {
+  public:
+    Shard() : mutex(), entries(), lru(), usage(0) {}
+    ~Shard() {}
+
+    std::mutex mutex;
+    EntryMap entries;
+    std::list<Index> lru;
+    size_t usage;
+  };
+
+  Shard &get_shard(Index prim_id)
+  {
+    return shards_[prim_id % CACHE_SHARD_COUNT];
+  }
+
+  Shard shards_[CACHE_SHARD_COUNT];
+  size_t cache_size_;
+};
+
+static void get_control_positions(const Mesh &mesh, Index face_index,
+    Vector *P0, Vector *P1, Vector *P2);
+static void get_control_normals(const Mesh &mesh, Index face_index,
+    Vector *N0, Vector *N1, Vector *N2);
+static void get_control_texture(const Mesh &mesh, Index face_index,
+    TexCoord *uv0, TexCoord *uv1, TexCoord *uv2);
+static Vector project_to_plane(const Vector &P, const Vector &origin, const Vector &N);
+
+static inline int grid_vertex_index(int N, int i, int j)
+{
+  // offset of row j + i
+  return j * (N + 1) - j * (j - 1) / 2 + i;
+}
+
+TessellatedMesh::TessellatedMesh() :
+    mesh_(NULL),
+    displacement_map_(NULL),
+    displacement_scale_(0),
+    displacement_bound_(1),
+    subdivision_level_(3),
+    cache_(new PatchCache())
+{
+}
+
+TessellatedMesh::~TessellatedMesh()
+{
+  delete cache_;
+}
+
+int TessellatedMesh::SetControlMesh(const Mesh *mesh)
+{
+  // patches are cached at one shape, so moving control points can't be used
+  if (mesh != NULL &&
+      (mesh->HasPointVelocity() || mesh->HasPointPositionSamples())) {
+    return -1;
+  }
+
+  mesh_ = mesh;
+  ClearCache();
+  return 0;
+}
+
+void TessellatedMesh::SetDisplacementMap(const Texture *texture)
+{
+  displacement_map_ = texture;
+  ClearCache();
+}
+
+void TessellatedMesh::SetDisplacementScale(Real scale)
+{
+  displacement_scale_ = scale;
+  ClearCache();
+}
+
+void TessellatedMesh::SetDisplacementBound(Real bound)
+{
+  displacement_bound_ = Abs(bound);
+}
+
+void TessellatedMesh::SetSubdivisionLevel(int level)
+{
+  subdivision_level_ = Clamp(level, 0, MAX_SUBDIVISION_LEVEL);
+  ClearCache();
+}
+
+void TessellatedMesh::SetCacheSize(size_t bytes)
+{
+  cache_->SetCacheSize(bytes);
+}
+
+const Mesh *TessellatedMesh::GetControlMesh() const
+{
+  return mesh_;
+}
+
+int TessellatedMesh::GetSubdivisionLevel() const
+{
+  return subdivision_level_;
+}
+
+size_t TessellatedMesh::GetCacheSize() const
+{
+  return cache_->GetCacheSize();
+}
+
+size_t TessellatedMesh::GetCacheMemoryUsage() const
+{
+  return cache_->GetMemoryUsage();
+}
+
+void TessellatedMesh::ClearCache()
+{
+  cache_->Clear();
+}
+
+bool TessellatedMesh::ray_intersect(Index prim_id, const Ray &ray,
+    Real time, Intersection *isect) const
+{
+  const std::shared_ptr<const Patch> patch = get_patch(prim_id);
+  const int N = patch->N;
+
+  Real t_nearest = REAL_MAX;
+  Real u_hit = 0, v_hit = 0;
+  int tri_hit[3] = {0, 0, 0};
+  // grid coordinates of the hit triangle
+  Vector grid_hit[3];
+  bool hit = false;
+
+  for (int j = 0; j < N; j++) {
+    Real boxhit_tmin, boxhit_tmax;
+    if (!BoxRayIntersect(patch->row_bounds[j], ray.orig, ray.dir,
+          ray.tmin, Min(ray.tmax, t_nearest), &boxhit_tmin, &boxhit_tmax)) {
+      continue;
+    }
+
+    for (int i = 0; i < N - j; i++) {
+      const int tris[2][3] = {
+        {grid_vertex_index(N, i, j),
+         grid_vertex_index(N, i + 1, j),
+         grid_vertex_index(N, i, j + 1)},
+        {grid_vertex_index(N, i + 1, j),
+         grid_vertex_index(N, i + 1, j + 1),
+         grid_vertex_index(N, i, j + 1)}
+      };
+      // the last triangle in the row has no downward neighbor
+      const int NTRIS = (i < N - j - 1) ? 2 : 1;
+
+      for (int k = 0; k < NTRIS; k++) {
+        Real t = 0, u = 0, v = 0;
+        const bool hittmp = TriRayIntersect(
+            patch->P[tris[k][0]], patch->P[tris[k][1]], patch->P[tris[k][2]],
+            ray.orig, ray.dir, DO_NOT_CULL_BACKFACES,
+            &t, &u, &v);
+
+        if (hittmp && t < t_nearest && RayInRange(ray, t)) {
+          t_nearest = t;
+          u_hit = u;
+          v_hit = v;
+          tri_hit[0] = tris[k][0];
+          tri_hit[1] = tris[k][1];
+          tri_hit[2] = tris[k][2];
+          if (k == 0) {
+            grid_hit[0] = Vector(i, j, 0);
+            grid_hit[1] = Vector(i + 1, j, 0);
+            grid_hit[2] = Vector(i, j + 1, 0);
+          } else {
+            grid_hit[0] = Vector(i + 1, j, 0);
+            grid_hit[1] = Vector(i + 1, j + 1, 0);
+            grid_hit[2] = Vector(i, j + 1, 0);
+          }
+          hit = true;
+        }
+      }
+    }
+  }
+
+  if (!hit) {
+    return false;
+  }
+
+  if (isect == NULL)
+    return true;
+
+  isect->N = TriComputeNormal(
+      patch->N_vtx[tri_hit[0]],
+      patch->N_vtx[tri_hit[1]],
+      patch->N_vtx[tri_hit[2]],
+      u_hit, v_hit);
+
+  if (mesh_->HasPointTexture()) {
+    // barycentric coordinates on the control face
+    const Real w = 1 - u_hit - v_hit;
+    const Vector b = (w * grid_hit[0] + u_hit * grid_hit[1] + v_hit * grid_hit[2]) / N;
+
+    TexCoord uv0, uv1, uv2;
+    Vector P0, P1, P2;
+    get_control_texture(*mesh_, prim_id, &uv0, &uv1, &uv2);
+    get_control_positions(*mesh_, prim_id, &P0, &P1, &P2);
+
+    const Real b0 = 1 - b.x - b.y;
+    isect->uv.u = b0 * uv0.u + b.x * uv1.u + b.y * uv2.u;
+    isect->uv.v = b0 * uv0.v + b.x * uv1.v + b.y * uv2.v;
+
+    TriComputeDerivatives(
+        P0, P1, P2,
+        uv0, uv1, uv2,
+        &isect->dPdu, &isect->dPdv);
+  }
+  else {
+    isect->uv.u = 0;
+    isect->uv.v = 0;
+    isect->dPdu = Vector(0, 0, 0);
+    isect->dPdv = Vector(0, 0, 0);
+  }
+
+  isect->P = RayPointAt(ray, t_nearest);
+  isect->object = NULL;
+  isect->prim_id = prim_id;
+  isect->shading_group_id = mesh_->GetFaceGroupID(prim_id);
+  isect->t_hit = t_nearest;
+
+  return true;
+}
+
+void TessellatedMesh::get_primitive_bounds(Index prim_id, Box *bounds) const
+{
+  Vector P0, P1, P2;
+  get_control_positions(*mesh_, prim_id, &P0, &P1, &P2);
+
+  TriComputeBounds(P0, P1, P2, bounds);
+
+  // the Phong offset from the flat triangle is a sum over edges of
+  // b_i * b_j (<= 1/4) times how far the edge leaves the planes of
+  // its two end normals
+  Real bulge = 0;
+  if (subdivision_level_ > 0) {
+    Vector N0, N1, N2;
+    get_control_normals(*mesh_, prim_id, &N0, &N1, &N2);
+
+    const Vector E01 = P1 - P0;
+    const Vector E12 = P2 - P1;
+    const Vector E20 = P0 - P2;
+    const Real deviation =
+        Abs(Dot(E01, N0)) + Abs(Dot(E01, N1)) +
+        Abs(Dot(E12, N1)) + Abs(Dot(E12, N2)) +
+        Abs(Dot(E20, N2)) + Abs(Dot(E20, N0));
+    bulge = PHONG_ALPHA / 4 * deviation;
+  }
+
+  bounds->Expand(bulge + Abs(displacement_scale_) * displacement_bound_);
+}
+
+void TessellatedMesh::get_bounds(Box *bounds) const
+{
+  bounds->ReverseInfinite();
+
+  for (int i = 0; i < GetPrimitiveCount(); i++) {
+    Box patch_bounds;
+    GetPrimitiveBounds(i, &patch_bounds);
+    bounds->AddBox(patch_bounds);
+  }
+}
+
+Index TessellatedMesh::get_primitive_count() const
+{
+  if (mesh_ == NULL) {
+    return 0;
+  }
+  return mesh_->GetFaceCount();
+}
+
+std::shared_ptr<const Patch> TessellatedMesh::get_patch(Index prim_id) const
+{
+  std::shared_ptr<const Patch> patch = cache_->Find(prim_id);
+  if (patch) {
+    return patch;
+  }
+
+  // tessellate outside of the lock. if another thread finishes the same
+  // patch first, Insert returns that one and this one is discarded
+  std::shared_ptr<Patch> new_patch(new Patch());
+  tessellate_patch(prim_id, new_patch.get());
+
+  return cache_->Insert(prim_id, new_patch);
+}
+
+void TessellatedMesh::tessellate_patch(Index prim_id, Patch *patch) const
+{
+  const int N = 1 << subdivision_level_;
+  const int NVERTS = (N + 1) * (N + 2) / 2;
+
+  Vector P0, P1, P2;
+  Vector N0, N1, N2;
+  TexCoord uv0, uv1, uv2;
+  get_control_positions(*mesh_, prim_id, &P0, &P1, &P2);
+  get_control_normals(*mesh_, prim_id, &N0, &N1, &N2);
+  get_control_texture(*mesh_, prim_id, &uv0, &uv1, &uv2);
+
+  const bool has_texture = mesh_->HasPointTexture();
+  const Real alpha = (subdivision_level_ > 0) ? PHONG_ALPHA : 0;
+
+  patch->N = N;
+  patch->P.resize(NVERTS);
+  patch->N_vtx.resize(NVERTS, Vector(0, 0, 0));
+  patch->row_bounds.resize(N);
+
+  for (int j = 0; j <= N; j++) {
+    for (int i = 0; i <= N - j; i++) {
+      const Real b1 = static_cast<Real>(i) / N;
+      const Real b2 = static_cast<Real>(j) / N;
+      const Real b0 = 1 - b1 - b2;
+
+      // Phong tessellation
+      const Vector P_flat = b0 * P0 + b1 * P1 + b2 * P2;
+      const Vector P_phong =
+          b0 * project_to_plane(P_flat, P0, N0) +
+          b1 * project_to_plane(P_flat, P1, N1) +
+          b2 * project_to_plane(P_flat, P2, N2);
+      Vector P = (1 - alpha) * P_flat + alpha * P_phong;
+
+      // displacement along interpolated normal
+      if (displacement_map_ != NULL && displacement_scale_ != 0) {
+        const Vector N_interp = Normalize(b0 * N0 + b1 * N1 + b2 * N2);
+        float u = b1;
+        float v = b2;
+        if (has_texture) {
+          u = b0 * uv0.u + b1 * uv1.u + b2 * uv2.u;
+          v = b0 * uv0.v + b1 * uv1.v + b2 * uv2.v;
+        }
+        const Color4 value = displacement_map_->Lookup(u, v);
+        P += displacement_scale_ * value.r * N_interp;
+      }
+
+      patch->P[grid_vertex_index(N, i, j)] = P;
+    }
+  }
+
+  // accumulate face normals to vertices and compute row bounds
+  for (int j = 0; j < N; j++) {
+    Box &row = patch->row_bounds[j];
+    row.ReverseInfinite();
+
+    for (int i = 0; i < N - j; i++) {
+      const int tris[2][3] = {
+        {grid_vertex_index(N, i, j),
+         grid_vertex_index(N, i + 1, j),
+         grid_vertex_index(N, i, j + 1)},
+        {grid_vertex_index(N, i + 1, j),
+         grid_vertex_index(N, i + 1, j + 1),
+         grid_vertex_index(N, i, j + 1)}
+      };
+      const int NTRIS = (i < N - j - 1) ? 2 : 1;
+
+      for (int k = 0; k < NTRIS; k++) {
+        const Vector &A = patch->P[tris[k][0]];
+        const Vector &B = patch->P[tris[k][1]];
+        const Vector &C = patch->P[tris[k][2]];
+        // area weighted
+        const Vector face_N = Cross(B - A, C - A);
+
+        patch->N_vtx[tris[k][0]] += face_N;
+        patch->N_vtx[tris[k][1]] += face_N;
+        patch->N_vtx[tris[k][2]] += face_N;
+
+        row.AddPoint(A);
+        row.AddPoint(B);
+        row.AddPoint(C);
+      }
+    }
+  }
+
+  for (int i = 0; i < NVERTS; i++) {
+    patch->N_vtx[i] = Normalize(patch->N_vtx[i]);
+  }
+}
+
+static void get_control_positions(const Mesh &mesh, Index face_index,
+    Vector *P0, Vector *P1, Vector *P2)
+{
+  const Index3 face = mesh.GetFaceIndices(face_index);
+  *P0 = mesh.GetPointPosition(face.i0);
+  *P1 = mesh.GetPointPosition(face.i1);
+  *P2 = mesh.GetPointPosition(face.i2);
+}
+
+static void get_control_normals(const Mesh &mesh, Index face_index,
+    Vector *N0, Vector *N1, Vector *N2)
+{
+  if (mesh.HasVertexNormal()) {
+    *N0 = mesh.GetVertexNormal(3 * face_index + 0);
+    *N1 = mesh.GetVertexNormal(3 * face_index + 1);
+    *N2 = mesh.GetVertexNormal(3 * face_index + 2);
+  }
+  else if (mesh.HasPointNormal()) {
+    const Index3 face = mesh.GetFaceIndices(face_index);
+    *N0 = mesh.GetPointNormal(face.i0);
+    *N1 = mesh.GetPointNormal(face.i1);
+    *N2 = mesh.GetPointNormal(face.i2);
+  }
+  else {
+    Vector P0, P1, P2;
+    get_control_positions(mesh, face_index, &P0, &P1, &P2);
+    *N0 = *N1 = *N2 = TriComputeFaceNormal(P0, P1, P2);
+  }
+
+  *N0 = Normalize(*N0);
+  *N1 = Normalize(*N1);
+  *N2 = Normalize(*N2);
+}
+
+static void get_control_texture(const Mesh &mesh, Index face_index,
+    TexCoord *uv0, TexCoord *uv1, TexCoord *uv2)
+{
+  const Index3 face = mesh.GetFaceIndices(face_index);
+  *uv0 = mesh.GetPointTexture(face.i0);
+  *uv1 = mesh.GetPointTexture(face.i1);
+  *uv2 = mesh.GetPointTexture(face.i2);
+}
+
+static Vector project_to_plane(const Vector &P, const Vector &origin, const Vector &N)
+{
+  return P - Dot(P - origin, N) * N;
+}
+
+} // namespace xxx
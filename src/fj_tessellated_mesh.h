@@ -0,0 +1,67 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#ifndef FJ_TESSELLATED_MESH_H
+#define FJ_TESSELLATED_MESH_H
+
+#include "fj_compatibility.h"
+#include "fj_primitive_set.h"
+#include "fj_vector.h"
+#include "fj_types.h"
+#include "fj_box.h"
+
+#include <memory>
+#include <cstddef>
+
+namespace fj {
+
+class Texture;
+class Mesh;
+class Patch;
+class PatchCache;
+
+// TessellatedMesh holds a coarse control mesh and dices each face into a
+// patch (subdivision plus displacement) when a ray reaches it first.
+// Patches live in a LRU cache bounded by cache_size. Patches don't move,
+// so control meshes with velocity or position samples are rejected.
+class FJ_API TessellatedMesh : public PrimitiveSet {
+public:
+  TessellatedMesh();
+  virtual ~TessellatedMesh();
+
+  // returns -1 if the mesh has motion
+  int SetControlMesh(const Mesh *mesh);
+  void SetDisplacementMap(const Texture *texture);
+  void SetDisplacementScale(Real scale);
+  void SetDisplacementBound(Real bound);
+  void SetSubdivisionLevel(int level);
+  void SetCacheSize(size_t bytes);
+
+  const Mesh *GetControlMesh() const;
+  int GetSubdivisionLevel() const;
+  size_t GetCacheSize() const;
+  size_t GetCacheMemoryUsage() const;
+  void ClearCache();
+
+private:
+  virtual bool ray_intersect(Index prim_id, const Ray &ray,
+      Real time, Intersection *isect) const;
+  virtual void get_primitive_bounds(Index prim_id, Box *bounds) const;
+  virtual void get_bounds(Box *bounds) const;
+  virtual Index get_primitive_count() const;
+
+  std::shared_ptr<const Patch> get_patch(Index prim_id) const;
+  void tessellate_patch(Index prim_id, Patch *patch) const;
+
+  const Mesh *mesh_;
+  const Texture *displacement_map_;
+  Real displacement_scale_;
+  Real displacement_bound_;
+  int subdivision_level_;
+
+  PatchCache *cache_;
+};
+
+} // namespace xxx
+
+#endif // FJ_XXX_H
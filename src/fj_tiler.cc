@@ -5,8 +5,12 @@
 #include "fj_rectangle.h"
 #include "fj_numeric.h"
 
+#include <algorithm>
+#include <utility>
 #include <cstddef>
 #include <cassert>
+#include <cstdint>
+#include <cmath>
 
 namespace fj {
 
@@ -40,6 +44,57 @@ const Tile *Tiler::GetTile(int index) const
   return &tiles_[index];
 }
 
+// distance along the hilbert curve that fills n x n (n is power of 2)
+static int64_t hilbert_index(int64_t n, int64_t x, int64_t y)
+{
+  int64_t d = 0;
+
+  for (int64_t s = n / 2; s > 0; s /= 2) {
+    const int64_t rx = (x & s) > 0;
+    const int64_t ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+
+    // rotate the quadrant
+    if (ry == 0) {
+      if (rx == 1) {
+        x = s - 1 - x;
+        y = s - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+static int64_t morton_index(int64_t x, int64_t y)
+{
+  int64_t d = 0;
+
+  for (int i = 0; i < 31; i++) {
+    d |= ((x >> i) & 1) << (2 * i);
+    d |= ((y >> i) & 1) << (2 * i + 1);
+  }
+  return d;
+}
+
+// ring around the center, then angle in the ring
+static double spiral_index(int xntiles, int yntiles, int x, int y)
+{
+  const double dx = x - .5 * (xntiles - 1);
+  const double dy = y - .5 * (yntiles - 1);
+  const double ring = std::floor(std::max(std::abs(dx), std::abs(dy)) + .5);
+  const double angle = std::atan2(dy, dx) + PI;
+
+  return ring * 8 + angle;
+}
+
+static bool overlaps(const Tile &tile, const Rectangle &region)
+{
+  return
+    tile.xmin < region.max[0] && region.min[0] < tile.xmax &&
+    tile.ymin < region.max[1] && region.min[1] < tile.ymax;
+}
+
 void Tiler::Divide(int xres, int yres, int xtile_size, int ytile_size)
 {
   assert(xres > 0);
@@ -112,4 +167,57 @@ void Tiler::GenerateTiles(const Rectangle &region)
   tiles_.swap(tmp_tiles);
 }
 
+void Tiler::GenerateTileOrder(int tile_order, const Rectangle &priority_region,
+    std::vector<int> *iteration_que) const
+{
+  const int tile_count = GetTileCount();
+  std::vector<std::pair<double, int>> keys(tile_count);
+
+  int n = 1;
+  while (n < xntiles_ || n < yntiles_) {
+    n *= 2;
+  }
+
+  for (int i = 0; i < tile_count; i++) {
+    const int x = i % xntiles_;
+    const int y = i / xntiles_;
+    double key = i;
+
+    switch (tile_order) {
+    case TILE_ORDER_SPIRAL:
+      key = spiral_index(xntiles_, yntiles_, x, y);
+      break;
+    case TILE_ORDER_HILBERT:
+      key = hilbert_index(n, x, y);
+      break;
+    case TILE_ORDER_MORTON:
+      key = morton_index(x, y);
+      break;
+    case TILE_ORDER_SCANLINE:
+    default:
+      break;
+    }
+    keys[i] = std::make_pair(key, i);
+  }
+
+  std::stable_sort(keys.begin(), keys.end());
+
+  iteration_que->resize(tile_count);
+  for (int i = 0; i < tile_count; i++) {
+    (*iteration_que)[i] = keys[i].second;
+  }
+
+  const bool has_priority =
+      priority_region.min[0] < priority_region.max[0] &&
+      priority_region.min[1] < priority_region.max[1];
+
+  if (has_priority) {
+    std::stable_partition(iteration_que->begin(), iteration_que->end(),
+        [this, &priority_region](int index)
+        {
+          return overlaps(tiles_[index], priority_region);
+        });
+  }
+}
+
 } // namespace xxx
@@ -18,6 +18,13 @@ public:
   int xmin, ymin, xmax, ymax;
 };
 
+enum TileOrder {
+  TILE_ORDER_SCANLINE = 0,
+  TILE_ORDER_SPIRAL,
+  TILE_ORDER_HILBERT,
+  TILE_ORDER_MORTON
+};
+
 class Tiler {
 public:
   Tiler();
@@ -29,6 +36,11 @@ public:
   void Divide(int xres, int yres, int xtile_size, int ytile_size);
   void GenerateTiles(const Rectangle &region);
 
+  // Tile indices in rendering order for MtRunParallelLoop. Tiles overlapping
+  // priority_region come first. An empty priority_region has no effect.
+  void GenerateTileOrder(int tile_order, const Rectangle &priority_region,
+      std::vector<int> *iteration_que) const;
+
 public:
   int total_ntiles_;
   int xntiles_;
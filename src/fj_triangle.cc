@@ -320,4 +320,122 @@ bool TriBoxIntersect(
    return true;   /* box and triangle overlaps */
 }
 
+static bool is_zero_vector(const Vector &v)
+{
+  return v[0] == 0 && v[1] == 0 && v[2] == 0;
+}
+
+static bool is_separating_axis(const Vector &axis,
+    const Vector *verts, int nverts, const Vector &boxhalfsize)
+{
+  Real min = Dot(axis, verts[0]);
+  Real max = min;
+
+  for (int i = 1; i < nverts; i++) {
+    const Real p = Dot(axis, verts[i]);
+    min = Min(min, p);
+    max = Max(max, p);
+  }
+
+  const Real rad =
+      Abs(axis[0]) * boxhalfsize[0] +
+      Abs(axis[1]) * boxhalfsize[1] +
+      Abs(axis[2]) * boxhalfsize[2];
+
+  return min > rad || max < -rad;
+}
+
+// separating axis test between box and convex hull of triangle swept
+// from (v0, v1, v2) to (w0, w1, w2). box center is at origin.
+// candidate axes are a subset of full hull axes so never misses overlap
+static bool sweep_box_intersect(
+    const Vector &v0, const Vector &v1, const Vector &v2,
+    const Vector &w0, const Vector &w1, const Vector &w2,
+    const Vector &boxhalfsize)
+{
+  const Vector verts[6] = {v0, v1, v2, w0, w1, w2};
+
+  // box axes
+  for (int i = 0; i < 3; i++) {
+    Real min = verts[0][i];
+    Real max = min;
+    for (int j = 1; j < 6; j++) {
+      min = Min(min, verts[j][i]);
+      max = Max(max, verts[j][i]);
+    }
+    if (min > boxhalfsize[i] || max < -boxhalfsize[i])
+      return false;
+  }
+
+  // start, end and trajectory edges
+  const Vector edges[9] = {
+    v1 - v0, v2 - v1, v0 - v2,
+    w1 - w0, w2 - w1, w0 - w2,
+    w0 - v0, w1 - v1, w2 - v2
+  };
+
+  // triangle normals
+  if (is_separating_axis(Cross(edges[0], edges[1]), verts, 6, boxhalfsize))
+    return false;
+  if (is_separating_axis(Cross(edges[3], edges[4]), verts, 6, boxhalfsize))
+    return false;
+
+  // side faces of sweep
+  for (int i = 0; i < 3; i++) {
+    for (int j = 6; j < 9; j++) {
+      if (is_separating_axis(Cross(edges[i], edges[j]), verts, 6, boxhalfsize))
+        return false;
+    }
+  }
+
+  // box axes x edges
+  for (int i = 0; i < 9; i++) {
+    const Vector &e = edges[i];
+    if (is_separating_axis(Vector(0, -e[2], e[1]), verts, 6, boxhalfsize))
+      return false;
+    if (is_separating_axis(Vector(e[2], 0, -e[0]), verts, 6, boxhalfsize))
+      return false;
+    if (is_separating_axis(Vector(-e[1], e[0], 0), verts, 6, boxhalfsize))
+      return false;
+  }
+
+  return true;
+}
+
+bool TriBoxIntersectMotion(
+    const Vector &vert0, const Vector &vert1, const Vector &vert2,
+    const Vector &vel0, const Vector &vel1, const Vector &vel2,
+    const Vector &boxcenter, const Vector &boxhalfsize)
+{
+  if (is_zero_vector(vel0) && is_zero_vector(vel1) && is_zero_vector(vel2)) {
+    return TriBoxIntersect(vert0, vert1, vert2, boxcenter, boxhalfsize);
+  }
+
+  // split the sweep so that each hull hugs the swept surface
+  const int N_STEPS = 4;
+  const Vector step0 = vel0 / N_STEPS;
+  const Vector step1 = vel1 / N_STEPS;
+  const Vector step2 = vel2 / N_STEPS;
+
+  Vector v0 = vert0 - boxcenter;
+  Vector v1 = vert1 - boxcenter;
+  Vector v2 = vert2 - boxcenter;
+
+  for (int i = 0; i < N_STEPS; i++) {
+    const Vector w0 = v0 + step0;
+    const Vector w1 = v1 + step1;
+    const Vector w2 = v2 + step2;
+
+    if (sweep_box_intersect(v0, v1, v2, w0, w1, w2, boxhalfsize)) {
+      return true;
+    }
+
+    v0 = w0;
+    v1 = w1;
+    v2 = w2;
+  }
+
+  return false;
+}
+
 } // namespace xxx
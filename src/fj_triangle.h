@@ -46,6 +46,13 @@ FJ_API bool TriBoxIntersect(
     const Vector &vert0, const Vector &vert1, const Vector &vert2,
     const Vector &boxcenter, const Vector &boxhalfsize);
 
+// triangle moving linearly from vert to vert + vel during [0, 1].
+// exact when static, otherwise tests convex hulls of short sweeps
+FJ_API bool TriBoxIntersectMotion(
+    const Vector &vert0, const Vector &vert1, const Vector &vert2,
+    const Vector &vel0, const Vector &vel1, const Vector &vel2,
+    const Vector &boxcenter, const Vector &boxhalfsize);
+
 } // namespace xxx
 
 #endif // FJ_XXX_H
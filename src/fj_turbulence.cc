@@ -2,18 +2,29 @@
 // See LICENSE and README
 
 #include "fj_turbulence.h"
+#include "fj_numeric.h"
 #include "fj_noise.h"
 #include <cassert>
 
 namespace fj {
 
+// lattice units of baked noise before it repeats
+static const int NOISE_TILE_PERIOD = 16;
+// a tile of 16 samples per unit takes 256^3 floats (64MB)
+static const int MAX_TILE_RESOLUTION = 16;
+static const int TURBULENCE_BATCH_SIZE = 64;
+
+static Real tile_noise(const NoiseTile &tile, const Vector &position,
+    Real lacunarity, Real persistence, int octaves);
+
 Turbulence::Turbulence() :
     amplitude_  (1, 1, 1),
     frequency_  (1, 1, 1),
     offset_     (0, 0, 0),
     lacunarity_ (2),
     gain_       (.5),
-    octaves_    (8)
+    octaves_    (8),
+    tile_       ()
 {
 }
 
@@ -52,9 +63,24 @@ void Turbulence::SetOctaves(int octaves)
   octaves_ = octaves;
 }
 
+void Turbulence::SetTileResolution(int resolution)
+{
+  assert(resolution >= 0);
+  if (resolution > 0) {
+    tile_.Bake(NOISE_TILE_PERIOD, Min(resolution, MAX_TILE_RESOLUTION));
+  } else {
+    tile_.Clear();
+  }
+}
+
 Real Turbulence::Evaluate(const Vector &position) const
 {
   const Vector P = position * frequency_ + offset_;
+
+  if (!tile_.IsEmpty()) {
+    return amplitude_.x * tile_noise(tile_, P, lacunarity_, gain_, octaves_);
+  }
+
   const Real noise = PerlinNoise(P, lacunarity_, gain_, octaves_);
 
   return amplitude_.x * noise;
@@ -63,9 +89,91 @@ Real Turbulence::Evaluate(const Vector &position) const
 Vector Turbulence::Evaluate3d(const Vector &position) const
 {
   const Vector P = position * frequency_ + offset_;
+
+  if (!tile_.IsEmpty()) {
+    const Vector noise(
+        tile_noise(tile_, P, lacunarity_, gain_, octaves_),
+        tile_noise(tile_, P + NOISE3D_OFFSET_Y, lacunarity_, gain_, octaves_),
+        tile_noise(tile_, P + NOISE3D_OFFSET_Z, lacunarity_, gain_, octaves_));
+    return amplitude_ * noise;
+  }
+
   const Vector noise = PerlinNoise3d(P, lacunarity_, gain_, octaves_);
 
   return amplitude_ * noise;
 }
 
+void Turbulence::EvaluateBatch(const Vector *positions, int count,
+    Real *values) const
+{
+  if (!tile_.IsEmpty()) {
+    for (int i = 0; i < count; i++) {
+      values[i] = Evaluate(positions[i]);
+    }
+    return;
+  }
+
+  Vector P[TURBULENCE_BATCH_SIZE];
+
+  for (int start = 0; start < count; start += TURBULENCE_BATCH_SIZE) {
+    const int N = Min(TURBULENCE_BATCH_SIZE, count - start);
+    Real *dst = &values[start];
+
+    for (int i = 0; i < N; i++) {
+      P[i] = positions[start + i] * frequency_ + offset_;
+    }
+
+    PerlinNoiseBatch(P, N, lacunarity_, gain_, octaves_, dst);
+
+    for (int i = 0; i < N; i++) {
+      dst[i] = amplitude_.x * dst[i];
+    }
+  }
+}
+
+void Turbulence::Evaluate3dBatch(const Vector *positions, int count,
+    Vector *values) const
+{
+  if (!tile_.IsEmpty()) {
+    for (int i = 0; i < count; i++) {
+      values[i] = Evaluate3d(positions[i]);
+    }
+    return;
+  }
+
+  Vector P[TURBULENCE_BATCH_SIZE];
+
+  for (int start = 0; start < count; start += TURBULENCE_BATCH_SIZE) {
+    const int N = Min(TURBULENCE_BATCH_SIZE, count - start);
+    Vector *dst = &values[start];
+
+    for (int i = 0; i < N; i++) {
+      P[i] = positions[start + i] * frequency_ + offset_;
+    }
+
+    PerlinNoise3dBatch(P, N, lacunarity_, gain_, octaves_, dst);
+
+    for (int i = 0; i < N; i++) {
+      dst[i] = amplitude_ * dst[i];
+    }
+  }
+}
+
+static Real tile_noise(const NoiseTile &tile, const Vector &position,
+    Real lacunarity, Real persistence, int octaves)
+{
+  Vector P = position;
+  Real noise_value = 0;
+  Real amp = 1;
+
+  for (int i = 0; i < octaves; i++) {
+    noise_value += amp * tile.Sample(P.x, P.y, P.z);
+
+    amp *= persistence;
+    P   *= lacunarity;
+  }
+
+  return noise_value;
+}
+
 } // namespace xxx
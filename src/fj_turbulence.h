@@ -6,6 +6,7 @@
 
 #include "fj_compatibility.h"
 #include "fj_vector.h"
+#include "fj_noise.h"
 #include "fj_types.h"
 
 namespace fj {
@@ -21,9 +22,15 @@ public:
   void SetLacunarity(Real lacunarity);
   void SetGain(Real gain);
   void SetOctaves(int octaves);
+  // bakes noise into a periodic tile of resolution samples per unit
+  // and samples it instead of evaluating noise. 0 turns it off.
+  // resolution is clamped to 16
+  void SetTileResolution(int resolution);
 
   double Evaluate(const Vector &position) const;
   Vector Evaluate3d(const Vector &position) const;
+  void EvaluateBatch(const Vector *positions, int count, Real *values) const;
+  void Evaluate3dBatch(const Vector *positions, int count, Vector *values) const;
 
 private:
   Vector amplitude_;
@@ -32,6 +39,8 @@ private:
   Real   lacunarity_;
   Real   gain_;
   int    octaves_;
+
+  NoiseTile tile_;
 };
 
 } // namespace xxx
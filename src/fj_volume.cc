@@ -2,21 +2,322 @@
 // See LICENSE and README
 
 #include "fj_volume.h"
+#include "fj_half.h"
+#include "fj_interval.h"
 #include "fj_numeric.h"
+#include "fj_random.h"
+#include "fj_os.h"
+
+#include <cstdint>
+#include <cmath>
 
 namespace fj {
 
-VoxelBuffer::VoxelBuffer() : data_(), res_()
+static const int BRICK_BITS = 3;
+static const int BRICK_SIZE = 1 << BRICK_BITS;
+static const int BRICK_MASK = BRICK_SIZE - 1;
+static const int BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+static const int TILE_BITS = 4;
+static const int TILE_SIZE = 1 << TILE_BITS;
+static const int TILE_MASK = TILE_SIZE - 1;
+static const int TILE_BRICKS = TILE_SIZE * TILE_SIZE * TILE_SIZE;
+
+// voxel index bits covered by a tile
+static const int TILE_SHIFT = BRICK_BITS + TILE_BITS;
+
+// voxel offsets of the 8 corners of a cell in a brick
+static const int CORNER_OFFSETS[8] = {
+  0,
+  BRICK_SIZE * BRICK_SIZE,
+  BRICK_SIZE,
+  BRICK_SIZE + BRICK_SIZE * BRICK_SIZE,
+  1,
+  1 + BRICK_SIZE * BRICK_SIZE,
+  1 + BRICK_SIZE,
+  1 + BRICK_SIZE + BRICK_SIZE * BRICK_SIZE
+};
+
+static size_t voxel_data_size(int format)
+{
+  switch (format) {
+  case VOXEL_HALF16:
+    return sizeof(uint16_t);
+  case VOXEL_UINT8:
+    return sizeof(uint8_t);
+  default:
+    return sizeof(float);
+  }
+}
+
+// voxel values of a brick. only the array of the current format is
+// allocated. data points to the array or to memory of a mapped file
+class VoxelBrick {
+public:
+  VoxelBrick() :
+    format(VOXEL_FLOAT32),
+    offset(0),
+    scale(0),
+    mapped(false),
+    data(NULL),
+    values(BRICK_VOXELS, 0),
+    halves(),
+    bytes()
+  {
+    data = &values[0];
+  }
+  ~VoxelBrick() {}
+
+  float Get(int i) const
+  {
+    switch (format) {
+    case VOXEL_HALF16:
+      return HalfToFloat(static_cast<const uint16_t *>(data)[i]);
+    case VOXEL_UINT8:
+      return offset + scale * static_cast<const uint8_t *>(data)[i];
+    default:
+      return static_cast<const float *>(data)[i];
+    }
+  }
+
+  // decodes the 8 corners of the cell at base with one format switch
+  void GetCorners(int base, float *corners) const
+  {
+    switch (format) {
+    case VOXEL_HALF16:
+      {
+        const uint16_t *src = static_cast<const uint16_t *>(data) + base;
+        uint16_t h[8];
+        for (int i = 0; i < 8; i++) {
+          h[i] = src[CORNER_OFFSETS[i]];
+        }
+        HalfToFloatArray(h, 8, corners);
+      }
+      break;
+    case VOXEL_UINT8:
+      {
+        const uint8_t *src = static_cast<const uint8_t *>(data) + base;
+        for (int i = 0; i < 8; i++) {
+          corners[i] = offset + scale * src[CORNER_OFFSETS[i]];
+        }
+      }
+      break;
+    default:
+      {
+        const float *src = static_cast<const float *>(data) + base;
+        for (int i = 0; i < 8; i++) {
+          corners[i] = src[CORNER_OFFSETS[i]];
+        }
+      }
+      break;
+    }
+  }
+
+  void Set(int i, float value)
+  {
+    if (format != VOXEL_FLOAT32 || mapped) {
+      std::vector<float> decoded(BRICK_VOXELS);
+      decode(decoded);
+      encode(VOXEL_FLOAT32, decoded);
+    }
+    values[i] = value;
+  }
+
+  void SetMapped(int fmt, float off, float scl, const void *ptr)
+  {
+    std::vector<float>().swap(values);
+    std::vector<uint16_t>().swap(halves);
+    std::vector<uint8_t>().swap(bytes);
+
+    format = fmt;
+    offset = off;
+    scale = scl;
+    mapped = true;
+    data = ptr;
+  }
+
+  void GetRange(float *min, float *max) const
+  {
+    float vmin = Get(0);
+    float vmax = vmin;
+    for (int i = 1; i < BRICK_VOXELS; i++) {
+      const float v = Get(i);
+      vmin = Min(vmin, v);
+      vmax = Max(vmax, v);
+    }
+    *min = vmin;
+    *max = vmax;
+  }
+
+  void Convert(int to_format)
+  {
+    if (to_format == format) {
+      return;
+    }
+
+    std::vector<float> decoded(BRICK_VOXELS);
+    decode(decoded);
+    encode(to_format, decoded);
+  }
+
+  size_t GetMemoryUsage() const
+  {
+    return sizeof(*this) +
+        values.capacity() * sizeof(float) +
+        halves.capacity() * sizeof(uint16_t) +
+        bytes.capacity() * sizeof(uint8_t);
+  }
+
+  int format;
+  float offset;
+  float scale;
+  bool mapped;
+  const void *data;
+
+private:
+  void decode(std::vector<float> &decoded) const
+  {
+    for (int i = 0; i < BRICK_VOXELS; i++) {
+      decoded[i] = Get(i);
+    }
+  }
+
+  void encode(int to_format, std::vector<float> &decoded)
+  {
+    std::vector<float>().swap(values);
+    std::vector<uint16_t>().swap(halves);
+    std::vector<uint8_t>().swap(bytes);
+    offset = 0;
+    scale = 0;
+
+    switch (to_format) {
+    case VOXEL_HALF16:
+      halves.resize(BRICK_VOXELS);
+      for (int i = 0; i < BRICK_VOXELS; i++) {
+        halves[i] = FloatToHalf(decoded[i]);
+      }
+      data = &halves[0];
+      break;
+
+    case VOXEL_UINT8:
+      {
+        // quantized between min and max of the brick
+        float vmin = decoded[0];
+        float vmax = decoded[0];
+        for (int i = 1; i < BRICK_VOXELS; i++) {
+          vmin = Min(vmin, decoded[i]);
+          vmax = Max(vmax, decoded[i]);
+        }
+        offset = vmin;
+        scale = (vmax - vmin) / 255;
+
+        const float inv_scale = scale > 0 ? 1 / scale : 0;
+        bytes.resize(BRICK_VOXELS);
+        for (int i = 0; i < BRICK_VOXELS; i++) {
+          const float q = (decoded[i] - offset) * inv_scale + .5f;
+          bytes[i] = static_cast<uint8_t>(Clamp(q, 0, 255));
+        }
+        data = &bytes[0];
+      }
+      break;
+
+    default:
+      values.swap(decoded);
+      data = &values[0];
+      break;
+    }
+
+    format = to_format;
+    mapped = false;
+  }
+
+  std::vector<float> values;
+  std::vector<uint16_t> halves;
+  std::vector<uint8_t> bytes;
+};
+
+class VoxelTile {
+public:
+  VoxelTile()
+  {
+    for (int i = 0; i < TILE_BRICKS; i++) {
+      bricks[i].store(NULL, std::memory_order_relaxed);
+    }
+  }
+  ~VoxelTile()
+  {
+    for (int i = 0; i < TILE_BRICKS; i++) {
+      delete bricks[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<VoxelBrick*> bricks[TILE_BRICKS];
+};
+
+static inline int brick_index(int x, int y, int z)
+{
+  const int bx = (x >> BRICK_BITS) & TILE_MASK;
+  const int by = (y >> BRICK_BITS) & TILE_MASK;
+  const int bz = (z >> BRICK_BITS) & TILE_MASK;
+  return (bz * TILE_SIZE + by) * TILE_SIZE + bx;
+}
+
+static inline int voxel_index(int x, int y, int z)
+{
+  return ((z & BRICK_MASK) * BRICK_SIZE + (y & BRICK_MASK)) * BRICK_SIZE + (x & BRICK_MASK);
+}
+
+// allocates with compare and swap so that concurrent writers
+// agree on a single instance
+template<typename T>
+static T *get_or_new(std::atomic<T*> &slot, bool *created)
+{
+  T *ptr = slot.load(std::memory_order_acquire);
+  *created = false;
+
+  if (ptr != NULL) {
+    return ptr;
+  }
+
+  T *new_ptr = new T();
+  if (slot.compare_exchange_strong(ptr, new_ptr,
+        std::memory_order_acq_rel, std::memory_order_acquire)) {
+    *created = true;
+    return new_ptr;
+  }
+
+  delete new_ptr;
+  return ptr;
+}
+
+VoxelBuffer::VoxelBuffer() :
+    tiles_(), brick_count_(0), format_(VOXEL_FLOAT32), res_(),
+    mapping_(NULL), mapping_size_(0)
 {
+  ntiles_[0] = 0;
+  ntiles_[1] = 0;
+  ntiles_[2] = 0;
 }
 
 VoxelBuffer::~VoxelBuffer()
 {
+  clear_tiles();
 }
 
 void VoxelBuffer::Resize(int xres, int yres, int zres)
 {
-  data_.resize(xres * yres * zres, 0);
+  clear_tiles();
+
+  ntiles_[0] = (xres + (1 << TILE_SHIFT) - 1) >> TILE_SHIFT;
+  ntiles_[1] = (yres + (1 << TILE_SHIFT) - 1) >> TILE_SHIFT;
+  ntiles_[2] = (zres + (1 << TILE_SHIFT) - 1) >> TILE_SHIFT;
+
+  std::vector<std::atomic<VoxelTile*>> tiles_tmp(ntiles_[0] * ntiles_[1] * ntiles_[2]);
+  for (size_t i = 0; i < tiles_tmp.size(); i++) {
+    tiles_tmp[i].store(NULL, std::memory_order_relaxed);
+  }
+  tiles_.swap(tiles_tmp);
+
   res_ = Resolution(xres, yres, zres);
 }
 
@@ -27,7 +328,7 @@ const Resolution &VoxelBuffer::GetResolution() const
 
 bool VoxelBuffer::IsEmpty() const
 {
-  return data_.empty();
+  return tiles_.empty();
 }
 
 void VoxelBuffer::SetValue(int x, int y, int z, float value)
@@ -39,8 +340,30 @@ void VoxelBuffer::SetValue(int x, int y, int z, float value)
   if (z < 0 || res_.z <= z)
     return;
 
-  const int64_t index = (z * res_.x * res_.y) + (y * res_.x) + x;
-  data_[index] = value;
+  const int tile_id =
+      ((z >> TILE_SHIFT) * ntiles_[1] + (y >> TILE_SHIFT)) * ntiles_[0] + (x >> TILE_SHIFT);
+  std::atomic<VoxelTile*> &tile_slot = tiles_[tile_id];
+
+  // zero is the default value. no need to allocate
+  if (value == 0) {
+    VoxelTile *tile = tile_slot.load(std::memory_order_acquire);
+    if (tile == NULL)
+      return;
+    VoxelBrick *brick = tile->bricks[brick_index(x, y, z)].load(std::memory_order_acquire);
+    if (brick == NULL)
+      return;
+    brick->Set(voxel_index(x, y, z), value);
+    return;
+  }
+
+  bool created = false;
+  VoxelTile *tile = get_or_new(tile_slot, &created);
+  VoxelBrick *brick = get_or_new(tile->bricks[brick_index(x, y, z)], &created);
+  if (created) {
+    brick_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  brick->Set(voxel_index(x, y, z), value);
 }
 
 float VoxelBuffer::GetValue(int x, int y, int z) const
@@ -52,23 +375,308 @@ float VoxelBuffer::GetValue(int x, int y, int z) const
   if (z < 0 || res_.z <= z)
     return 0;
 
-  const int64_t index = (z * res_.x * res_.y) + (y * res_.x) + x;
-  return data_[index];
+  const int tile_id =
+      ((z >> TILE_SHIFT) * ntiles_[1] + (y >> TILE_SHIFT)) * ntiles_[0] + (x >> TILE_SHIFT);
+  const VoxelTile *tile = tiles_[tile_id].load(std::memory_order_acquire);
+  if (tile == NULL)
+    return 0;
+
+  const VoxelBrick *brick = tile->bricks[brick_index(x, y, z)].load(std::memory_order_acquire);
+  if (brick == NULL)
+    return 0;
+
+  return brick->Get(voxel_index(x, y, z));
+}
+
+void VoxelBuffer::GetCornerValues(int x, int y, int z, float *values) const
+{
+  // all 8 voxels are in one brick unless the corner is on the last slice
+  const bool in_brick =
+      x >= 0 && x + 1 < res_.x && (x & BRICK_MASK) != BRICK_MASK &&
+      y >= 0 && y + 1 < res_.y && (y & BRICK_MASK) != BRICK_MASK &&
+      z >= 0 && z + 1 < res_.z && (z & BRICK_MASK) != BRICK_MASK;
+
+  if (!in_brick) {
+    for (int i = 0; i < 8; i++) {
+      values[i] = GetValue(x + (i >> 2), y + ((i >> 1) & 1), z + (i & 1));
+    }
+    return;
+  }
+
+  const int tile_id =
+      ((z >> TILE_SHIFT) * ntiles_[1] + (y >> TILE_SHIFT)) * ntiles_[0] + (x >> TILE_SHIFT);
+  const VoxelTile *tile = tiles_[tile_id].load(std::memory_order_acquire);
+  const VoxelBrick *brick = tile == NULL ? NULL :
+      tile->bricks[brick_index(x, y, z)].load(std::memory_order_acquire);
+
+  if (brick == NULL) {
+    for (int i = 0; i < 8; i++) {
+      values[i] = 0;
+    }
+    return;
+  }
+
+  brick->GetCorners(voxel_index(x, y, z), values);
+}
+
+void VoxelBuffer::GetCornerValues(const int *x, const int *y, const int *z,
+    int count, float *values) const
+{
+  const VoxelBrick *brick = NULL;
+  int brick_x = -1, brick_y = -1, brick_z = -1;
+
+  for (int n = 0; n < count; n++) {
+    float *corners = &values[8 * n];
+    const bool in_brick =
+        x[n] >= 0 && x[n] + 1 < res_.x && (x[n] & BRICK_MASK) != BRICK_MASK &&
+        y[n] >= 0 && y[n] + 1 < res_.y && (y[n] & BRICK_MASK) != BRICK_MASK &&
+        z[n] >= 0 && z[n] + 1 < res_.z && (z[n] & BRICK_MASK) != BRICK_MASK;
+
+    if (!in_brick) {
+      GetCornerValues(x[n], y[n], z[n], corners);
+      continue;
+    }
+
+    const int bx = x[n] >> BRICK_BITS;
+    const int by = y[n] >> BRICK_BITS;
+    const int bz = z[n] >> BRICK_BITS;
+    if (bx != brick_x || by != brick_y || bz != brick_z) {
+      const int tile_id =
+          ((z[n] >> TILE_SHIFT) * ntiles_[1] + (y[n] >> TILE_SHIFT)) * ntiles_[0] +
+          (x[n] >> TILE_SHIFT);
+      const VoxelTile *tile = tiles_[tile_id].load(std::memory_order_acquire);
+      brick = tile == NULL ? NULL :
+          tile->bricks[brick_index(x[n], y[n], z[n])].load(std::memory_order_acquire);
+      brick_x = bx;
+      brick_y = by;
+      brick_z = bz;
+    }
+
+    if (brick == NULL) {
+      for (int i = 0; i < 8; i++) {
+        corners[i] = 0;
+      }
+      continue;
+    }
+
+    brick->GetCorners(voxel_index(x[n], y[n], z[n]), corners);
+  }
+}
+
+void VoxelBuffer::SetFormat(int format)
+{
+  switch (format) {
+  case VOXEL_FLOAT32:
+  case VOXEL_HALF16:
+  case VOXEL_UINT8:
+    format_ = format;
+    break;
+  default:
+    format_ = VOXEL_FLOAT32;
+    break;
+  }
+}
+
+int VoxelBuffer::GetFormat() const
+{
+  return format_;
+}
+
+void VoxelBuffer::Compact()
+{
+  for (size_t t = 0; t < tiles_.size(); t++) {
+    VoxelTile *tile = tiles_[t].load(std::memory_order_relaxed);
+    if (tile == NULL)
+      continue;
+
+    for (int b = 0; b < TILE_BRICKS; b++) {
+      VoxelBrick *brick = tile->bricks[b].load(std::memory_order_relaxed);
+      if (brick == NULL)
+        continue;
+
+      float vmin = 0, vmax = 0;
+      brick->GetRange(&vmin, &vmax);
+
+      if (vmin == 0 && vmax == 0) {
+        // reads as zero without the brick
+        delete brick;
+        tile->bricks[b].store(NULL, std::memory_order_relaxed);
+        brick_count_.fetch_sub(1, std::memory_order_relaxed);
+        continue;
+      }
+
+      brick->Convert(format_);
+    }
+  }
+}
+
+size_t VoxelBuffer::GetAllocatedBrickCount() const
+{
+  return brick_count_.load(std::memory_order_relaxed);
+}
+
+size_t VoxelBuffer::GetMemoryUsage() const
+{
+  size_t tile_count = 0;
+  for (size_t i = 0; i < tiles_.size(); i++) {
+    if (tiles_[i].load(std::memory_order_relaxed) != NULL) {
+      tile_count++;
+    }
+  }
+
+  size_t brick_bytes = 0;
+  for (size_t i = 0; i < tiles_.size(); i++) {
+    const VoxelTile *tile = tiles_[i].load(std::memory_order_relaxed);
+    if (tile == NULL)
+      continue;
+    for (int j = 0; j < TILE_BRICKS; j++) {
+      const VoxelBrick *brick = tile->bricks[j].load(std::memory_order_relaxed);
+      if (brick != NULL) {
+        brick_bytes += brick->GetMemoryUsage();
+      }
+    }
+  }
+
+  return tiles_.size() * sizeof(tiles_[0]) +
+      tile_count * sizeof(VoxelTile) +
+      brick_bytes;
+}
+
+void VoxelBuffer::GetBrickResolution(int *bx, int *by, int *bz) const
+{
+  *bx = (res_.x + BRICK_SIZE - 1) >> BRICK_BITS;
+  *by = (res_.y + BRICK_SIZE - 1) >> BRICK_BITS;
+  *bz = (res_.z + BRICK_SIZE - 1) >> BRICK_BITS;
+}
+
+void VoxelBuffer::GetBrickValueRange(int bx, int by, int bz, float *min, float *max) const
+{
+  *min = 0;
+  *max = 0;
+
+  const VoxelBrick *brick = find_brick(bx, by, bz);
+  if (brick == NULL)
+    return;
+
+  brick->GetRange(min, max);
+}
+
+int VoxelBuffer::GetBrickSize()
+{
+  return BRICK_SIZE;
+}
+
+size_t VoxelBuffer::GetBrickDataSize(int format)
+{
+  return BRICK_VOXELS * voxel_data_size(format);
+}
+
+const void *VoxelBuffer::GetBrickData(int bx, int by, int bz,
+    int *format, float *offset, float *scale) const
+{
+  const VoxelBrick *brick = find_brick(bx, by, bz);
+  if (brick == NULL)
+    return NULL;
+
+  *format = brick->format;
+  *offset = brick->offset;
+  *scale = brick->scale;
+  return brick->data;
+}
+
+void VoxelBuffer::SetMappedBrick(int bx, int by, int bz,
+    int format, float offset, float scale, const void *data)
+{
+  const int x = bx << BRICK_BITS;
+  const int y = by << BRICK_BITS;
+  const int z = bz << BRICK_BITS;
+
+  if (x < 0 || res_.x <= x)
+    return;
+  if (y < 0 || res_.y <= y)
+    return;
+  if (z < 0 || res_.z <= z)
+    return;
+
+  const int tile_id =
+      ((z >> TILE_SHIFT) * ntiles_[1] + (y >> TILE_SHIFT)) * ntiles_[0] + (x >> TILE_SHIFT);
+
+  bool created = false;
+  VoxelTile *tile = get_or_new(tiles_[tile_id], &created);
+  VoxelBrick *brick = get_or_new(tile->bricks[brick_index(x, y, z)], &created);
+  if (created) {
+    brick_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  brick->SetMapped(format, offset, scale, data);
+}
+
+void VoxelBuffer::SetMapping(void *addr, size_t size)
+{
+  OsUnmapFile(mapping_, mapping_size_);
+  mapping_ = addr;
+  mapping_size_ = size;
+}
+
+const VoxelBrick *VoxelBuffer::find_brick(int bx, int by, int bz) const
+{
+  const int x = bx << BRICK_BITS;
+  const int y = by << BRICK_BITS;
+  const int z = bz << BRICK_BITS;
+
+  if (x < 0 || res_.x <= x)
+    return NULL;
+  if (y < 0 || res_.y <= y)
+    return NULL;
+  if (z < 0 || res_.z <= z)
+    return NULL;
+
+  const int tile_id =
+      ((z >> TILE_SHIFT) * ntiles_[1] + (y >> TILE_SHIFT)) * ntiles_[0] + (x >> TILE_SHIFT);
+  const VoxelTile *tile = tiles_[tile_id].load(std::memory_order_acquire);
+  if (tile == NULL)
+    return NULL;
+
+  return tile->bricks[brick_index(x, y, z)].load(std::memory_order_acquire);
+}
+
+void VoxelBuffer::clear_tiles()
+{
+  for (size_t i = 0; i < tiles_.size(); i++) {
+    delete tiles_[i].load(std::memory_order_relaxed);
+  }
+  std::vector<std::atomic<VoxelTile*>>().swap(tiles_);
+  brick_count_.store(0, std::memory_order_relaxed);
+
+  // after bricks referring to it are gone
+  OsUnmapFile(mapping_, mapping_size_);
+  mapping_ = NULL;
+  mapping_size_ = 0;
 }
 
+static const int SAMPLE_BATCH_SIZE = 32;
+static const int MAX_MIP_LEVELS = 8;
+
 static float trilinear_buffer_value(const VoxelBuffer &buffer, const Vector &P);
 static float nearest_buffer_value(const VoxelBuffer &buffer, const Vector &P);
 
 Volume::Volume() :
   buffer_(),
   bounds_(),
-  size_()
+  size_(),
+  macro_min_(),
+  macro_max_()
 {
+  macro_res_[0] = 0;
+  macro_res_[1] = 0;
+  macro_res_[2] = 0;
+
   compute_filter_size();
 }
 
 Volume::~Volume()
 {
+  clear_mipmaps();
 }
 
 void Volume::Resize(int xres, int yres, int zres)
@@ -79,6 +687,10 @@ void Volume::Resize(int xres, int yres, int zres)
 
   buffer_.Resize(xres, yres, zres);
   compute_filter_size();
+
+  std::vector<float>().swap(macro_min_);
+  std::vector<float>().swap(macro_max_);
+  clear_mipmaps();
 }
 
 void Volume::SetBounds(const Box &bounds)
@@ -107,6 +719,19 @@ Real Volume::GetFilterSize() const
   return filtersize_;
 }
 
+Vector Volume::GetVoxelSize() const
+{
+  if (buffer_.IsEmpty()) {
+    return Vector(0, 0, 0);
+  }
+
+  const Resolution &res = buffer_.GetResolution();
+  return Vector(
+      size_.x / res.x,
+      size_.y / res.y,
+      size_.z / res.z);
+}
+
 Vector Volume::IndexToPoint(int i, int j, int k) const
 {
   const Resolution &res = buffer_.GetResolution();
@@ -144,6 +769,21 @@ float Volume::GetValue(int x, int y, int z) const
   return buffer_.GetValue(x, y, z);
 }
 
+void Volume::SetVoxelFormat(int format)
+{
+  buffer_.SetFormat(format);
+}
+
+int Volume::GetVoxelFormat() const
+{
+  return buffer_.GetFormat();
+}
+
+void Volume::Compact()
+{
+  buffer_.Compact();
+}
+
 bool Volume::GetSample(const Vector &point, VolumeSample *sample) const
 {
   if (buffer_.IsEmpty()) {
@@ -170,6 +810,506 @@ bool Volume::GetSample(const Vector &point, VolumeSample *sample) const
   return true;
 }
 
+void Volume::GetSamples(const Vector &point, const Vector &step, int count,
+    int level, float *densities) const
+{
+  if (buffer_.IsEmpty()) {
+    for (int i = 0; i < count; i++) {
+      densities[i] = 0;
+    }
+    return;
+  }
+
+  level = Clamp(level, 0, GetMipLevelCount() - 1);
+  const VoxelBuffer &buffer = level == 0 ? buffer_ : *mipmaps_[level - 1];
+  const Real level_scale = 1. / (1 << level);
+
+  // voxel space of the level shifted by half a voxel so that truncation
+  // gives the lowest corner. point and step are mapped once for the batch
+  const Resolution &res = buffer_.GetResolution();
+  const Real scale[3] = {
+      res.x / size_.x * level_scale,
+      res.y / size_.y * level_scale,
+      res.z / size_.z * level_scale};
+  const Real origin[3] = {
+      (point.x - bounds_.min.x) * scale[0] - .5,
+      (point.y - bounds_.min.y) * scale[1] - .5,
+      (point.z - bounds_.min.z) * scale[2] - .5};
+  const Real delta[3] = {
+      step.x * scale[0],
+      step.y * scale[1],
+      step.z * scale[2]};
+  const Real upper[3] = {
+      res.x * level_scale - .5,
+      res.y * level_scale - .5,
+      res.z * level_scale - .5};
+
+  Real P[3][SAMPLE_BATCH_SIZE];
+  int corner[3][SAMPLE_BATCH_SIZE];
+  float weight[3][2][SAMPLE_BATCH_SIZE];
+  float inside[SAMPLE_BATCH_SIZE];
+  float corners[8 * SAMPLE_BATCH_SIZE];
+
+  for (int start = 0; start < count; start += SAMPLE_BATCH_SIZE) {
+    const int N = count - start < SAMPLE_BATCH_SIZE ? count - start : SAMPLE_BATCH_SIZE;
+
+    // positions, bounds test, lowest corners and weights. branch free
+    // loops over arrays so that the compiler can vectorize them
+    for (int i = 0; i < N; i++) {
+      inside[i] = 1;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+      for (int i = 0; i < N; i++) {
+        P[axis][i] = origin[axis] + (start + i) * delta[axis];
+      }
+      for (int i = 0; i < N; i++) {
+        const Real p = P[axis][i];
+        inside[i] *= (p >= -.5 && p <= upper[axis]) ? 1 : 0;
+        // keeps truncation in int range for points far outside
+        P[axis][i] = p < -1 ? -1 : (p > upper[axis] + 1 ? upper[axis] + 1 : p);
+      }
+      for (int i = 0; i < N; i++) {
+        corner[axis][i] = (int) P[axis][i];
+      }
+      for (int i = 0; i < N; i++) {
+        weight[axis][0][i] = 1 - fabs(P[axis][i] - corner[axis][i]);
+        weight[axis][1][i] = 1 - fabs(P[axis][i] - (corner[axis][i] + 1));
+      }
+    }
+
+    buffer.GetCornerValues(corner[0], corner[1], corner[2], N, corners);
+
+    for (int n = 0; n < N; n++) {
+      const float *c = &corners[8 * n];
+      float value = 0;
+
+      for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+          for (int k = 0; k < 2; k++) {
+            value += weight[0][i][n] * weight[1][j][n] * weight[2][k][n] *
+                c[(i * 2 + j) * 2 + k];
+          }
+        }
+      }
+      densities[start + n] = inside[n] * value;
+    }
+  }
+}
+
+void Volume::BuildMipmaps()
+{
+  clear_mipmaps();
+
+  if (buffer_.IsEmpty()) {
+    return;
+  }
+
+  const VoxelBuffer *fine = &buffer_;
+
+  for (int level = 1; level < MAX_MIP_LEVELS; level++) {
+    const Resolution &fine_res = fine->GetResolution();
+    if (fine_res.x == 1 && fine_res.y == 1 && fine_res.z == 1) {
+      break;
+    }
+
+    VoxelBuffer *coarse = new VoxelBuffer();
+    coarse->Resize(
+        (fine_res.x + 1) / 2,
+        (fine_res.y + 1) / 2,
+        (fine_res.z + 1) / 2);
+    coarse->SetFormat(buffer_.GetFormat());
+
+    const Resolution &res = coarse->GetResolution();
+    for (int z = 0; z < res.z; z++) {
+      for (int y = 0; y < res.y; y++) {
+        for (int x = 0; x < res.x; x++) {
+          float corners[8];
+          fine->GetCornerValues(2 * x, 2 * y, 2 * z, corners);
+
+          // box filter over children inside the finer level
+          float sum = 0;
+          int nchildren = 0;
+          for (int i = 0; i < 8; i++) {
+            const int xx = 2 * x + (i >> 2);
+            const int yy = 2 * y + ((i >> 1) & 1);
+            const int zz = 2 * z + (i & 1);
+            if (xx < fine_res.x && yy < fine_res.y && zz < fine_res.z) {
+              sum += corners[i];
+              nchildren++;
+            }
+          }
+
+          if (sum != 0) {
+            coarse->SetValue(x, y, z, sum / nchildren);
+          }
+        }
+      }
+    }
+    coarse->Compact();
+
+    mipmaps_.push_back(coarse);
+    fine = coarse;
+  }
+}
+
+int Volume::GetMipLevelCount() const
+{
+  return 1 + static_cast<int>(mipmaps_.size());
+}
+
+void Volume::clear_mipmaps()
+{
+  for (size_t i = 0; i < mipmaps_.size(); i++) {
+    delete mipmaps_[i];
+  }
+  mipmaps_.clear();
+}
+
+void Volume::ComputeMacroGrid()
+{
+  int XN = 0, YN = 0, ZN = 0;
+  buffer_.GetBrickResolution(&XN, &YN, &ZN);
+
+  std::vector<float> brick_min(XN * YN * ZN, 0);
+  std::vector<float> brick_max(XN * YN * ZN, 0);
+
+  for (int z = 0; z < ZN; z++) {
+    for (int y = 0; y < YN; y++) {
+      for (int x = 0; x < XN; x++) {
+        const int id = (z * YN + y) * XN + x;
+        buffer_.GetBrickValueRange(x, y, z, &brick_min[id], &brick_max[id]);
+      }
+    }
+  }
+
+  // trilinear filter reads one voxel across brick borders, so each cell
+  // takes the range of its neighbors. outside of buffer is zero
+  std::vector<float> min_tmp(XN * YN * ZN, 0);
+  std::vector<float> max_tmp(XN * YN * ZN, 0);
+
+  for (int z = 0; z < ZN; z++) {
+    for (int y = 0; y < YN; y++) {
+      for (int x = 0; x < XN; x++) {
+        float vmin = REAL_MAX;
+        float vmax = -REAL_MAX;
+
+        for (int k = z - 1; k <= z + 1; k++) {
+          for (int j = y - 1; j <= y + 1; j++) {
+            for (int i = x - 1; i <= x + 1; i++) {
+              if (i < 0 || XN <= i || j < 0 || YN <= j || k < 0 || ZN <= k) {
+                vmin = Min(vmin, 0);
+                vmax = Max(vmax, 0);
+                continue;
+              }
+              const int id = (k * YN + j) * XN + i;
+              vmin = Min(vmin, brick_min[id]);
+              vmax = Max(vmax, brick_max[id]);
+            }
+          }
+        }
+
+        const int id = (z * YN + y) * XN + x;
+        min_tmp[id] = vmin;
+        max_tmp[id] = vmax;
+      }
+    }
+  }
+
+  macro_min_.swap(min_tmp);
+  macro_max_.swap(max_tmp);
+  macro_res_[0] = XN;
+  macro_res_[1] = YN;
+  macro_res_[2] = ZN;
+}
+
+bool Volume::HasMacroGrid() const
+{
+  return !macro_max_.empty();
+}
+
+void Volume::GetMacroGridResolution(int *i, int *j, int *k) const
+{
+  *i = macro_res_[0];
+  *j = macro_res_[1];
+  *k = macro_res_[2];
+}
+
+float Volume::GetMacroCellMin(int i, int j, int k) const
+{
+  if (i < 0 || macro_res_[0] <= i)
+    return 0;
+  if (j < 0 || macro_res_[1] <= j)
+    return 0;
+  if (k < 0 || macro_res_[2] <= k)
+    return 0;
+
+  return macro_min_[(k * macro_res_[1] + j) * macro_res_[0] + i];
+}
+
+float Volume::GetMacroCellMax(int i, int j, int k) const
+{
+  if (i < 0 || macro_res_[0] <= i)
+    return 0;
+  if (j < 0 || macro_res_[1] <= j)
+    return 0;
+  if (k < 0 || macro_res_[2] <= k)
+    return 0;
+
+  return macro_max_[(k * macro_res_[1] + j) * macro_res_[0] + i];
+}
+
+// 3D DDA over macro cells
+class MacroCellWalker {
+public:
+  MacroCellWalker(const Volume &volume,
+      const Vector &orig, const Vector &dir, Real t_begin, Real t_end) :
+      macro_res_(volume.macro_res_), t_(t_begin), t_end_(t_end), done_(false)
+  {
+    const Resolution &res = volume.buffer_.GetResolution();
+    const Vector cells_per_unit(
+        res.x / (volume.size_.x * BRICK_SIZE),
+        res.y / (volume.size_.y * BRICK_SIZE),
+        res.z / (volume.size_.z * BRICK_SIZE));
+    const Vector start = orig + t_begin * dir;
+
+    for (int i = 0; i < 3; i++) {
+      const Real G = (start[i] - volume.bounds_.min[i]) * cells_per_unit[i];
+      const Real dG = dir[i] * cells_per_unit[i];
+
+      cell_id_[i] = static_cast<int>(Floor(G));
+      cell_id_[i] = Clamp(cell_id_[i], 0, macro_res_[i] - 1);
+
+      if (dG > 0) {
+        t_next_[i] = t_begin + (cell_id_[i] + 1 - G) / dG;
+        t_delta_[i] = 1 / dG;
+        cell_step_[i] = +1;
+        cell_end_[i] = macro_res_[i];
+      }
+      else if (dG < 0) {
+        t_next_[i] = t_begin + (cell_id_[i] - G) / dG;
+        t_delta_[i] = -1 / dG;
+        cell_step_[i] = -1;
+        cell_end_[i] = -1;
+      }
+      else {
+        t_next_[i] = REAL_MAX;
+        t_delta_[i] = 0;
+        cell_step_[i] = 0;
+        cell_end_[i] = -1;
+      }
+    }
+  }
+  ~MacroCellWalker() {}
+
+  // returns current cell and its range [t0, t1] then moves to next cell
+  bool Next(int *cell_index, Real *t0, Real *t1)
+  {
+    if (done_) {
+      return false;
+    }
+
+    int axis = 0;
+    if (t_next_[1] < t_next_[axis])
+      axis = 1;
+    if (t_next_[2] < t_next_[axis])
+      axis = 2;
+
+    *cell_index = (cell_id_[2] * macro_res_[1] + cell_id_[1]) * macro_res_[0] + cell_id_[0];
+    *t0 = t_;
+    *t1 = Min(t_next_[axis], t_end_);
+
+    if (t_next_[axis] >= t_end_) {
+      done_ = true;
+      return true;
+    }
+
+    cell_id_[axis] += cell_step_[axis];
+    if (cell_id_[axis] == cell_end_[axis]) {
+      // rest of the ray is outside due to round off
+      *t1 = t_end_;
+      done_ = true;
+      return true;
+    }
+    t_ = t_next_[axis];
+    t_next_[axis] += t_delta_[axis];
+
+    return true;
+  }
+
+private:
+  const int *macro_res_;
+  int cell_id_[3];
+  int cell_step_[3];
+  int cell_end_[3];
+  Real t_next_[3];
+  Real t_delta_[3];
+  Real t_;
+  Real t_end_;
+  bool done_;
+};
+
+static bool clip_ray_by_bounds(const Box &bounds,
+    const Vector &orig, const Vector &dir, Real tmin, Real tmax,
+    Real *t_begin, Real *t_end)
+{
+  Real boxhit_tmin = 0;
+  Real boxhit_tmax = 0;
+  if (!BoxRayIntersect(bounds, orig, dir, tmin, tmax, &boxhit_tmin, &boxhit_tmax)) {
+    return false;
+  }
+
+  *t_begin = Max(boxhit_tmin, tmin);
+  *t_end = Min(boxhit_tmax, tmax);
+
+  return *t_begin < *t_end;
+}
+
+int Volume::FindOccupiedIntervals(const Vector &orig, const Vector &dir,
+    Real tmin, Real tmax, const ObjectInstance *object,
+    IntervalList *intervals) const
+{
+  if (buffer_.IsEmpty()) {
+    return 0;
+  }
+
+  Real t_begin = 0;
+  Real t_end = 0;
+  if (!clip_ray_by_bounds(bounds_, orig, dir, tmin, tmax, &t_begin, &t_end)) {
+    return 0;
+  }
+
+  Interval interval;
+  interval.object = object;
+
+  if (!HasMacroGrid()) {
+    interval.tmin = t_begin;
+    interval.tmax = t_end;
+    intervals->Push(interval);
+    return 1;
+  }
+
+  MacroCellWalker walker(*this, orig, dir, t_begin, t_end);
+  int count = 0;
+  bool in_interval = false;
+  int id = 0;
+  Real t0 = 0, t1 = 0;
+
+  while (walker.Next(&id, &t0, &t1)) {
+    const bool occupied = macro_max_[id] > 0 || macro_min_[id] < 0;
+
+    if (occupied && !in_interval) {
+      interval.tmin = t0;
+      in_interval = true;
+    }
+    else if (!occupied && in_interval) {
+      interval.tmax = t0;
+      intervals->Push(interval);
+      in_interval = false;
+      count++;
+    }
+  }
+
+  if (in_interval) {
+    interval.tmax = t_end;
+    intervals->Push(interval);
+    count++;
+  }
+
+  return count;
+}
+
+bool Volume::SampleFreeFlight(const Vector &orig, const Vector &dir,
+    Real tmin, Real tmax, XorShift *rng, Real *t_collision) const
+{
+  if (buffer_.IsEmpty() || !HasMacroGrid()) {
+    return false;
+  }
+
+  Real t_begin = 0;
+  Real t_end = 0;
+  if (!clip_ray_by_bounds(bounds_, orig, dir, tmin, tmax, &t_begin, &t_end)) {
+    return false;
+  }
+
+  MacroCellWalker walker(*this, orig, dir, t_begin, t_end);
+  int id = 0;
+  Real t0 = 0, t1 = 0;
+
+  while (walker.Next(&id, &t0, &t1)) {
+    const Real majorant = macro_max_[id];
+    if (majorant <= 0) {
+      continue;
+    }
+
+    // tentative collisions with majorant
+    Real t = t0;
+    for (;;) {
+      t -= log(1 - rng->NextFloat01()) / majorant;
+      if (t >= t1) {
+        break;
+      }
+
+      VolumeSample sample;
+      GetSample(orig + t * dir, &sample);
+
+      if (rng->NextFloat01() * majorant < sample.density) {
+        *t_collision = t;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+Real Volume::EstimateTransmittance(const Vector &orig, const Vector &dir,
+    Real tmin, Real tmax, XorShift *rng) const
+{
+  if (buffer_.IsEmpty() || !HasMacroGrid()) {
+    return 1;
+  }
+
+  Real t_begin = 0;
+  Real t_end = 0;
+  if (!clip_ray_by_bounds(bounds_, orig, dir, tmin, tmax, &t_begin, &t_end)) {
+    return 1;
+  }
+
+  MacroCellWalker walker(*this, orig, dir, t_begin, t_end);
+  Real transmittance = 1;
+  int id = 0;
+  Real t0 = 0, t1 = 0;
+
+  while (walker.Next(&id, &t0, &t1)) {
+    const Real majorant = macro_max_[id];
+    if (majorant <= 0) {
+      continue;
+    }
+
+    Real t = t0;
+    for (;;) {
+      t -= log(1 - rng->NextFloat01()) / majorant;
+      if (t >= t1) {
+        break;
+      }
+
+      VolumeSample sample;
+      GetSample(orig + t * dir, &sample);
+      transmittance *= 1 - Clamp(sample.density / majorant, 0, 1);
+
+      // russian roulette keeps the estimate unbiased
+      if (transmittance < .1) {
+        if (rng->NextFloat01() < .5) {
+          return 0;
+        }
+        transmittance *= 2;
+      }
+    }
+  }
+
+  return transmittance;
+}
+
 void Volume::compute_filter_size()
 {
   if (buffer_.IsEmpty()) {
@@ -217,6 +1357,9 @@ static float trilinear_buffer_value(const VoxelBuffer &buffer, const Vector &P)
       (int) P_sample[1],
       (int) P_sample[2]};
 
+  float corners[8];
+  buffer.GetCornerValues(lowest_corner[0], lowest_corner[1], lowest_corner[2], corners);
+
   int x, y, z;
   float weight[3];
   float value = 0;
@@ -233,7 +1376,7 @@ static float trilinear_buffer_value(const VoxelBuffer &buffer, const Vector &P)
         z = lowest_corner[2] + k;
         weight[2] = 1 - fabs(P_sample[2] - z);
 
-        value += weight[0] * weight[1] * weight[2] * buffer.GetValue(x, y, z);
+        value += weight[0] * weight[1] * weight[2] * corners[(i * 2 + j) * 2 + k];
       }
     }
   }
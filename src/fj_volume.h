@@ -8,7 +8,9 @@
 #include "fj_vector.h"
 #include "fj_types.h"
 #include "fj_box.h"
+#include <cstddef>
 #include <vector>
+#include <atomic>
 
 namespace fj {
 
@@ -21,6 +23,18 @@ public:
   int x, y, z;
 };
 
+class VoxelTile;
+class VoxelBrick;
+
+enum VoxelFormat {
+  VOXEL_FLOAT32 = 0,
+  VOXEL_HALF16,
+  VOXEL_UINT8
+};
+
+// Sparse voxel storage. Voxels are grouped into 8^3 bricks and bricks into
+// 16^3 tiles. Tiles and bricks are allocated on first non-zero write, and
+// untouched regions read as zero. Writes to different voxels are thread safe.
 class FJ_API VoxelBuffer {
 public:
   VoxelBuffer();
@@ -32,10 +46,52 @@ public:
 
   void SetValue(int x, int y, int z, float value);
   float GetValue(int x, int y, int z) const;
+  // values of (x, y, z) to (x+1, y+1, z+1) with z running fastest
+  void GetCornerValues(int x, int y, int z, float *values) const;
+  // batch of corner values for count lowest corners. 8 values per corner.
+  // consecutive corners in the same brick share one brick lookup
+  void GetCornerValues(const int *x, const int *y, const int *z, int count,
+      float *values) const;
+
+  // storage of bricks after Compact. half floats or 8 bits quantized
+  // between min and max of each brick. writing to a compacted brick
+  // expands it back to floats and is not thread safe
+  void SetFormat(int format);
+  int GetFormat() const;
+  void Compact();
+
+  size_t GetAllocatedBrickCount() const;
+  size_t GetMemoryUsage() const;
+
+  // value range of brick (bx, by, bz). both are 0 for unallocated bricks
+  void GetBrickResolution(int *bx, int *by, int *bz) const;
+  void GetBrickValueRange(int bx, int by, int bz, float *min, float *max) const;
+
+  // raw brick access for volume files. mapped bricks refer to memory
+  // owned by the buffer through SetMapping and expand on write
+  static int GetBrickSize();
+  static size_t GetBrickDataSize(int format);
+  const void *GetBrickData(int bx, int by, int bz,
+      int *format, float *offset, float *scale) const;
+  void SetMappedBrick(int bx, int by, int bz,
+      int format, float offset, float scale, const void *data);
+  void SetMapping(void *addr, size_t size);
 
 private:
-  std::vector<float> data_;
+  VoxelBuffer(const VoxelBuffer &);
+  const VoxelBuffer &operator=(const VoxelBuffer &);
+
+  void clear_tiles();
+  const VoxelBrick *find_brick(int bx, int by, int bz) const;
+
+  std::vector<std::atomic<VoxelTile*>> tiles_;
+  std::atomic<size_t> brick_count_;
+  int format_;
+  int ntiles_[3];
   Resolution res_;
+
+  void *mapping_;
+  size_t mapping_size_;
 };
 
 class FJ_API VolumeSample {
@@ -46,6 +102,10 @@ public:
   float density;
 };
 
+class IntervalList;
+class ObjectInstance;
+class XorShift;
+
 class FJ_API Volume {
 public:
   Volume();
@@ -58,6 +118,7 @@ public:
 
   void GetResolution(int *i, int *j, int *k) const;
   Real GetFilterSize() const;
+  Vector GetVoxelSize() const;
 
   Vector IndexToPoint(int i, int j, int k) const;
   void PointToIndex(const Vector &point, int *i, int *j, int *k) const;
@@ -65,16 +126,60 @@ public:
   void SetValue(int x, int y, int z, float value);
   float GetValue(int x, int y, int z) const;
 
+  // converts voxels into the compact format once filling is done
+  void SetVoxelFormat(int format);
+  int GetVoxelFormat() const;
+  void Compact();
+
   bool GetSample(const Vector &point, VolumeSample *sample) const;
+  // densities at count points of point + i * step in object space from
+  // mip level. points outside bounds get zero density
+  void GetSamples(const Vector &point, const Vector &step, int count,
+      int level, float *densities) const;
+
+  // mip pyramid of densities for blurry lookups. each level halves the
+  // resolution of the previous one. level 0 is the voxels themselves.
+  // needs to be rebuilt after voxel values change
+  void BuildMipmaps();
+  int GetMipLevelCount() const;
+
+  // coarse min/max density per brick for empty space skipping.
+  // needs to be recomputed after voxel values change
+  void ComputeMacroGrid();
+  bool HasMacroGrid() const;
+  void GetMacroGridResolution(int *i, int *j, int *k) const;
+  float GetMacroCellMin(int i, int j, int k) const;
+  float GetMacroCellMax(int i, int j, int k) const;
+
+  // pushes intervals of ray [tmin, tmax] in object space where density
+  // can be non-zero. the whole overlap with bounds without macro grid
+  int FindOccupiedIntervals(const Vector &orig, const Vector &dir,
+      Real tmin, Real tmax, const ObjectInstance *object,
+      IntervalList *intervals) const;
+
+  // delta tracking with macro grid as majorant. returns true with the
+  // distance to the first real collision in [tmin, tmax]
+  bool SampleFreeFlight(const Vector &orig, const Vector &dir,
+      Real tmin, Real tmax, XorShift *rng, Real *t_collision) const;
+  // ratio tracking estimate of transmittance along [tmin, tmax]
+  Real EstimateTransmittance(const Vector &orig, const Vector &dir,
+      Real tmin, Real tmax, XorShift *rng) const;
 
 public:
   void compute_filter_size();
+  void clear_mipmaps();
 
   VoxelBuffer buffer_;
   Box bounds_;
   Vector size_;
 
   Real filtersize_;
+
+  std::vector<float> macro_min_;
+  std::vector<float> macro_max_;
+  int macro_res_[3];
+
+  std::vector<VoxelBuffer *> mipmaps_;
 };
 
 FJ_API void VolGetIndexRange(const Volume *volume,
@@ -2,10 +2,13 @@
 // See LICENSE and README
 
 #include "fj_volume_filling.h"
+#include "fj_multi_thread.h"
 #include "fj_numeric.h"
 #include "fj_vector.h"
 #include "fj_volume.h"
 
+#include <vector>
+
 #define VEC3_BILERP(dst,v00,v10,v01,v11,s,t) do { \
   (dst)->x = Bilerp((v00)->x, (v10)->x, (v01)->x, (v11)->x, (s), (t)); \
   (dst)->y = Bilerp((v00)->y, (v10)->y, (v01)->y, (v11)->y, (s), (t)); \
@@ -61,18 +64,14 @@ void BilerpWispConstrolPoint(WispsControlPoint *cp,
       cp01->speck_radius, cp11->speck_radius, s, t);
 }
 
-void FillWithSphere(Volume *volume,
-    const Vector *center, Real radius, float density)
+static void fill_sphere_range(Volume *volume,
+    const Vector *center, Real radius, float density,
+    int xmin, int ymin, int zmin,
+    int xmax, int ymax, int zmax)
 {
   int i, j, k;
-  int xmin, ymin, zmin;
-  int xmax, ymax, zmax;
   const Real thresholdwidth = .5 * volume->GetFilterSize();
 
-  VolGetIndexRange(volume, center, radius,
-      &xmin, &ymin, &zmin,
-      &xmax, &ymax, &zmax);
-
   for (k = zmin; k <= zmax; k++) {
     for (j = ymin; j <= ymax; j++) {
       for (i = xmin; i <= xmax; i++) {
@@ -94,4 +93,102 @@ void FillWithSphere(Volume *volume,
   }
 }
 
+void FillWithSphere(Volume *volume,
+    const Vector *center, Real radius, float density)
+{
+  int xmin, ymin, zmin;
+  int xmax, ymax, zmax;
+
+  VolGetIndexRange(volume, center, radius,
+      &xmin, &ymin, &zmin,
+      &xmax, &ymax, &zmax);
+
+  fill_sphere_range(volume, center, radius, density,
+      xmin, ymin, zmin,
+      xmax, ymax, zmax);
+}
+
+// slab thickness matches voxel bricks so that slabs do not share bricks
+static const int SLAB_BITS = 3;
+
+class SphereFilling {
+public:
+  SphereFilling() : volume(NULL), spheres(NULL), slab_spheres() {}
+  ~SphereFilling() {}
+
+  Volume *volume;
+  const VolumeSphere *spheres;
+  std::vector<std::vector<int>> slab_spheres;
+};
+
+static LoopStatus fill_slab(void *data, const ThreadContext &context)
+{
+  SphereFilling *filling = reinterpret_cast<SphereFilling *>(data);
+  Volume *volume = filling->volume;
+
+  const int slab_id = context.iteration_id;
+  const int slab_min = slab_id << SLAB_BITS;
+  const int slab_max = slab_min + (1 << SLAB_BITS) - 1;
+  const std::vector<int> &sphere_ids = filling->slab_spheres[slab_id];
+
+  for (size_t i = 0; i < sphere_ids.size(); i++) {
+    const VolumeSphere &sphere = filling->spheres[sphere_ids[i]];
+    int xmin, ymin, zmin;
+    int xmax, ymax, zmax;
+
+    VolGetIndexRange(volume, &sphere.center, sphere.radius,
+        &xmin, &ymin, &zmin,
+        &xmax, &ymax, &zmax);
+
+    fill_sphere_range(volume, &sphere.center, sphere.radius, sphere.density,
+        xmin, ymin, Max(zmin, slab_min),
+        xmax, ymax, Min(zmax, slab_max));
+  }
+
+  return LoopStatus::Continue;
+}
+
+void FillWithSpheres(Volume *volume,
+    const VolumeSphere *spheres, int nspheres, int thread_count)
+{
+  int xres, yres, zres;
+  volume->GetResolution(&xres, &yres, &zres);
+
+  const int nslabs = (zres + (1 << SLAB_BITS) - 1) >> SLAB_BITS;
+  if (nslabs < 1) {
+    return;
+  }
+
+  SphereFilling filling;
+  filling.volume = volume;
+  filling.spheres = spheres;
+  filling.slab_spheres.resize(nslabs);
+
+  // sphere order is kept in each slab so the sums match serial filling
+  for (int i = 0; i < nspheres; i++) {
+    int xmin, ymin, zmin;
+    int xmax, ymax, zmax;
+
+    VolGetIndexRange(volume, &spheres[i].center, spheres[i].radius,
+        &xmin, &ymin, &zmin,
+        &xmax, &ymax, &zmax);
+
+    zmin = Max(zmin, 0);
+    zmax = Min(zmax, zres - 1);
+
+    for (int slab = zmin >> SLAB_BITS; slab <= zmax >> SLAB_BITS; slab++) {
+      filling.slab_spheres[slab].push_back(i);
+    }
+  }
+
+  std::vector<int> iteration_que;
+  for (int i = 0; i < nslabs; i++) {
+    if (!filling.slab_spheres[i].empty()) {
+      iteration_que.push_back(i);
+    }
+  }
+
+  MtRunParallelLoop(&filling, fill_slab, thread_count, iteration_que);
+}
+
 } // namespace xxx
@@ -58,9 +58,25 @@ FJ_API void BilerpWispConstrolPoint(WispsControlPoint *cp,
     const WispsControlPoint *cp01, const WispsControlPoint *cp11,
     Real s, Real t);
 
+class FJ_API VolumeSphere {
+public:
+  VolumeSphere() : center(), radius(0), density(0) {}
+  ~VolumeSphere() {}
+
+public:
+  Vector center;
+  Real radius;
+  float density;
+};
+
 FJ_API void FillWithSphere(Volume *volume,
     const Vector *center, Real radius, float density);
 
+// same as calling FillWithSphere for each sphere in order, but in parallel.
+// voxels are split into z-slabs and each slab is filled by one thread
+FJ_API void FillWithSpheres(Volume *volume,
+    const VolumeSphere *spheres, int nspheres, int thread_count);
+
 } // namespace xxx
 
 #endif // FJ_XXX_H
@@ -0,0 +1,268 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "fj_volume_io.h"
+#include "fj_volume.h"
+#include "fj_os.h"
+
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#define VOL_FILE_VERSION 1
+#define VOL_FILE_MAGIC "fjvol"
+#define VOL_MAGIC_SIZE 8
+
+namespace fj {
+
+// brick data is aligned so that mapped voxels can be read in place
+static const size_t DATA_ALIGNMENT = 64;
+
+class VolFileHeader {
+public:
+  VolFileHeader() :
+      version(0), brick_size(0), format(0), reserved(0),
+      brick_count(0), offset_of_table(0)
+  {
+    memset(magic, 0, sizeof(magic));
+    memset(resolution, 0, sizeof(resolution));
+    memset(bounds, 0, sizeof(bounds));
+  }
+
+  char magic[VOL_MAGIC_SIZE];
+  int32_t version;
+  int32_t resolution[3];
+  int32_t brick_size;
+  int32_t format;
+  int32_t reserved;
+  double bounds[6];
+  int64_t brick_count;
+  int64_t offset_of_table;
+};
+
+class VolBrickEntry {
+public:
+  VolBrickEntry() :
+      format(0), offset(0), scale(0), data_offset(0)
+  {
+    memset(index, 0, sizeof(index));
+  }
+
+  int32_t index[3];
+  int32_t format;
+  float offset;
+  float scale;
+  int64_t data_offset;
+};
+
+static int error_no = ERR_VOL_NOERR;
+
+static void set_error(int err)
+{
+  error_no = err;
+}
+
+static size_t align_offset(size_t offset)
+{
+  return (offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+}
+
+int VolGetErrorNo(void)
+{
+  return error_no;
+}
+
+const char *VolGetErrorMessage(int err)
+{
+  static const char *errmsg[] = {
+    "",                     // ERR_VOL_NOERR
+    "No such file",         // ERR_VOL_NOFILE
+    "Not volume file",      // ERR_VOL_NOTVOL
+    "Invalid file version", // ERR_VOL_BADVER
+    "Broken volume file"    // ERR_VOL_BADFILE
+  };
+  static const int nerrs = (int) sizeof(errmsg)/sizeof(errmsg[0]);
+
+  if (err >= nerrs) {
+    fprintf(stderr, "fatal error: error no %d is out of range\n", err);
+    abort();
+  }
+  return errmsg[err];
+}
+
+int WriteVolume(const std::string &filename, const Volume &volume)
+{
+  set_error(ERR_VOL_NOERR);
+
+  const VoxelBuffer &buffer = volume.buffer_;
+  const Resolution &res = buffer.GetResolution();
+  const Box &bounds = volume.GetBounds();
+
+  int XN = 0, YN = 0, ZN = 0;
+  buffer.GetBrickResolution(&XN, &YN, &ZN);
+
+  std::vector<VolBrickEntry> entries;
+  std::vector<const void *> brick_data;
+
+  for (int z = 0; z < ZN; z++) {
+    for (int y = 0; y < YN; y++) {
+      for (int x = 0; x < XN; x++) {
+        VolBrickEntry entry;
+        int format = 0;
+        const void *data = buffer.GetBrickData(x, y, z,
+            &format, &entry.offset, &entry.scale);
+        if (data == NULL)
+          continue;
+
+        entry.index[0] = x;
+        entry.index[1] = y;
+        entry.index[2] = z;
+        entry.format = format;
+        entries.push_back(entry);
+        brick_data.push_back(data);
+      }
+    }
+  }
+
+  VolFileHeader header;
+  strcpy(header.magic, VOL_FILE_MAGIC);
+  header.version = VOL_FILE_VERSION;
+  header.resolution[0] = res.x;
+  header.resolution[1] = res.y;
+  header.resolution[2] = res.z;
+  header.brick_size = VoxelBuffer::GetBrickSize();
+  header.format = volume.GetVoxelFormat();
+  header.bounds[0] = bounds.min.x;
+  header.bounds[1] = bounds.min.y;
+  header.bounds[2] = bounds.min.z;
+  header.bounds[3] = bounds.max.x;
+  header.bounds[4] = bounds.max.y;
+  header.bounds[5] = bounds.max.z;
+  header.brick_count = entries.size();
+  header.offset_of_table = sizeof(header);
+
+  size_t offset = align_offset(sizeof(header) + entries.size() * sizeof(VolBrickEntry));
+  for (size_t i = 0; i < entries.size(); i++) {
+    entries[i].data_offset = offset;
+    offset = align_offset(offset + VoxelBuffer::GetBrickDataSize(entries[i].format));
+  }
+
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file == NULL) {
+    set_error(ERR_VOL_NOFILE);
+    return -1;
+  }
+
+  fwrite(&header, sizeof(header), 1, file);
+  if (!entries.empty()) {
+    fwrite(&entries[0], sizeof(VolBrickEntry), entries.size(), file);
+  }
+
+  const char padding[DATA_ALIGNMENT] = {'\0'};
+  for (size_t i = 0; i < entries.size(); i++) {
+    const long pos = ftell(file);
+    fwrite(padding, 1, entries[i].data_offset - pos, file);
+    fwrite(brick_data[i], VoxelBuffer::GetBrickDataSize(entries[i].format), 1, file);
+  }
+  const long pos = ftell(file);
+  fwrite(padding, 1, offset - pos, file);
+
+  const bool failed = ferror(file) != 0;
+  fclose(file);
+
+  if (failed) {
+    set_error(ERR_VOL_NOFILE);
+    return -1;
+  }
+
+  return 0;
+}
+
+int ReadVolume(const std::string &filename, Volume &volume)
+{
+  set_error(ERR_VOL_NOERR);
+
+  size_t size = 0;
+  void *addr = OsMapFile(filename.c_str(), &size);
+  if (addr == NULL) {
+    set_error(ERR_VOL_NOFILE);
+    return -1;
+  }
+  const char *bytes = static_cast<const char *>(addr);
+
+  VolFileHeader header;
+  if (size < sizeof(header)) {
+    OsUnmapFile(addr, size);
+    set_error(ERR_VOL_NOTVOL);
+    return -1;
+  }
+  memcpy(&header, bytes, sizeof(header));
+
+  if (strncmp(header.magic, VOL_FILE_MAGIC, VOL_MAGIC_SIZE) != 0) {
+    OsUnmapFile(addr, size);
+    set_error(ERR_VOL_NOTVOL);
+    return -1;
+  }
+  if (header.version != VOL_FILE_VERSION ||
+      header.brick_size != VoxelBuffer::GetBrickSize()) {
+    OsUnmapFile(addr, size);
+    set_error(ERR_VOL_BADVER);
+    return -1;
+  }
+
+  const int64_t max_bricks = size / sizeof(VolBrickEntry);
+  if (header.brick_count < 0 || header.brick_count > max_bricks ||
+      header.offset_of_table < 0 || header.offset_of_table > static_cast<int64_t>(size) ||
+      header.offset_of_table + header.brick_count * sizeof(VolBrickEntry) > size ||
+      header.resolution[0] < 1 || header.resolution[1] < 1 || header.resolution[2] < 1) {
+    OsUnmapFile(addr, size);
+    set_error(ERR_VOL_BADFILE);
+    return -1;
+  }
+
+  std::vector<VolBrickEntry> entries(header.brick_count);
+  if (!entries.empty()) {
+    memcpy(&entries[0], bytes + header.offset_of_table,
+        entries.size() * sizeof(VolBrickEntry));
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    const VolBrickEntry &entry = entries[i];
+    if (entry.format != VOXEL_FLOAT32 &&
+        entry.format != VOXEL_HALF16 &&
+        entry.format != VOXEL_UINT8) {
+      OsUnmapFile(addr, size);
+      set_error(ERR_VOL_BADFILE);
+      return -1;
+    }
+
+    const size_t data_size = VoxelBuffer::GetBrickDataSize(entry.format);
+    if (entry.data_offset < 0 || entry.data_offset % DATA_ALIGNMENT != 0 ||
+        entry.data_offset + data_size > size) {
+      OsUnmapFile(addr, size);
+      set_error(ERR_VOL_BADFILE);
+      return -1;
+    }
+  }
+
+  volume.Resize(header.resolution[0], header.resolution[1], header.resolution[2]);
+  volume.SetBounds(Box(
+      Vector(header.bounds[0], header.bounds[1], header.bounds[2]),
+      Vector(header.bounds[3], header.bounds[4], header.bounds[5])));
+  volume.SetVoxelFormat(header.format);
+
+  VoxelBuffer &buffer = volume.buffer_;
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    const VolBrickEntry &entry = entries[i];
+    buffer.SetMappedBrick(entry.index[0], entry.index[1], entry.index[2],
+        entry.format, entry.offset, entry.scale, bytes + entry.data_offset);
+  }
+
+  buffer.SetMapping(addr, size);
+
+  return 0;
+}
+
+} // namespace xxx
@@ -0,0 +1,32 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#ifndef FJ_VOLUME_IO_H
+#define FJ_VOLUME_IO_H
+
+#include "fj_compatibility.h"
+#include <string>
+
+namespace fj {
+
+class Volume;
+
+enum VolErrorNo {
+  ERR_VOL_NOERR = 0,
+  ERR_VOL_NOFILE,
+  ERR_VOL_NOTVOL,
+  ERR_VOL_BADVER,
+  ERR_VOL_BADFILE
+};
+
+FJ_API int VolGetErrorNo(void);
+FJ_API const char *VolGetErrorMessage(int err);
+
+// .fjvol stores allocated bricks as they are in memory. ReadVolume maps
+// the file and bricks refer to the mapped memory until they are written
+FJ_API int WriteVolume(const std::string &filename, const Volume &volume);
+FJ_API int ReadVolume(const std::string &filename, Volume &volume);
+
+} // namespace xxx
+
+#endif // FJ_XXX_H
@@ -0,0 +1,181 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "fj_volume_shadow.h"
+#include "fj_object_instance.h"
+#include "fj_multi_thread.h"
+#include "fj_numeric.h"
+#include "fj_shading.h"
+#include "fj_volume.h"
+#include "fj_light.h"
+
+#include <cfloat>
+
+namespace fj {
+
+static const int MAX_RESOLUTION = 256;
+
+class VolumeShadowBaker {
+public:
+  VolumeShadowBaker() : shadow(NULL), samples(NULL), nsamples(0), cxt(NULL) {}
+  ~VolumeShadowBaker() {}
+
+  VolumeShadow *shadow;
+  const LightSample *samples;
+  int nsamples;
+  const TraceContext *cxt;
+
+  Vector grid_point(int x, int y, int z) const
+  {
+    const Box &bounds = shadow->bounds_;
+    const Vector size = bounds.Diagonal();
+
+    return Vector(
+        bounds.min.x + x * size.x / (shadow->res_[0] - 1),
+        bounds.min.y + y * size.y / (shadow->res_[1] - 1),
+        bounds.min.z + z * size.z / (shadow->res_[2] - 1));
+  }
+
+  float transmittance(const Vector &P) const
+  {
+    const TraceContext shad_cxt = SlShadowContext(cxt, shadow->object_);
+    float sum = 0;
+
+    for (int i = 0; i < nsamples; i++) {
+      Vector Ln = samples[i].P - P;
+      const double distance = Length(Ln);
+      if (distance > 0) {
+        Ln /= distance;
+      }
+
+      Color4 C_occl;
+      double t_hit = FLT_MAX;
+      const int hit = SlTrace(&shad_cxt, &P, &Ln, .0001, distance, &C_occl, &t_hit);
+
+      sum += hit ? 1 - C_occl.a : 1;
+    }
+
+    return sum / nsamples;
+  }
+
+  void BakeSlice(int z) const
+  {
+    const int xres = shadow->res_[0];
+    const int yres = shadow->res_[1];
+
+    for (int y = 0; y < yres; y++) {
+      for (int x = 0; x < xres; x++) {
+        const Vector P = grid_point(x, y, z);
+        shadow->data_[(z * yres + y) * xres + x] = transmittance(P);
+      }
+    }
+  }
+};
+
+static LoopStatus bake_slice(void *data, const ThreadContext &context)
+{
+  VolumeShadowBaker *baker = reinterpret_cast<VolumeShadowBaker *>(data);
+  baker->BakeSlice(context.iteration_id);
+
+  return LoopStatus::Continue;
+}
+
+VolumeShadow::VolumeShadow() : object_(NULL), bounds_(), data_()
+{
+  res_[0] = 0;
+  res_[1] = 0;
+  res_[2] = 0;
+}
+
+VolumeShadow::~VolumeShadow()
+{
+}
+
+int VolumeShadow::Bake(const ObjectInstance *object,
+    const LightSample *samples, int nsamples,
+    const TraceContext &cxt, float rate, int thread_count)
+{
+  const Volume *volume = object->GetVolume();
+  if (volume == NULL || nsamples < 1 || rate <= 0) {
+    return -1;
+  }
+
+  // filter size is in object space
+  const Real object_diagonal = Length(volume->GetBounds().Diagonal());
+  const Real world_diagonal = Length(object->GetBounds().Diagonal());
+  if (object_diagonal <= 0 || volume->GetFilterSize() <= 0) {
+    return -1;
+  }
+  const Real cellsize = rate * volume->GetFilterSize() * world_diagonal / object_diagonal;
+
+  object_ = object;
+  bounds_ = object->GetBounds();
+
+  const Vector size = bounds_.Diagonal();
+  for (int i = 0; i < 3; i++) {
+    const int res = static_cast<int>(Ceil(size[i] / cellsize)) + 1;
+    res_[i] = static_cast<int>(Clamp(res, 2, MAX_RESOLUTION));
+  }
+  data_.resize(res_[0] * res_[1] * res_[2], 1);
+
+  VolumeShadowBaker baker;
+  baker.shadow = this;
+  baker.samples = samples;
+  baker.nsamples = nsamples;
+  baker.cxt = &cxt;
+
+  std::vector<int> iteration_que(res_[2]);
+  for (int i = 0; i < res_[2]; i++) {
+    iteration_que[i] = i;
+  }
+
+  MtRunParallelLoop(&baker, bake_slice, thread_count, iteration_que);
+
+  return 0;
+}
+
+const ObjectInstance *VolumeShadow::GetObject() const
+{
+  return object_;
+}
+
+void VolumeShadow::GetResolution(int *xres, int *yres, int *zres) const
+{
+  *xres = res_[0];
+  *yres = res_[1];
+  *zres = res_[2];
+}
+
+bool VolumeShadow::GetTransmittance(const Vector &P, float *transmittance) const
+{
+  if (data_.empty() || !bounds_.ContainsPoint(P)) {
+    return false;
+  }
+
+  const Vector size = bounds_.Diagonal();
+  Real f[3] = {0, 0, 0};
+  int lo[3] = {0, 0, 0};
+
+  for (int i = 0; i < 3; i++) {
+    const Real g = (P[i] - bounds_.min[i]) / size[i] * (res_[i] - 1);
+    lo[i] = static_cast<int>(Clamp(static_cast<int>(g), 0, res_[i] - 2));
+    f[i] = Clamp(g - lo[i], 0, 1);
+  }
+
+  const float c00 = Lerp(get_value(lo[0], lo[1],   lo[2]  ), get_value(lo[0]+1, lo[1],   lo[2]  ), f[0]);
+  const float c10 = Lerp(get_value(lo[0], lo[1]+1, lo[2]  ), get_value(lo[0]+1, lo[1]+1, lo[2]  ), f[0]);
+  const float c01 = Lerp(get_value(lo[0], lo[1],   lo[2]+1), get_value(lo[0]+1, lo[1],   lo[2]+1), f[0]);
+  const float c11 = Lerp(get_value(lo[0], lo[1]+1, lo[2]+1), get_value(lo[0]+1, lo[1]+1, lo[2]+1), f[0]);
+  const float c0 = Lerp(c00, c10, f[1]);
+  const float c1 = Lerp(c01, c11, f[1]);
+
+  *transmittance = Lerp(c0, c1, f[2]);
+  return true;
+}
+
+float VolumeShadow::get_value(int x, int y, int z) const
+{
+  return data_[(z * res_[1] + y) * res_[0] + x];
+}
+
+} // namespace xxx
@@ -0,0 +1,46 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#ifndef FJ_VOLUME_SHADOW_H
+#define FJ_VOLUME_SHADOW_H
+
+#include "fj_vector.h"
+#include "fj_box.h"
+#include <vector>
+
+namespace fj {
+
+class ObjectInstance;
+class TraceContext;
+class LightSample;
+
+// Transmittance toward a light baked on a grid over a volume object.
+// Volume shading looks it up instead of tracing shadow rays.
+class VolumeShadow {
+public:
+  VolumeShadow();
+  ~VolumeShadow();
+
+  // cell size is rate times filter size of the volume in world space
+  int Bake(const ObjectInstance *object,
+      const LightSample *samples, int nsamples,
+      const TraceContext &cxt, float rate, int thread_count);
+
+  const ObjectInstance *GetObject() const;
+  void GetResolution(int *xres, int *yres, int *zres) const;
+  bool GetTransmittance(const Vector &P, float *transmittance) const;
+
+private:
+  float get_value(int x, int y, int z) const;
+
+  const ObjectInstance *object_;
+  Box bounds_;
+  int res_[3];
+  std::vector<float> data_;
+
+  friend class VolumeShadowBaker;
+};
+
+} // namespace xxx
+
+#endif // FJ_XXX_H
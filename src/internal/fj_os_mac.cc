@@ -6,6 +6,9 @@
 #include <string.h>
 #include <dlfcn.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 void *OsDlopen(const char *filename)
 {
@@ -49,3 +52,58 @@ int OsDlclose(void *handle)
     return 0;
   }
 }
+
+void *OsMapFile(const char *filename, size_t *size)
+{
+  struct stat st;
+  void *addr = NULL;
+  int fd = -1;
+
+  *size = 0;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // mapping keeps the file referenced
+  close(fd);
+
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  *size = st.st_size;
+  return addr;
+}
+
+int OsUnmapFile(void *addr, size_t size)
+{
+  if (addr == NULL) {
+    return 0;
+  }
+
+  if (munmap(addr, size) == -1) {
+    return -1;
+  } else {
+    return 0;
+  }
+}
+
+int OsGetAvailableCpuCount()
+{
+  // no affinity masks on Mac OS X
+  return 0;
+}
+
+int OsSetThreadCpu(int cpu_index)
+{
+  // threads can't be bound to a cpu on Mac OS X
+  return -1;
+}
@@ -6,6 +6,11 @@
 #include <string.h>
 #include <dlfcn.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
 
 void *OsDlopen(const char *filename)
 {
@@ -49,3 +54,254 @@ int OsDlclose(void *handle)
     return 0;
   }
 }
+
+void *OsMapFile(const char *filename, size_t *size)
+{
+  struct stat st;
+  void *addr = NULL;
+  int fd = -1;
+
+  *size = 0;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // mapping keeps the file referenced
+  close(fd);
+
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  *size = st.st_size;
+  return addr;
+}
+
+int OsUnmapFile(void *addr, size_t size)
+{
+  if (addr == NULL) {
+    return 0;
+  }
+
+  if (munmap(addr, size) == -1) {
+    return -1;
+  } else {
+    return 0;
+  }
+}
+
+// cgroup path of this process from /proc/self/cgroup. for cgroup v1 it is
+// the path of the hierarchy with the cpu controller. returns 0 if found
+static int get_cgroup_path(int version, char *path, size_t path_size)
+{
+  FILE *fp = fopen("/proc/self/cgroup", "r");
+  char line[1024] = {'\0'};
+  int found = -1;
+
+  if (fp == NULL) {
+    return -1;
+  }
+
+  // hierarchy-id:controller-list:path
+  while (found != 0 && fgets(line, sizeof(line), fp) != NULL) {
+    char *controllers = strchr(line, ':');
+    char *cgroup_path = controllers == NULL ? NULL : strchr(controllers + 1, ':');
+    if (cgroup_path == NULL) {
+      continue;
+    }
+    *controllers++ = '\0';
+    *cgroup_path++ = '\0';
+    cgroup_path[strcspn(cgroup_path, "\n")] = '\0';
+
+    if (version == 2) {
+      if (strcmp(line, "0") != 0 || controllers[0] != '\0') {
+        continue;
+      }
+    } else {
+      // "cpu" alone or in a list such as "cpu,cpuacct"
+      int has_cpu = 0;
+      for (char *c = strtok(controllers, ","); c != NULL; c = strtok(NULL, ",")) {
+        if (strcmp(c, "cpu") == 0) {
+          has_cpu = 1;
+        }
+      }
+      if (!has_cpu) {
+        continue;
+      }
+    }
+
+    if (strlen(cgroup_path) < path_size) {
+      strcpy(path, cgroup_path);
+      found = 0;
+    }
+  }
+
+  fclose(fp);
+  return found;
+}
+
+// cpu quota of the cgroup at dir as number of cpus (rounded up).
+// returns 0 if not limited, -1 if the files are missing
+static int read_cgroup_dir_cpu_limit(int version, const char *dir)
+{
+  char filename[1024] = {'\0'};
+  FILE *fp = NULL;
+  long quota = -1;
+  long period = 0;
+
+  if (version == 2) {
+    snprintf(filename, sizeof(filename), "%s/cpu.max", dir);
+    fp = fopen(filename, "r");
+    if (fp == NULL) {
+      return -1;
+    }
+    char quota_str[64] = {'\0'};
+    const int n = fscanf(fp, "%63s %ld", quota_str, &period);
+    fclose(fp);
+
+    if (n == 2 && strcmp(quota_str, "max") != 0) {
+      if (sscanf(quota_str, "%ld", &quota) != 1) {
+        quota = -1;
+      }
+    }
+  } else {
+    snprintf(filename, sizeof(filename), "%s/cpu.cfs_quota_us", dir);
+    fp = fopen(filename, "r");
+    if (fp == NULL) {
+      return -1;
+    }
+    if (fscanf(fp, "%ld", &quota) != 1) {
+      quota = -1;
+    }
+    fclose(fp);
+
+    snprintf(filename, sizeof(filename), "%s/cpu.cfs_period_us", dir);
+    fp = fopen(filename, "r");
+    if (fp != NULL) {
+      if (fscanf(fp, "%ld", &period) != 1) {
+        period = 0;
+      }
+      fclose(fp);
+    }
+  }
+
+  if (quota <= 0 || period <= 0) {
+    return 0;
+  }
+  return static_cast<int>((quota + period - 1) / period);
+}
+
+// cpu quota as number of cpus (rounded up). returns 0 if not limited.
+// the quota of the process's own cgroup and of its ancestors all apply,
+// so the smallest one is taken
+static int read_cgroup_cpu_limit()
+{
+  int limit = 0;
+
+  for (int version = 2; version >= 1; version--) {
+    const char *root = version == 2 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/cpu";
+    char cgroup_path[512] = {'\0'};
+    char dir[1024] = {'\0'};
+    bool found_files = false;
+
+    if (get_cgroup_path(version, cgroup_path, sizeof(cgroup_path)) != 0) {
+      // no entry. the root files may still be there
+      cgroup_path[0] = '\0';
+    }
+
+    // walk up from the cgroup of the process to the root
+    for (;;) {
+      snprintf(dir, sizeof(dir), "%s%s", root, cgroup_path);
+      const int dir_limit = read_cgroup_dir_cpu_limit(version, dir);
+      if (dir_limit >= 0) {
+        found_files = true;
+      }
+      if (dir_limit > 0 && (limit == 0 || dir_limit < limit)) {
+        limit = dir_limit;
+      }
+
+      char *slash = strrchr(cgroup_path, '/');
+      if (slash == NULL) {
+        break;
+      }
+      *slash = '\0';
+    }
+
+    if (found_files) {
+      break;
+    }
+  }
+
+  return limit;
+}
+
+// cpus the process was allowed to run on before any thread was bound
+static const cpu_set_t &get_process_cpu_set()
+{
+  static const cpu_set_t process_set = []()
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (sched_getaffinity(getpid(), sizeof(set), &set) == -1) {
+        CPU_ZERO(&set);
+      }
+      return set;
+    }();
+  return process_set;
+}
+
+int OsGetAvailableCpuCount()
+{
+  const int affinity_count = CPU_COUNT(&get_process_cpu_set());
+  const int cgroup_limit = read_cgroup_cpu_limit();
+
+  if (cgroup_limit > 0 && (affinity_count == 0 || cgroup_limit < affinity_count)) {
+    return cgroup_limit;
+  }
+  return affinity_count;
+}
+
+int OsSetThreadCpu(int cpu_index)
+{
+  const cpu_set_t &process_set = get_process_cpu_set();
+  const int cpu_count = CPU_COUNT(&process_set);
+
+  if (cpu_count == 0) {
+    return -1;
+  }
+
+  cpu_set_t set;
+  if (cpu_index < 0) {
+    set = process_set;
+  } else {
+    // n-th allowed cpu
+    const int nth = cpu_index % cpu_count;
+    int found = 0;
+
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (!CPU_ISSET(cpu, &process_set)) {
+        continue;
+      }
+      if (found == nth) {
+        CPU_SET(cpu, &set);
+        break;
+      }
+      found++;
+    }
+  }
+
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    return -1;
+  } else {
+    return 0;
+  }
+}
@@ -60,3 +60,115 @@ int OsDlclose(void *handle)
     return 0;
   }
 }
+
+void *OsMapFile(const char *filename, size_t *size)
+{
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = NULL;
+  LARGE_INTEGER file_size;
+  void *addr = NULL;
+
+  *size = 0;
+
+  file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    return NULL;
+  }
+
+  mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL) {
+    CloseHandle(file);
+    return NULL;
+  }
+
+  addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  // view keeps the mapping referenced
+  CloseHandle(mapping);
+  CloseHandle(file);
+
+  if (addr == NULL) {
+    return NULL;
+  }
+
+  *size = static_cast<size_t>(file_size.QuadPart);
+  return addr;
+}
+
+int OsUnmapFile(void *addr, size_t size)
+{
+  if (addr == NULL) {
+    return 0;
+  }
+
+  if (UnmapViewOfFile(addr) == 0) {
+    return -1;
+  } else {
+    return 0;
+  }
+}
+
+static DWORD_PTR get_process_affinity_mask()
+{
+  DWORD_PTR process_mask = 0;
+  DWORD_PTR system_mask = 0;
+
+  if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask) == 0) {
+    return 0;
+  }
+  return process_mask;
+}
+
+int OsGetAvailableCpuCount()
+{
+  const DWORD_PTR process_mask = get_process_affinity_mask();
+  int count = 0;
+
+  for (DWORD_PTR bit = 1; bit != 0; bit <<= 1) {
+    if (process_mask & bit) {
+      count++;
+    }
+  }
+  return count;
+}
+
+int OsSetThreadCpu(int cpu_index)
+{
+  const DWORD_PTR process_mask = get_process_affinity_mask();
+  const int cpu_count = OsGetAvailableCpuCount();
+
+  if (cpu_count == 0) {
+    return -1;
+  }
+
+  DWORD_PTR mask = 0;
+  if (cpu_index < 0) {
+    mask = process_mask;
+  } else {
+    // n-th allowed cpu
+    const int nth = cpu_index % cpu_count;
+    int found = 0;
+
+    for (DWORD_PTR bit = 1; bit != 0; bit <<= 1) {
+      if (!(process_mask & bit)) {
+        continue;
+      }
+      if (found == nth) {
+        mask = bit;
+        break;
+      }
+      found++;
+    }
+  }
+
+  if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+    return -1;
+  } else {
+    return 0;
+  }
+}
@@ -89,6 +89,16 @@ static int set_Turbulence_octaves(void *self, const PropertyValue &value)
   return 0;
 }
 
+static int set_Turbulence_tile_resolution(void *self, const PropertyValue &value)
+{
+  if (value.vector[0] < 0)
+    return -1;
+
+  Turbulence *turbulence = reinterpret_cast<Turbulence *>(self);
+  turbulence->SetTileResolution((int) value.vector[0]);
+  return 0;
+}
+
 static int set_Turbulence_amplitude(void *self, const PropertyValue &value)
 {
   Turbulence *turbulence = reinterpret_cast<Turbulence *>(self);
@@ -180,6 +190,27 @@ static int set_Renderer_raymarch_refract_step(void *self, const PropertyValue &v
   return 0;
 }
 
+static int set_Renderer_volume_integrator(void *self, const PropertyValue &value)
+{
+  Renderer *renderer = reinterpret_cast<Renderer *>(self);
+  renderer->SetVolumeIntegrator(static_cast<int>(value.vector[0]));
+  return 0;
+}
+
+static int set_Renderer_raymarch_quality(void *self, const PropertyValue &value)
+{
+  Renderer *renderer = reinterpret_cast<Renderer *>(self);
+  renderer->SetRaymarchQuality(value.vector[0]);
+  return 0;
+}
+
+static int set_Renderer_raymarch_lod(void *self, const PropertyValue &value)
+{
+  Renderer *renderer = reinterpret_cast<Renderer *>(self);
+  renderer->SetRaymarchLod(value.vector[0]);
+  return 0;
+}
+
 static int set_Renderer_sample_time_range(void *self, const PropertyValue &value)
 {
   Renderer *renderer = reinterpret_cast<Renderer *>(self);
@@ -201,6 +232,22 @@ static int set_Renderer_tilesize(void *self, const PropertyValue &value)
   return 0;
 }
 
+static int set_Renderer_tile_order(void *self, const PropertyValue &value)
+{
+  Renderer *renderer = reinterpret_cast<Renderer *>(self);
+  renderer->SetTileOrder((int) value.vector[0]);
+  return 0;
+}
+
+static int set_Renderer_priority_region(void *self, const PropertyValue &value)
+{
+  Renderer *renderer = reinterpret_cast<Renderer *>(self);
+  renderer->SetPriorityRegion(
+      (int) value.vector[0], (int) value.vector[1],
+      (int) value.vector[2], (int) value.vector[3]);
+  return 0;
+}
+
 static int set_Renderer_filterwidth(void *self, const PropertyValue &value)
 {
   Renderer *renderer = reinterpret_cast<Renderer *>(self);
@@ -259,6 +306,20 @@ static int set_Renderer_thread_count(void *self, const PropertyValue &value)
   return 0;
 }
 
+static int set_Renderer_pin_threads(void *self, const PropertyValue &value)
+{
+  Renderer *renderer = reinterpret_cast<Renderer *>(self);
+  renderer->SetPinThreads((int) value.vector[0]);
+  return 0;
+}
+
+static int set_Renderer_time_budget(void *self, const PropertyValue &value)
+{
+  Renderer *renderer = reinterpret_cast<Renderer *>(self);
+  renderer->SetTimeBudget(value.vector[0]);
+  return 0;
+}
+
 static int set_Camera_fov(void *self, const PropertyValue &value)
 {
   Camera *cam = reinterpret_cast<Camera *>(self);
@@ -347,6 +408,80 @@ static int set_Volume_bounds_max(void *self, const PropertyValue &value)
   return 0;
 }
 
+static int set_Volume_voxel_format(void *self, const PropertyValue &value)
+{
+  const int format = (int) value.vector[0];
+  if (format != VOXEL_FLOAT32 && format != VOXEL_HALF16 && format != VOXEL_UINT8)
+    return -1;
+
+  Volume *volume = reinterpret_cast<Volume *>(self);
+  volume->SetVoxelFormat(format);
+  return 0;
+}
+
+static int set_Curve_intersection_mode(void *self, const PropertyValue &value)
+{
+  const int mode = (int) value.vector[0];
+  if (mode != CURVE_TUBE && mode != CURVE_RIBBON && mode != CURVE_AUTO)
+    return -1;
+
+  Curve *curve = reinterpret_cast<Curve *>(self);
+  curve->SetIntersectionMode(mode);
+  return 0;
+}
+
+static int set_Curve_ribbon_width(void *self, const PropertyValue &value)
+{
+  Curve *curve = reinterpret_cast<Curve *>(self);
+  curve->SetRibbonWidth(value.vector[0]);
+  return 0;
+}
+
+static int set_TessellatedMesh_control_mesh(void *self, const PropertyValue &value)
+{
+  TessellatedMesh *mesh = reinterpret_cast<TessellatedMesh *>(self);
+  return mesh->SetControlMesh(value.mesh);
+}
+
+static int set_TessellatedMesh_displacement_map(void *self, const PropertyValue &value)
+{
+  TessellatedMesh *mesh = reinterpret_cast<TessellatedMesh *>(self);
+  mesh->SetDisplacementMap(value.texture);
+  return 0;
+}
+
+static int set_TessellatedMesh_displacement_scale(void *self, const PropertyValue &value)
+{
+  TessellatedMesh *mesh = reinterpret_cast<TessellatedMesh *>(self);
+  mesh->SetDisplacementScale(value.vector[0]);
+  return 0;
+}
+
+static int set_TessellatedMesh_displacement_bound(void *self, const PropertyValue &value)
+{
+  TessellatedMesh *mesh = reinterpret_cast<TessellatedMesh *>(self);
+  mesh->SetDisplacementBound(value.vector[0]);
+  return 0;
+}
+
+static int set_TessellatedMesh_subdivision_level(void *self, const PropertyValue &value)
+{
+  TessellatedMesh *mesh = reinterpret_cast<TessellatedMesh *>(self);
+  mesh->SetSubdivisionLevel((int) value.vector[0]);
+  return 0;
+}
+
+static int set_TessellatedMesh_cache_size(void *self, const PropertyValue &value)
+{
+  // in megabytes
+  if (value.vector[0] < 0)
+    return -1;
+
+  TessellatedMesh *mesh = reinterpret_cast<TessellatedMesh *>(self);
+  mesh->SetCacheSize((size_t) (value.vector[0] * 1024 * 1024));
+  return 0;
+}
+
 static int set_Light_intensity(void *self, const PropertyValue &value)
 {
   Light *light = reinterpret_cast<Light *>(self);
@@ -382,6 +517,13 @@ static int set_Light_environment_map(void *self, const PropertyValue &value)
   return 0;
 }
 
+static int set_Light_volume_shadow_rate(void *self, const PropertyValue &value)
+{
+  Light *light = reinterpret_cast<Light *>(self);
+  light->SetVolumeShadowRate(value.vector[0]);
+  return 0;
+}
+
 static int set_Light_transform_order(void *self, const PropertyValue &value)
 {
   // TODO error handling
@@ -439,12 +581,13 @@ static const Property ObjectInstance_properties[] = {
 };
 
 static const Property Turbulence_properties[] = {
-  Property("lacunarity", PropScalar(2),        set_Turbulence_lacunarity),
-  Property("gain",       PropScalar(.5),       set_Turbulence_gain),
-  Property("octaves",    PropScalar(8),        set_Turbulence_octaves),
-  Property("amplitude",  PropVector3(1, 1, 1), set_Turbulence_amplitude),
-  Property("frequency",  PropVector3(1, 1, 1), set_Turbulence_frequency),
-  Property("offset",     PropVector3(0, 0, 0), set_Turbulence_offset),
+  Property("lacunarity",      PropScalar(2),        set_Turbulence_lacunarity),
+  Property("gain",            PropScalar(.5),       set_Turbulence_gain),
+  Property("octaves",         PropScalar(8),        set_Turbulence_octaves),
+  Property("amplitude",       PropVector3(1, 1, 1), set_Turbulence_amplitude),
+  Property("frequency",       PropVector3(1, 1, 1), set_Turbulence_frequency),
+  Property("offset",          PropVector3(0, 0, 0), set_Turbulence_offset),
+  Property("tile_resolution", PropScalar(0),        set_Turbulence_tile_resolution),
   Property()
 };
 
@@ -459,17 +602,24 @@ static const Property Renderer_properties[] = {
   Property("raymarch_diffuse_step", PropScalar(.1),    set_Renderer_raymarch_diffuse_step),
   Property("raymarch_reflect_step", PropScalar(.1),    set_Renderer_raymarch_reflect_step),
   Property("raymarch_refract_step", PropScalar(.1),    set_Renderer_raymarch_refract_step),
+  Property("volume_integrator",     PropScalar(0),     set_Renderer_volume_integrator),
+  Property("raymarch_quality",      PropScalar(0),     set_Renderer_raymarch_quality),
+  Property("raymarch_lod",          PropScalar(0),     set_Renderer_raymarch_lod),
   Property("sample_time_range",     PropVector2(0, 1), set_Renderer_sample_time_range),
   Property("resolution",            PropVector2(320, 240), set_Renderer_resolution),
   Property("tilesize",              PropVector2(32, 32),   set_Renderer_tilesize),
+  Property("tile_order",            PropScalar(0),         set_Renderer_tile_order),
   Property("filterwidth",           PropVector2(2, 2),     set_Renderer_filterwidth),
   Property("sampler_type",          PropScalar(0),         set_Renderer_sampler_type),
   Property("pixelsamples",          PropVector2(3, 3),     set_Renderer_pixelsamples),
   Property("adaptive_max_subdivision", PropScalar(1), set_Renderer_adaptive_max_subdivision),
   Property("adaptive_subdivision_threshold", PropScalar(.05), set_Renderer_adaptive_subdivision_threshold),
   Property("render_region",         PropVector4(0, 0, 320, 240), set_Renderer_render_region),
+  Property("priority_region",       PropVector4(0, 0, 0, 0),     set_Renderer_priority_region),
   Property("use_max_thread",        PropScalar(1), set_Renderer_use_max_thread),
   Property("thread_count",          PropScalar(8), set_Renderer_thread_count),
+  Property("pin_threads",           PropScalar(0), set_Renderer_pin_threads),
+  Property("time_budget",           PropScalar(0), set_Renderer_time_budget),
   Property()
 };
 
@@ -488,6 +638,23 @@ static const Property Volume_properties[] = {
   Property("resolution", PropVector3(0, 0, 0), set_Volume_resolution),
   Property("bounds_min", PropVector3(0, 0, 0), set_Volume_bounds_min),
   Property("bounds_max", PropVector3(0, 0, 0), set_Volume_bounds_max),
+  Property("voxel_format", PropScalar(VOXEL_FLOAT32), set_Volume_voxel_format),
+  Property()
+};
+
+static const Property Curve_properties[] = {
+  Property("intersection_mode", PropScalar(CURVE_TUBE), set_Curve_intersection_mode),
+  Property("ribbon_width",      PropScalar(.001),       set_Curve_ribbon_width),
+  Property()
+};
+
+static const Property TessellatedMesh_properties[] = {
+  Property("control_mesh",       PropMesh(NULL),    set_TessellatedMesh_control_mesh),
+  Property("displacement_map",   PropTexture(NULL), set_TessellatedMesh_displacement_map),
+  Property("displacement_scale", PropScalar(0),     set_TessellatedMesh_displacement_scale),
+  Property("displacement_bound", PropScalar(1),     set_TessellatedMesh_displacement_bound),
+  Property("subdivision_level",  PropScalar(3),     set_TessellatedMesh_subdivision_level),
+  Property("cache_size",         PropScalar(256),   set_TessellatedMesh_cache_size),
   Property()
 };
 
@@ -502,6 +669,7 @@ static const Property Light_properties[] = {
   Property("sample_count",    PropScalar(16),        set_Light_sample_count),
   Property("double_sided",    PropScalar(0),         set_Light_double_sided),
   Property("environment_map", PropTexture(NULL),     set_Light_environment_map),
+  Property("volume_shadow_rate", PropScalar(0),      set_Light_volume_shadow_rate),
   Property()
 };
 
@@ -523,14 +691,18 @@ DEFINE_GET_ENTRY_FUNC(Turbulence)
 DEFINE_GET_ENTRY_FUNC(Renderer)
 DEFINE_GET_ENTRY_FUNC(Camera)
 DEFINE_GET_ENTRY_FUNC(Volume)
+DEFINE_GET_ENTRY_FUNC(Curve)
 DEFINE_GET_ENTRY_FUNC(Light)
+DEFINE_GET_ENTRY_FUNC(TessellatedMesh)
 static const property_desc property_desc_list[] = {
   PROPERTY_DESC(ObjectInstance),
   PROPERTY_DESC(Turbulence),
   PROPERTY_DESC(Renderer),
   PROPERTY_DESC(Camera),
   PROPERTY_DESC(Volume),
+  PROPERTY_DESC(Curve),
   PROPERTY_DESC(Light),
+  PROPERTY_DESC(TessellatedMesh),
   {Type_Begin, NULL, NULL, NULL}
 };
 #undef DEFINE_GET_ENTRY_FUNC
@@ -0,0 +1,97 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "unit_test.h"
+#include "fj_half.h"
+#include <cstdio>
+#include <cmath>
+
+using namespace fj;
+
+int main()
+{
+  {
+    // exact values
+    TEST(FloatToHalf(0.f) == 0x0000);
+    TEST(FloatToHalf(-0.f) == 0x8000);
+    TEST(FloatToHalf(1.f) == 0x3c00);
+    TEST(FloatToHalf(-2.f) == 0xc000);
+    TEST(FloatToHalf(65504.f) == 0x7bff);
+
+    TEST(HalfToFloat(0x3c00) == 1.f);
+    TEST(HalfToFloat(0xc000) == -2.f);
+    TEST(HalfToFloat(0x7bff) == 65504.f);
+  }
+  {
+    // subnormals
+    TEST(FloatToHalf(std::ldexp(1.f, -24)) == 0x0001);
+    TEST(FloatToHalf(std::ldexp(1.f, -14)) == 0x0400);
+    TEST(FloatToHalf(std::ldexp(1.f, -15)) == 0x0200);
+    TEST(FloatToHalf(std::ldexp(1.f, -26)) == 0x0000);
+    TEST(FloatToHalf(-std::ldexp(1.f, -24)) == 0x8001);
+
+    TEST(HalfToFloat(0x0001) == std::ldexp(1.f, -24));
+    TEST(HalfToFloat(0x03ff) == std::ldexp(1023.f, -24));
+    TEST(HalfToFloat(0x8200) == -std::ldexp(1.f, -15));
+  }
+  {
+    // overflow clamps to the max finite half
+    TEST(FloatToHalf(1e6f) == 0x7bff);
+    TEST(FloatToHalf(-1e6f) == 0xfbff);
+    TEST(FloatToHalf(65520.f) == 0x7bff);
+    TEST(FloatToHalf(65535.f) == 0x7bff);
+  }
+  {
+    // rounding carry into the exponent
+    TEST(FloatToHalf(2047.9f) == 0x6800);
+    TEST(FloatToHalf(0.99999f) == 0x3c00);
+    TEST(FloatToHalf(std::ldexp(1023.75f, -24)) == 0x0400);
+  }
+  {
+    // inf and nan
+    TEST(FloatToHalf(INFINITY) == 0x7c00);
+    TEST(FloatToHalf(-INFINITY) == 0xfc00);
+    TEST((FloatToHalf(NAN) & 0x7c00) == 0x7c00);
+    TEST((FloatToHalf(NAN) & 0x03ff) != 0);
+
+    TEST(std::isinf(HalfToFloat(0x7c00)));
+    TEST(std::isnan(HalfToFloat(0x7e00)));
+  }
+  {
+    // round trip of every finite half
+    int mismatch = 0;
+    for (int i = 0; i < 0x10000; i++) {
+      const uint16_t h = static_cast<uint16_t>(i);
+      if ((h & 0x7c00) == 0x7c00) {
+        continue;
+      }
+      if (FloatToHalf(HalfToFloat(h)) != h) {
+        mismatch++;
+      }
+    }
+    TEST(mismatch == 0);
+  }
+  {
+    // array decode matches single decode
+    uint16_t halves[19];
+    float values[19];
+    for (int i = 0; i < 19; i++) {
+      halves[i] = static_cast<uint16_t>(i * 3331);
+    }
+    HalfToFloatArray(halves, 19, values);
+
+    int mismatch = 0;
+    for (int i = 0; i < 19; i++) {
+      const float f = HalfToFloat(halves[i]);
+      if (!(values[i] == f || (std::isnan(values[i]) && std::isnan(f)))) {
+        mismatch++;
+      }
+    }
+    TEST(mismatch == 0);
+  }
+
+  printf("%s: %d/%d/%d: (FAIL/PASS/TOTAL)\n", __FILE__,
+      TestGetFailCount(), TestGetPassCount(), TestGetTotalCount());
+
+  return 0;
+}
@@ -0,0 +1,235 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+// Measures how much thread identity and loop scheduling cost when many
+// threads hit them at once. usage: multi_thread_bench [thread count]
+
+#include "fj_multi_thread.h"
+
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <cstdlib>
+
+using namespace fj;
+
+static const int CALLS_PER_THREAD = 200000;
+static const int LOOP_ITERATIONS = 2000000;
+
+// thread identity as it used to be: a map behind a global mutex
+static std::unordered_map<std::thread::id, int> locked_id_map;
+static std::mutex locked_id_map_mtx;
+
+static int locked_get_thread_id()
+{
+  std::lock_guard<std::mutex> lock(locked_id_map_mtx);
+  return locked_id_map[std::this_thread::get_id()];
+}
+
+static double run_threads(int thread_count, const std::function<void(int)> &fn)
+{
+  std::vector<std::thread> threads;
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < thread_count; i++) {
+    threads.push_back(std::thread(fn, i));
+  }
+  for (auto &t: threads) {
+    t.join();
+  }
+
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+static std::atomic<long> id_sum(0);
+
+static double elapsed_since(std::chrono::steady_clock::time_point start)
+{
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+static LoopStatus probe_task(void *data, const ThreadContext &context)
+{
+  int *thread_count = static_cast<int *>(data);
+  if (context.iteration_id == 0) {
+    *thread_count = context.thread_count;
+  }
+  return LoopStatus::Continue;
+}
+
+// number of threads MtRunParallelFor really runs with when asked for
+// thread_count. the pool clamps it to its worker count + 1
+static int get_effective_thread_count(int thread_count)
+{
+  int effective = 0;
+  MtRunParallelFor(&effective, probe_task, thread_count, 0, 1);
+  return effective;
+}
+
+// thread ids are looked up on pool threads so that MtGetThreadID
+// returns the real ids and not 0 of an unregistered thread
+static LoopStatus locked_id_task(void *data, const ThreadContext &context)
+{
+  {
+    std::lock_guard<std::mutex> lock(locked_id_map_mtx);
+    locked_id_map[std::this_thread::get_id()] = MtGetThreadID();
+  }
+  long sum = 0;
+  for (int i = 0; i < CALLS_PER_THREAD; i++) {
+    sum += locked_get_thread_id();
+  }
+  id_sum += sum;
+  return LoopStatus::Continue;
+}
+
+static LoopStatus thread_local_id_task(void *data, const ThreadContext &context)
+{
+  std::atomic<long> *ids_seen = static_cast<std::atomic<long> *>(data);
+  long sum = 0;
+  for (int i = 0; i < CALLS_PER_THREAD; i++) {
+    sum += MtGetThreadID();
+  }
+  ids_seen->fetch_or(1L << (MtGetThreadID() % 64), std::memory_order_relaxed);
+  id_sum += sum;
+  return LoopStatus::Continue;
+}
+
+static double bench_locked_id(int thread_count)
+{
+  const auto start = std::chrono::steady_clock::now();
+  MtRunParallelFor(NULL, locked_id_task, thread_count, 0, thread_count);
+  return elapsed_since(start);
+}
+
+static double bench_thread_local_id(int thread_count, int *distinct_ids)
+{
+  std::atomic<long> ids_seen(0);
+  const auto start = std::chrono::steady_clock::now();
+  MtRunParallelFor(&ids_seen, thread_local_id_task, thread_count, 0, thread_count);
+  const double seconds = elapsed_since(start);
+
+  *distinct_ids = 0;
+  for (int i = 0; i < 64; i++) {
+    *distinct_ids += (ids_seen >> i) & 1;
+  }
+  return seconds;
+}
+
+// checkout of iterations from a shared counter as it used to be
+static double bench_locked_checkout(int thread_count)
+{
+  int index = 0;
+  std::mutex mtx;
+
+  return run_threads(thread_count, [&index, &mtx](int thread_id)
+    {
+      long sum = 0;
+      for (;;) {
+        int id = -1;
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          if (index < LOOP_ITERATIONS) {
+            id = index++;
+          }
+        }
+        if (id == -1) {
+          break;
+        }
+        sum += id;
+      }
+      id_sum += sum;
+    });
+}
+
+// checkout with an atomic counter as ParallelLoop does now. same threads
+// as the mutex case so only the counter differs
+static double bench_atomic_checkout(int thread_count)
+{
+  std::atomic<int> index(0);
+
+  return run_threads(thread_count, [&index](int thread_id)
+    {
+      long sum = 0;
+      for (;;) {
+        const int id = index.fetch_add(1, std::memory_order_relaxed);
+        if (id >= LOOP_ITERATIONS) {
+          break;
+        }
+        sum += id;
+      }
+      id_sum += sum;
+    });
+}
+
+static LoopStatus empty_task(void *data, const ThreadContext &context)
+{
+  long *sums = static_cast<long *>(data);
+  sums[context.thread_id] += context.iteration_id;
+  return LoopStatus::Continue;
+}
+
+// whole loop including pool wake up and a task call per iteration
+static double bench_parallel_for(int thread_count)
+{
+  std::vector<long> sums(thread_count, 0);
+  const auto start = std::chrono::steady_clock::now();
+
+  MtRunParallelFor(&sums[0], empty_task, thread_count, 0, LOOP_ITERATIONS);
+
+  const double seconds = elapsed_since(start);
+  for (long s: sums) {
+    id_sum += s;
+  }
+  return seconds;
+}
+
+static void print_result(const char *name, long count, double seconds)
+{
+  std::cout << "  " << std::left << std::setw(32) << name
+    << std::right << std::setw(10) << std::fixed << std::setprecision(4)
+    << seconds << " sec  "
+    << std::setw(8) << std::setprecision(1) << count / seconds / 1e6
+    << " M/sec\n";
+}
+
+int main(int argc, char **argv)
+{
+  const int requested = argc > 1 ? std::max(1, atoi(argv[1])) : 64;
+  // every case runs with the thread count the pool really gives
+  const int thread_count = get_effective_thread_count(requested);
+  const long id_calls = static_cast<long>(thread_count) * CALLS_PER_THREAD;
+
+  std::cout << "threads: " << thread_count
+    << " (requested: " << requested
+    << ", hardware: " << MtGetMaxAvailableThreadCount() << ")\n";
+
+  std::cout << "MtGetThreadID x " << id_calls << " on pool threads\n";
+  int distinct_ids = 0;
+  const double locked_id = bench_locked_id(thread_count);
+  const double local_id = bench_thread_local_id(thread_count, &distinct_ids);
+  print_result("mutex + map", id_calls, locked_id);
+  print_result("thread_local", id_calls, local_id);
+  std::cout << "  speedup: " << std::setprecision(1)
+    << locked_id / local_id << "x (distinct ids: " << distinct_ids << ")\n";
+
+  std::cout << "iteration checkout x " << LOOP_ITERATIONS << "\n";
+  const double locked_checkout = bench_locked_checkout(thread_count);
+  const double atomic_checkout = bench_atomic_checkout(thread_count);
+  const double pool_loop = bench_parallel_for(thread_count);
+  print_result("mutex counter", LOOP_ITERATIONS, locked_checkout);
+  print_result("atomic counter", LOOP_ITERATIONS, atomic_checkout);
+  print_result("MtRunParallelFor", LOOP_ITERATIONS, pool_loop);
+  std::cout << "  speedup: " << std::setprecision(1)
+    << locked_checkout / atomic_checkout << "x\n";
+
+  // keep the loops from being optimized away
+  return id_sum == -1 ? 1 : 0;
+}
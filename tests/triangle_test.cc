@@ -0,0 +1,79 @@
+// Copyright (c) 2011-2020 Hiroshi Tsubokawa
+// See LICENSE and README
+
+#include "unit_test.h"
+#include "fj_triangle.h"
+#include "fj_vector.h"
+#include <cstdio>
+
+using namespace fj;
+
+int main()
+{
+  const Vector boxcenter(0, 0, 0);
+  const Vector boxhalfsize(1, 1, 1);
+  const Vector no_motion(0, 0, 0);
+
+  {
+    // crossing the box
+    const Vector v0(-2, 0, -2);
+    const Vector v1( 2, 0, -2);
+    const Vector v2( 0, 0,  2);
+
+    TEST(TriBoxIntersect(v0, v1, v2, boxcenter, boxhalfsize));
+    TEST(TriBoxIntersectMotion(v0, v1, v2,
+        no_motion, no_motion, no_motion, boxcenter, boxhalfsize));
+  }
+  {
+    // a vertex touching the face at x = 1
+    const Vector v0(1, 0, 0);
+    const Vector v1(3, 1, 0);
+    const Vector v2(3, -1, 0);
+
+    TEST(TriBoxIntersect(v0, v1, v2, boxcenter, boxhalfsize));
+  }
+  {
+    // above the box
+    const Vector v0(-2, 2, -2);
+    const Vector v1( 2, 2, -2);
+    const Vector v2( 0, 2,  2);
+
+    TEST(!TriBoxIntersect(v0, v1, v2, boxcenter, boxhalfsize));
+    TEST(!TriBoxIntersectMotion(v0, v1, v2,
+        no_motion, no_motion, no_motion, boxcenter, boxhalfsize));
+  }
+  {
+    // bounds overlap the box but the plane passes by a corner
+    const Vector v0(1.5, 1.5, 0);
+    const Vector v1(3, 0, 0);
+    const Vector v2(0, 3, 0);
+
+    TEST(!TriBoxIntersect(v0, v1, v2, boxcenter, boxhalfsize));
+  }
+  {
+    // passes through the box during the sweep. neither start nor end
+    // overlaps the box
+    const Vector v0(-2, -3, -2);
+    const Vector v1( 2, -3, -2);
+    const Vector v2( 0, -3,  2);
+    const Vector vel(0, 6, 0);
+
+    TEST(!TriBoxIntersect(v0, v1, v2, boxcenter, boxhalfsize));
+    TEST(!TriBoxIntersect(v0 + vel, v1 + vel, v2 + vel, boxcenter, boxhalfsize));
+    TEST(TriBoxIntersectMotion(v0, v1, v2, vel, vel, vel, boxcenter, boxhalfsize));
+  }
+  {
+    // moving alongside the box without entering it
+    const Vector v0(-2, -3, 2);
+    const Vector v1( 2, -3, 2);
+    const Vector v2( 0, -3, 4);
+    const Vector vel(0, 6, 0);
+
+    TEST(!TriBoxIntersectMotion(v0, v1, v2, vel, vel, vel, boxcenter, boxhalfsize));
+  }
+
+  printf("%s: %d/%d/%d: (FAIL/PASS/TOTAL)\n", __FILE__,
+      TestGetFailCount(), TestGetPassCount(), TestGetTotalCount());
+
+  return 0;
+}
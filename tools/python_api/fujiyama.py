@@ -187,6 +187,14 @@ class SceneInterface:
 		cmd = 'RunProcedure %s' % (procedure)
 		self.commands.append(cmd)
 
+	def SaveVolume(self, volume, filename):
+		cmd = 'SaveVolume %s %s' % (volume, filename)
+		self.commands.append(cmd)
+
+	def LoadVolume(self, volume, filename):
+		cmd = 'LoadVolume %s %s' % (volume, filename)
+		self.commands.append(cmd)
+
 	def AddObjectToGroup(self, group, object):
 		cmd = 'AddObjectToGroup %s %s' % (group, object)
 		self.commands.append(cmd)
@@ -259,6 +267,10 @@ class SceneInterface:
 		cmd = 'NewMesh %s' % (name)
 		self.commands.append(cmd)
 
+	def NewTessellatedMesh(self, name):
+		cmd = 'NewTessellatedMesh %s' % (name)
+		self.commands.append(cmd)
+
 	def AssignShader(self, object_instance, shading_group, shader):
 		cmd = 'AssignShader %s %s %s' % (object_instance, shading_group, shader)
 		self.commands.append(cmd)
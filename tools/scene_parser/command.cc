@@ -79,6 +79,30 @@ static CommandResult SaveFrameBuffer_run(const CommandArgument *args)
   return result;
 }
 
+/* SaveVolume */
+static const int SaveVolume_args[] = {
+  ARG_COMMAND_NAME,
+  ARG_ENTRY_ID,
+  ARG_FILE_PATH};
+static CommandResult SaveVolume_run(const CommandArgument *args)
+{
+  CommandResult result;
+  result.SetStatus(SiSaveVolume(args[1].GetID(), args[2].GetString()));
+  return result;
+}
+
+/* LoadVolume */
+static const int LoadVolume_args[] = {
+  ARG_COMMAND_NAME,
+  ARG_ENTRY_ID,
+  ARG_FILE_PATH};
+static CommandResult LoadVolume_run(const CommandArgument *args)
+{
+  CommandResult result;
+  result.SetStatus(SiLoadVolume(args[1].GetID(), args[2].GetString()));
+  return result;
+}
+
 /* AddObjectToGroup */
 static const int AddObjectToGroup_args[] = {
   ARG_COMMAND_NAME,
@@ -266,6 +290,18 @@ static CommandResult NewMesh_run(const CommandArgument *args)
   return result;
 }
 
+/* NewTessellatedMesh */
+static const int NewTessellatedMesh_args[] = {
+  ARG_COMMAND_NAME,
+  ARG_NEW_ENTRY_ID};
+static CommandResult NewTessellatedMesh_run(const CommandArgument *args)
+{
+  CommandResult result;
+  result.SetEntryID(SiNewTessellatedMesh());
+  result.SetEntryName(args[1].GetString());
+  return result;
+}
+
 /* AssignFrameBuffer */
 static const int AssignFrameBuffer_args[] = {
   ARG_COMMAND_NAME,
@@ -506,6 +542,8 @@ static const Command command_list[] = {
   REGISTER_COMMAND(RenderScene),
   REGISTER_COMMAND(RunProcedure),
   REGISTER_COMMAND(SaveFrameBuffer),
+  REGISTER_COMMAND(SaveVolume),
+  REGISTER_COMMAND(LoadVolume),
   REGISTER_COMMAND(AddObjectToGroup),
   REGISTER_COMMAND(NewObjectInstance),
   REGISTER_COMMAND(NewFrameBuffer),
@@ -521,6 +559,7 @@ static const Command command_list[] = {
   REGISTER_COMMAND(NewCurve),
   REGISTER_COMMAND(NewLight),
   REGISTER_COMMAND(NewMesh),
+  REGISTER_COMMAND(NewTessellatedMesh),
   REGISTER_COMMAND(AssignFrameBuffer),
   REGISTER_COMMAND(AssignObjectGroup),
   REGISTER_COMMAND(AssignPointCloud),